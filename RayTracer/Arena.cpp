@@ -0,0 +1,145 @@
+#include "Arena.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <new>
+
+#if defined(_DEBUG) && !defined(ARENA_COUNT_ALLOCATIONS)
+#define ARENA_COUNT_ALLOCATIONS
+#endif
+
+//Smallest block allocated when an arena grows
+#define ARENA_MIN_BLOCK (64 * 1024)
+
+static char* alignPointer(char* pointer, size_t alignment)
+{
+	return (char*)(((uintptr_t)pointer + alignment - 1) & ~(uintptr_t)(alignment - 1));
+}
+
+Arena::Arena(size_t capacity)
+{
+	if (capacity > 0)
+	{
+		_block = (char*)::operator new(capacity);
+		_capacity = capacity;
+	}
+}
+
+Arena::~Arena()
+{
+	reset();
+	::operator delete(_block);
+}
+
+void* Arena::alloc(size_t size, size_t alignment)
+{
+	if (_block)
+	{
+		char* pointer = alignPointer(_block + _used, alignment);
+		size_t end = (size_t)(pointer - _block) + size;
+		if (end <= _capacity)
+		{
+			_used = end;
+			_peak = std::max(_peak, _used + _overflowSize);
+			return pointer;
+		}
+	}
+
+	//Full, the block is grown at the next reset
+	void* overflow = ::operator new(size + alignment);
+	_overflow.push_back(overflow);
+	_overflowSize += size + alignment;
+	_peak = std::max(_peak, _used + _overflowSize);
+	return alignPointer((char*)overflow, alignment);
+}
+
+void Arena::reset()
+{
+	if (!_overflow.empty())
+	{
+		for (size_t i = 0; i < _overflow.size(); i++)
+			::operator delete(_overflow[i]);
+		_overflow.clear();
+		_overflowSize = 0;
+
+		size_t capacity = ARENA_MIN_BLOCK;
+		while (capacity < _peak)
+			capacity *= 2;
+		::operator delete(_block);
+		_block = (char*)::operator new(capacity);
+		_capacity = capacity;
+	}
+	_used = 0;
+}
+
+void Arena::rewind(size_t mark)
+{
+	_used = std::min(mark, _used);
+}
+
+Arena & arena_Frame()
+{
+	static Arena arena;
+	return arena;
+}
+
+Arena & arena_Thread()
+{
+	static thread_local Arena arena;
+	return arena;
+}
+
+#ifdef ARENA_COUNT_ALLOCATIONS
+
+//Replaces the global operator new to count the allocations, operator delete has to match it
+static std::atomic<long long> heapAllocations{ 0 };
+
+void* operator new(size_t size)
+{
+	heapAllocations.fetch_add(1, std::memory_order_relaxed);
+	void* pointer = malloc(size > 0 ? size : 1);
+	if (!pointer)
+		throw std::bad_alloc();
+	return pointer;
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void* pointer) noexcept
+{
+	free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept
+{
+	free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept
+{
+	free(pointer);
+}
+
+void operator delete[](void* pointer, size_t) noexcept
+{
+	free(pointer);
+}
+
+long long heap_AllocationCount()
+{
+	return heapAllocations.load(std::memory_order_relaxed);
+}
+
+#else
+
+long long heap_AllocationCount()
+{
+	return -1;
+}
+
+#endif
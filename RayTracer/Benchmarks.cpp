@@ -0,0 +1,791 @@
+#include "Benchmarks.h"
+#include "RayTracer.h"
+#include "Utils.h"
+#include "GpuTimer.h"
+#include "Denoiser.h"
+#include "JobSystem.h"
+#include "Intersect.h"
+#include "TraceShared.h"
+#include "PerfCounters.h"
+
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+//The denoiser benchmark compares a few samples per pixel denoised with DENOISE_REFERENCE_SAMPLES samples
+#define DENOISE_REFERENCE_SAMPLES 1024
+
+//The traversal benchmark keeps the best of ORDER_BENCH_CPU_RUNS CPU traces in each order
+#define ORDER_BENCH_CPU_RUNS 3
+
+//*** Multi-view batches ***************************************************************************
+
+//Copy of the trace texture into a layer of viewsTexture
+struct ViewCopy
+{
+	int layer, width, height;
+};
+ViewCopy viewCopy;
+
+void viewCopyPass(void* data)
+{
+	const ViewCopy & copy = *(const ViewCopy*)data;
+	glCopyImageSubData(texture, GL_TEXTURE_2D, 0, 0, 0, 0, viewsTexture, GL_TEXTURE_2D_ARRAY, 0, 0, 0, copy.layer, copy.width, copy.height, 1);
+}
+
+//Turntable around the focus, the same views traced one render at a time then batched
+void benchmarkViews(int width, int height, int depth, int viewsNbr)
+{
+	std::vector<glm::mat4> cameras;
+	glm::mat4 startView = view;
+	double startEye[3] = { eye[0], eye[1], eye[2] };
+	for (int v = 0; v < viewsNbr; v++)
+	{
+		cameras.push_back(view);
+		orbitCamera(2.0 * glm::pi<double>() / viewsNbr, 0.0);
+	}
+	for (int c = 0; c < 3; c++)
+		eye[c] = startEye[c];
+	view = startView;
+
+	resizeViewTargets(width, height, viewsNbr);
+	GpuTimer timer;
+	timer.init(1);
+	double gpuMs[2] = { 1e30, 1e30 }, cpuMs[2] = { 1e30, 1e30 };
+	std::vector<float> layers[2];
+	for (int mode = 0; mode < 2; mode++)
+	{
+		for (int run = 0; run < 5; run++)
+		{
+			glFinish();
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			timer.begin();
+			if (mode == 0)
+			{
+				//Reference: one render per view, copied into its layer
+				for (int v = 0; v < viewsNbr; v++)
+				{
+					view = cameras[v];
+					glm::vec4 viewEye = glm::inverse(view)[3];
+					eye[0] = viewEye.x; eye[1] = viewEye.y; eye[2] = viewEye.z;
+					renderGraph.reset();
+					int target = addTraceRegion(width, height, 0, 0, width, height, depth);
+					int layers = renderGraph.importTexture("views", viewsTexture, width, height * viewsNbr, GL_RGBA32F);
+					viewCopy = { v, width, height };
+					int copy = renderGraph.addPass("viewCopy", &viewCopyPass, &viewCopy);
+					renderGraph.read(copy, target, RENDER_COPY);
+					renderGraph.write(copy, layers, RENDER_COPY);
+					renderGraph.execute();
+				}
+			}
+			else
+			{
+				traceViews(cameras, width, height, depth);
+			}
+			timer.end();
+			glFinish();
+			cpuMs[mode] = std::min(cpuMs[mode], std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+			timer.finish();
+			double elapsedMs;
+			while (timer.fetch(elapsedMs))
+				gpuMs[mode] = std::min(gpuMs[mode], elapsedMs);
+		}
+		read_TextureLayers(viewsTexture, width, height, viewsNbr, layers[mode]);
+	}
+	timer.release();
+	for (int c = 0; c < 3; c++)
+		eye[c] = startEye[c];
+	view = startView;
+
+	fprintf(stdout, "%d views of %dx%d depth %d: one render per view %.3f ms GPU (%.3f ms CPU), batched %.3f ms GPU (%.3f ms CPU), %.2fx\n",
+		viewsNbr, width, height, depth, gpuMs[0], cpuMs[0], gpuMs[1], cpuMs[1], gpuMs[0] / gpuMs[1]);
+	fprintf(stdout, "Batched views against one render per view: RMSE %.6f\n", compute_RMSE(layers[1], layers[0]));
+}
+
+//*** Frame benchmarks *****************************************************************************
+
+//Compare the reduced resolution reflections against full resolution ones
+void reportReflectionError(int width, int height, int depth)
+{
+	std::vector<float> reference, image;
+	int scale = reflectionScale;
+
+	reflectionScale = 1;
+	render(width, height, depth);
+	read_Texture(texture, width, height, reference);
+
+	reflectionScale = scale;
+	render(width, height, depth);
+	read_Texture(texture, width, height, image);
+
+	double rmse = compute_RMSE(image, reference);
+	fprintf(stdout, "Reflections at 1/%d resolution: RMSE %.5f, PSNR %.2f dB against full resolution\n",
+		scale, rmse, rmse > 0.0 ? 20.0 * log10(1.0 / rmse) : 999.0);
+}
+
+//Render frames as fast as possible and report the GPU time spent per frame
+void benchmark(int width, int height, int depth, int frames)
+{
+	GpuTimer timer;
+	timer.init();
+	glfwSwapInterval(0);
+
+	if (temporalRefresh > 0)
+		readTracedFraction();
+	//The counting shader is compiled on its first dispatch, keep that out of the ray rate
+	if (rayStats)
+	{
+		render(width, height, depth);
+		glFinish();
+		readRayStats();
+		resetRayStats();
+	}
+
+	std::vector<double> frameTimes;
+	frameDataRing.takeWaitMs();
+	traceTargetWaitMs = 0.0;
+	traceTargetWaits = 0;
+	renderGraph.startTiming();
+	if (profileFrames > 0)
+		profile_Start(std::min(profileFrames, frames));
+	//Throughput over the wall clock, the frames overlap on the GPU and in the presentation
+	glFinish();
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int f = 0; f < frames; f++)
+	{
+		orbitCamera(glm::radians(orbitStep), 0.0);
+		timer.begin();
+		render(width, height, depth);
+		timer.end();
+		glfwSwapBuffers(glContext);
+		glfwPollEvents();
+		if (profile_FrameEnd())
+			profile_Write(profilePath);
+		if (rayStats)
+			readRayStats();
+
+		double elapsedMs;
+		while (timer.fetch(elapsedMs))
+		{
+			frameTimes.push_back(elapsedMs);
+			statsGpuMs += elapsedMs;
+			if (targetFrameMs > 0.0)
+				governResolution(elapsedMs);
+		}
+	}
+	glFinish();
+	double wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	timer.finish();
+	double elapsedMs;
+	while (timer.fetch(elapsedMs))
+	{
+		frameTimes.push_back(elapsedMs);
+		statsGpuMs += elapsedMs;
+	}
+	timer.release();
+	if (rayStats)
+		reportRayStats();
+	renderGraph.report();
+
+	//The first frames include the driver warm up
+	size_t skipped = frameTimes.size() > 10 ? frameTimes.size() / 10 : frameTimes.size() > 1 ? 1 : 0;
+	double total = 0.0, best = 1e30;
+	for (size_t f = skipped; f < frameTimes.size(); f++)
+	{
+		total += frameTimes[f];
+		best = std::min(best, frameTimes[f]);
+	}
+	fprintf(stdout, "Benchmark %dx%d depth %d, %s primary visibility: %.3f ms/frame (best %.3f ms) over %d frames\n",
+		width, height, depth, rasterPrimary ? "rasterized" : "ray traced",
+		total / (frameTimes.size() - skipped), best, (int)(frameTimes.size() - skipped));
+	fprintf(stdout, "Throughput without vsync: %.1f frames/s, %.3f ms/frame of wall clock with %d trace target%s, %d waits for a target, %.3f ms in total\n",
+		frames * 1000.0 / wallMs, wallMs / frames, traceTargetsNbr, traceTargetsNbr > 1 ? "s" : "", traceTargetWaits, traceTargetWaitMs);
+	int waits;
+	double waitMs = frameDataRing.takeWaitMs(&waits);
+	fprintf(stdout, "Frame data: %s ring, %d waits for the GPU to release a region, %.3f ms in total\n",
+		frameDataRing.persistent() ? "persistently mapped" : "glBufferSubData", waits, waitMs);
+	if (temporalRefresh > 0)
+		fprintf(stdout, "Temporal cache: %.1f%% of the pixels shaded from scratch\n", 100.0 * readTracedFraction());
+}
+
+//GPU time per frame of the generated scene with objectsNbr objects and lightsNbr lights
+static double timeGeneratedScene(int objectsNbr, int lightsNbr, int width, int height, int depth, int frames)
+{
+	generateScene(generatedKind, objectsNbr, lightsNbr, sceneSeed, scene);
+	uploadScene(scene, sceneBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, sceneBuffer);
+
+	//The first frame after an upload pays for the transfer
+	render(width, height, depth);
+	glFinish();
+	return timeFrames(width, height, depth, frames);
+}
+
+//Scaling curves of the generated scene, one point per line as CSV: the object count by factors of 10 up to the
+//generated count, then the light count by factors of 2 and the depth from 0, both with all the generated objects
+void benchmarkScaling(int width, int height, int depth, int frames)
+{
+	glfwSwapInterval(0);
+	double pixels = (double)width * height;
+	fprintf(stdout, "Scaling of the %s scene, seed %u, at %dx%d over %d frames per point\n", generatedKind, sceneSeed, width, height, frames);
+	fprintf(stdout, "sweep,objects,lights,depth,ms/frame,ns/pixel\n");
+	for (int objectsNbr = 10; ; objectsNbr *= 10)
+	{
+		objectsNbr = std::min(objectsNbr, generatedObjectsNbr);
+		double ms = timeGeneratedScene(objectsNbr, generatedLightsNbr, width, height, depth, frames);
+		fprintf(stdout, "objects,%d,%d,%d,%.3f,%.2f\n", objectsNbr, generatedLightsNbr, depth, ms, ms * 1e6 / pixels);
+		if (objectsNbr == generatedObjectsNbr)
+			break;
+	}
+	for (int lightsNbr = 1; ; lightsNbr *= 2)
+	{
+		lightsNbr = std::min(lightsNbr, generatedLightsNbr);
+		double ms = timeGeneratedScene(generatedObjectsNbr, lightsNbr, width, height, depth, frames);
+		fprintf(stdout, "lights,%d,%d,%d,%.3f,%.2f\n", generatedObjectsNbr, lightsNbr, depth, ms, ms * 1e6 / pixels);
+		if (lightsNbr == generatedLightsNbr)
+			break;
+	}
+	for (int d = 0; d <= depth; d++)
+	{
+		double ms = timeGeneratedScene(generatedObjectsNbr, generatedLightsNbr, width, height, d, frames);
+		fprintf(stdout, "depth,%d,%d,%d,%.3f,%.2f\n", generatedObjectsNbr, generatedLightsNbr, d, ms, ms * 1e6 / pixels);
+	}
+}
+
+//Renders the frame on the GPU and on the CPU, both from the shared intersection and shading code, and prints the
+//time of each and their difference. The rounding of the GPU flips a few isolated pixels between lit and shadowed,
+//or between two faces of a box: outputs false when over 1% of the pixels differ by more than 2/255
+bool compareCpuTrace(int width, int height, int depth)
+{
+	//Once untimed for the driver warm up
+	render(width, height, depth);
+	glFinish();
+	GpuTimer timer;
+	timer.init();
+	timer.begin();
+	render(width, height, depth);
+	timer.end();
+	timer.finish();
+	double gpuMs = 0.0;
+	timer.fetch(gpuMs);
+	timer.release();
+	std::vector<float> gpuImage;
+	read_Texture(texture, width, height, gpuImage);
+
+	std::vector<float> cpuImage((size_t)width * height * 4);
+	trace_SetScene(scene, (float)dnear, (float)dfar, depth);
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	trace_RenderCpu(glm::inverse(projection * view), glm::vec3(eye[0], eye[1], eye[2]), width, height, cpuImage.data(), mortonOrder);
+	double cpuMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	int differing = 0;
+	float maxDifference = 0.0f;
+	for (size_t p = 0; p < cpuImage.size(); p += 4)
+	{
+		float difference = 0.0f;
+		for (int c = 0; c < 3; c++)
+			difference = std::max(difference, fabsf(cpuImage[p + c] - gpuImage[p + c]));
+		maxDifference = std::max(maxDifference, difference);
+		differing += difference > 2.0f / 255.0f;
+	}
+	bool match = differing <= width * height / 100;
+	fprintf(stdout, "Shared trace code %dx%d depth %d, %d objects: GPU %.3f ms, CPU %.3f ms (%d threads)\n",
+		width, height, depth, (int)scene.objects.size(), gpuMs, cpuMs, jobs_ThreadCount());
+	fprintf(stdout, "  RMSE %.6f, max difference %.4f, %d pixels differ by over 2/255: %s\n",
+		compute_RMSE(cpuImage, gpuImage), maxDifference, differing, match ? "match" : "MISMATCH");
+	return match;
+}
+
+//Misses per 100 events, or n/a when the counters are missing
+static std::string missRate(long long misses, long long events)
+{
+	char text[64] = "n/a";
+	if (misses >= 0 && events > 0)
+		snprintf(text, sizeof(text), "%.2f%% of %lld", 100.0 * misses / events, events);
+	return text;
+}
+
+//Row-major against Morton order, with the workgroup size of the raytracing shader: the GPU time per frame with
+//each order, the CPU time of the shared trace code on all the threads, best of ORDER_BENCH_CPU_RUNS, and the cache
+//counters of one thread tracing the whole frame. Both orders trace the same pixels, the images must be identical
+void benchmarkTraversal(int width, int height, int depth, int frames)
+{
+	glfwSwapInterval(0);
+	bool wasMorton = mortonOrder, wasProgressive = progressive;
+	progressive = false;
+	trace_SetScene(scene, (float)dnear, (float)dfar, depth);
+	glm::mat4 invProjectionView = glm::inverse(projection * view);
+	glm::vec3 eyePosition(eye[0], eye[1], eye[2]);
+	PerfCounters counters;
+	bool counting = counters.open();
+
+	double gpuMs[2], cpuMs[2];
+	long long counts[2][PERF_EVENTS_NBR];
+	std::vector<float> gpuImage[2], cpuImage[2];
+	for (int order = 0; order < 2; order++)
+	{
+		mortonOrder = order == 1;
+		if (!buildTraceShader(traceGroupX, traceGroupY))
+		{
+			error_callback(1, "Raytracing Shader Error\n");
+			return;
+		}
+		//Once untimed for the driver warm up
+		render(width, height, depth);
+		glFinish();
+		gpuMs[order] = timeFrames(width, height, depth, frames);
+		read_Texture(texture, width, height, gpuImage[order]);
+
+		cpuImage[order].resize((size_t)width * height * 4);
+		cpuMs[order] = 1e30;
+		for (int r = 0; r <= ORDER_BENCH_CPU_RUNS; r++)
+		{
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			trace_RenderCpu(invProjectionView, eyePosition, width, height, cpuImage[order].data(), mortonOrder);
+			if (r > 0)
+				cpuMs[order] = std::min(cpuMs[order], std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+		}
+		counters.start();
+		trace_RenderCpu(invProjectionView, eyePosition, width, height, cpuImage[order].data(), mortonOrder, false);
+		counters.stop(counts[order]);
+	}
+	mortonOrder = wasMorton;
+	progressive = wasProgressive;
+	buildTraceShader(traceGroupX, traceGroupY);
+
+	int tileX = traceGroupX, tileY = traceGroupY;
+	mortonTile(traceGroupX, traceGroupY, tileX, tileY);
+	fprintf(stdout, "Traversal order %dx%d depth %d, %d objects: workgroups of %dx%d invocations over %dx%d pixel tiles in Morton order,"
+		" CPU tiles of %dx%d\n", width, height, depth, (int)scene.objects.size(), traceGroupX, traceGroupY, tileX, tileY, TRACE_CPU_TILE, TRACE_CPU_TILE);
+	const char* names[2] = { "Row-major", "Morton   " };
+	for (int order = 0; order < 2; order++)
+		fprintf(stdout, "  %s GPU %9.3f ms/frame, CPU %9.3f ms/frame (%d threads), one thread: L1D read misses %s, LLC misses %s\n",
+			names[order], gpuMs[order], cpuMs[order], jobs_ThreadCount(), missRate(counts[order][PERF_L1D_READ_MISSES], counts[order][PERF_L1D_READS]).c_str(),
+			missRate(counts[order][PERF_LLC_MISSES], counts[order][PERF_LLC_REFERENCES]).c_str());
+	if (!counting)
+		fprintf(stdout, "  No cache counters: perf_event_open is not available, or not allowed by perf_event_paranoid\n");
+	fprintf(stdout, "  Morton against row-major: GPU x%.2f, CPU x%.2f, RMSE %.6f on the GPU and %.6f on the CPU\n", gpuMs[0] / gpuMs[1],
+		cpuMs[0] / cpuMs[1], compute_RMSE(gpuImage[1], gpuImage[0]), compute_RMSE(cpuImage[1], cpuImage[0]));
+}
+
+//Path trace a reference and a frame of a few samples per pixel, denoise the frame on the GPU and on the CPU,
+//and print the time of each denoiser and the error of its output against the reference
+void benchmarkDenoiser(int width, int height, int depth, int samples)
+{
+	const int runs = 10;
+	double threshold = noiseThreshold;
+	//No tile ever converges, each dispatch adds exactly one sample
+	noiseThreshold = -1.0;
+
+	std::vector<float> reference, noisy, albedo, normalDepth;
+	pathSeed = 0x5EED;
+	resetAccumulation();
+	for (int s = 0; s < DENOISE_REFERENCE_SAMPLES; s++)
+	{
+		pathTraceFrame(width, height, depth);
+		//Keep the queue short, some drivers reset long command streams
+		if (s % 16 == 15)
+			glFinish();
+	}
+	read_Texture(texture, width, height, reference);
+
+	//Samples independent from the reference ones
+	pathSeed = 0;
+	resetAccumulation();
+	for (int s = 0; s < samples; s++)
+		pathTraceFrame(width, height, depth);
+	read_Texture(texture, width, height, noisy);
+	read_Texture(albedoTexture, width, height, albedo);
+	read_Texture(normalDepthTexture, width, height, normalDepth);
+	noiseThreshold = threshold;
+
+	//GPU, once untimed for the driver warm up
+	GpuTimer timer;
+	timer.init();
+	denoiseFrame(width, height);
+	GLuint denoised = 0;
+	double gpuMs = 0.0, elapsedMs;
+	for (int r = 0; r < runs; r++)
+	{
+		timer.begin();
+		denoised = denoiseFrame(width, height);
+		timer.end();
+		while (timer.fetch(elapsedMs))
+			gpuMs += elapsedMs / runs;
+	}
+	timer.finish();
+	while (timer.fetch(elapsedMs))
+		gpuMs += elapsedMs / runs;
+	timer.release();
+	std::vector<float> gpuImage;
+	read_Texture(denoised, width, height, gpuImage);
+
+	//CPU, scalar then SIMD, the best of the runs after an untimed one
+	AtrousDenoiser denoiser;
+	std::vector<float> cpuImage[2];
+	double cpuMs[2];
+	for (int simd = 0; simd < 2; simd++)
+	{
+		cpuImage[simd].resize(noisy.size());
+		cpuMs[simd] = 1e30;
+		for (int r = 0; r <= runs; r++)
+		{
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			denoiser.denoise(noisy.data(), albedo.data(), normalDepth.data(), width, height, cpuImage[simd].data(), simd == 1);
+			if (r > 0)
+				cpuMs[simd] = std::min(cpuMs[simd], std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+		}
+	}
+
+	fprintf(stdout, "Denoiser %dx%d depth %d, %d samples per pixel against %d, RMSE of the noisy frame %.5f\n",
+		width, height, depth, samples, DENOISE_REFERENCE_SAMPLES, compute_RMSE(noisy, reference));
+	fprintf(stdout, "  GPU a-trous: %.3f ms/frame, RMSE %.5f\n", gpuMs, compute_RMSE(gpuImage, reference));
+	fprintf(stdout, "  CPU scalar:  %.3f ms/frame, RMSE %.5f\n", cpuMs[0], compute_RMSE(cpuImage[0], reference));
+	fprintf(stdout, "  CPU %s %.3f ms/frame, RMSE %.5f, RMSE %.6f against the GPU (%d threads)\n", AtrousDenoiser::simdAvailable() ? "SSE2:   " : "no SIMD:",
+		cpuMs[1], compute_RMSE(cpuImage[1], reference), compute_RMSE(cpuImage[1], gpuImage), jobs_ThreadCount());
+}
+
+//Scaling of the job system from 1 to 64 threads, on a fine grained parallel-for and on the CPU denoiser
+//of a synthetic 1080p frame. Needs no GL context
+int benchmarkThreads(bool pin)
+{
+	const int width = 1920, height = 1080;
+	const int items = 1 << 22;
+	std::vector<float> color((size_t)width * height * 4), albedo(color.size()), normalDepth(color.size()), output(color.size());
+	unsigned int noise = 1;
+	for (int y = 0; y < height; y++)
+		for (int x = 0; x < width; x++)
+		{
+			float* pixel = &color[((size_t)y * width + x) * 4];
+			noise = noise * 1664525u + 1013904223u;
+			float value = (float)x / width + (noise >> 8) / 16777216.0f - 0.5f;
+			pixel[0] = pixel[1] = pixel[2] = value;
+			pixel[3] = 1.0f;
+			float* guides = &albedo[((size_t)y * width + x) * 4];
+			guides[0] = (float)((x / 240) % 2);
+			guides[1] = (float)((y / 135) % 2);
+			guides[2] = 0.5f;
+			guides = &normalDepth[((size_t)y * width + x) * 4];
+			guides[0] = guides[1] = 0.0f;
+			guides[2] = 1.0f;
+			guides[3] = 100.0f + 0.1f * y;
+		}
+	std::vector<float> values(items);
+	AtrousDenoiser denoiser;
+
+	fprintf(stdout, "Job system scaling on %u hardware threads%s\n", std::thread::hardware_concurrency(), pin ? ", pinned" : "");
+	double baseline[2] = { 0.0, 0.0 };
+	for (int threads = 1; threads <= 64; threads *= 2)
+	{
+		jobs_Init(threads, pin);
+		double ms[2] = { 1e30, 1e30 };
+		for (int r = 0; r < 5; r++)
+		{
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			jobs_ParallelFor(0, items, 256, [&](int begin, int end)
+			{
+				for (int i = begin; i < end; i++)
+				{
+					float value = (float)i;
+					for (int k = 0; k < 16; k++)
+						value = sqrtf(value + k);
+					values[i] = value;
+				}
+			});
+			ms[0] = std::min(ms[0], std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+		}
+		for (int r = 0; r < 3; r++)
+		{
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			denoiser.denoise(color.data(), albedo.data(), normalDepth.data(), width, height, output.data());
+			ms[1] = std::min(ms[1], std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+		}
+		if (threads == 1)
+		{
+			baseline[0] = ms[0];
+			baseline[1] = ms[1];
+		}
+		fprintf(stdout, "%2d threads: parallel-for of %d items %.3f ms (x%.2f), 1080p denoiser %.3f ms (x%.2f)\n",
+			threads, items, ms[0], baseline[0] / ms[0], ms[1], baseline[1] / ms[1]);
+	}
+	jobs_Shutdown();
+	return 1;
+}
+
+
+//*** Intersection kernels ***************************************************************************
+
+//Rays and objects of the intersection benchmark, and the time and number of runs of each measurement
+#define INTERSECT_BENCH_RAYS 4096
+#define INTERSECT_BENCH_OBJECTS 64
+#define INTERSECT_BENCH_RUNS 9
+#define INTERSECT_BENCH_RUN_MS 20.0
+
+struct IntersectBenchData
+{
+	bool boxes;
+	std::vector<Ray> rays;
+	std::vector<RayPacket4> packets;
+	std::vector<SceneObject> objects;
+	std::vector<Boxes4> boxes4;
+	std::vector<Spheres4> spheres4;
+};
+
+//Keeps the normals alive, the scalar kernels compute one per test as the shader does
+static volatile float normalSink;
+
+static float objectIntersect(const IntersectBenchData & data, const Ray & ray, int o, glm::vec3 & normal)
+{
+	const SceneObject & object = data.objects[o];
+	return data.boxes ? boxIntersect(ray, object.min, object.max, normal) : sphereIntersect(ray, object.pos, object.r, normal);
+}
+
+//Closest hit of each ray, -1 on a miss, as intersectObjects finds it
+static void intersectScalar(const IntersectBenchData & data, float* closest)
+{
+	glm::vec3 normalSum(0.0f);
+	for (size_t r = 0; r < data.rays.size(); r++)
+	{
+		float best = (float)dfar;
+		glm::vec3 bestNormal(0.0f), normal;
+		for (int o = 0; o < (int)data.objects.size(); o++)
+		{
+			float dist = objectIntersect(data, data.rays[r], o, normal);
+			if (dist > 0.0f && dist < best)
+			{
+				best = dist;
+				bestNormal = normal;
+			}
+		}
+		closest[r] = best < (float)dfar ? best : -1.0f;
+		normalSum += bestNormal;
+	}
+	normalSink = normalSum.x;
+}
+
+//Four objects at a time, the normal of the closest hit only. The objects past the last group of four are tested one by one
+static void intersectSimd(const IntersectBenchData & data, float* closest)
+{
+	glm::vec3 normalSum(0.0f), normal;
+	int groups = (int)data.boxes4.size();
+	for (size_t r = 0; r < data.rays.size(); r++)
+	{
+		float best = (float)dfar;
+		int bestObject = -1;
+		for (int g = 0; g < groups; g++)
+		{
+			float dist[4];
+			if (data.boxes)
+				boxIntersect4(data.rays[r], data.boxes4[g], dist);
+			else
+				sphereIntersect4(data.rays[r], data.spheres4[g], dist);
+			for (int lane = 0; lane < 4; lane++)
+				if (dist[lane] > 0.0f && dist[lane] < best)
+				{
+					best = dist[lane];
+					bestObject = 4 * g + lane;
+				}
+		}
+		for (int o = 4 * groups; o < (int)data.objects.size(); o++)
+		{
+			float dist = objectIntersect(data, data.rays[r], o, normal);
+			if (dist > 0.0f && dist < best)
+			{
+				best = dist;
+				bestObject = o;
+			}
+		}
+		closest[r] = bestObject >= 0 ? best : -1.0f;
+		if (bestObject >= 0)
+		{
+			objectIntersect(data, data.rays[r], bestObject, normal);
+			normalSum += normal;
+		}
+	}
+	normalSink = normalSum.x;
+}
+
+//Four rays at a time, the normal of the closest hit only. The rays past the last packet are traced one by one
+static void intersectPacket(const IntersectBenchData & data, float* closest)
+{
+	glm::vec3 normalSum(0.0f), normal;
+	for (size_t p = 0; p < data.packets.size(); p++)
+	{
+		float best[4] = { (float)dfar, (float)dfar, (float)dfar, (float)dfar };
+		int bestObject[4] = { -1, -1, -1, -1 };
+		for (int o = 0; o < (int)data.objects.size(); o++)
+		{
+			const SceneObject & object = data.objects[o];
+			float dist[4];
+			if (data.boxes)
+				boxIntersectPacket(data.packets[p], object.min, object.max, dist);
+			else
+				sphereIntersectPacket(data.packets[p], object.pos, object.r, dist);
+			for (int lane = 0; lane < 4; lane++)
+				if (dist[lane] > 0.0f && dist[lane] < best[lane])
+				{
+					best[lane] = dist[lane];
+					bestObject[lane] = o;
+				}
+		}
+		for (int lane = 0; lane < 4; lane++)
+		{
+			closest[4 * p + lane] = bestObject[lane] >= 0 ? best[lane] : -1.0f;
+			if (bestObject[lane] >= 0)
+			{
+				objectIntersect(data, data.rays[4 * p + lane], bestObject[lane], normal);
+				normalSum += normal;
+			}
+		}
+	}
+	for (size_t r = 4 * data.packets.size(); r < data.rays.size(); r++)
+	{
+		float best = (float)dfar;
+		glm::vec3 bestNormal(0.0f);
+		for (int o = 0; o < (int)data.objects.size(); o++)
+		{
+			float dist = objectIntersect(data, data.rays[r], o, normal);
+			if (dist > 0.0f && dist < best)
+			{
+				best = dist;
+				bestNormal = normal;
+			}
+		}
+		closest[r] = best < (float)dfar ? best : -1.0f;
+		normalSum += bestNormal;
+	}
+	normalSink = normalSum.x;
+}
+
+//Ray/object tests of the C++ ports of boxIntersect and sphereIntersect: scalar, SIMD and packets of four rays,
+//on rays scattered at random over the scene and on the coherent rays of a camera. The data comes from a fixed
+//seed and each kernel is timed over several runs, the median and the spread tell a regression from the noise.
+//Needs no GL context
+int benchmarkIntersections()
+{
+	unsigned int noise = 1;
+	auto random01 = [&]() { noise = noise * 1664525u + 1013904223u; return (noise >> 8) / 16777216.0f; };
+
+	//Random rays, from around the scene toward a point in it
+	std::vector<Ray> randomRays(INTERSECT_BENCH_RAYS);
+	for (size_t r = 0; r < randomRays.size(); r++)
+	{
+		randomRays[r].origin = glm::vec3(1000.0f * random01() - 500.0f, 1000.0f * random01() - 500.0f, 500.0f * random01());
+		glm::vec3 target(700.0f * random01() - 350.0f, 700.0f * random01() - 350.0f, 300.0f * random01());
+		randomRays[r].dir = glm::normalize(target - randomRays[r].origin);
+	}
+
+	//Coherent rays, the pixels of the default camera in quads of 2x2 so that the packets are coherent too
+	int side = (int)sqrtf((float)INTERSECT_BENCH_RAYS);
+	std::vector<Ray> coherentRays(INTERSECT_BENCH_RAYS);
+	glm::vec3 cameraEye((float)eye[0], (float)eye[1], (float)eye[2]);
+	glm::vec3 forward = glm::normalize(glm::vec3((float)focus[0], (float)focus[1], (float)focus[2]) - cameraEye);
+	glm::vec3 right = glm::normalize(glm::cross(forward, glm::vec3(0.0f, 0.0f, 1.0f)));
+	glm::vec3 up = glm::cross(right, forward);
+	float halfSize = tanf(0.5f * (float)hfov);
+	for (int r = 0; r < (int)coherentRays.size(); r++)
+	{
+		int quad = r / 4, lane = r % 4;
+		int x = 2 * (quad % (side / 2)) + (lane & 1), y = 2 * (quad / (side / 2)) + (lane >> 1);
+		glm::vec2 offset = (2.0f * glm::vec2(x + 0.5f, y + 0.5f) / (float)side - 1.0f) * halfSize;
+		coherentRays[r].origin = cameraEye;
+		coherentRays[r].dir = glm::normalize(forward + offset.x * right + offset.y * up);
+	}
+
+	//Objects of the generated scenes, without their floor
+	Scene generated[2];
+	generateScene("clusters", INTERSECT_BENCH_OBJECTS + 1, 1, 1, generated[0]);
+	generateScene("spheres", INTERSECT_BENCH_OBJECTS + 1, 1, 1, generated[1]);
+
+	typedef void(*IntersectKernel)(const IntersectBenchData &, float*);
+	const IntersectKernel kernels[3] = { intersectScalar, intersectSimd, intersectPacket };
+	const char* kernelNames[3] = { "scalar", intersectSimdAvailable() ? "SIMD x4" : "no SIMD", "packet" };
+
+	fprintf(stdout, "Intersection kernels, %d rays x %d objects, ns per test: median of %d runs of %.0f ms, best and spread\n",
+		INTERSECT_BENCH_RAYS, INTERSECT_BENCH_OBJECTS, INTERSECT_BENCH_RUNS, INTERSECT_BENCH_RUN_MS);
+	int mismatches = 0;
+	for (int kind = 0; kind < 2; kind++)
+		for (int coherent = 0; coherent < 2; coherent++)
+		{
+			IntersectBenchData data;
+			data.boxes = kind == 0;
+			data.rays = coherent ? coherentRays : randomRays;
+			data.objects.assign(generated[kind].objects.begin() + 1, generated[kind].objects.end());
+			data.packets.resize(data.rays.size() / 4);
+			for (size_t r = 0; r < 4 * data.packets.size(); r++)
+			{
+				RayPacket4 & packet = data.packets[r / 4];
+				int lane = (int)(r % 4);
+				packet.originX[lane] = data.rays[r].origin.x;
+				packet.originY[lane] = data.rays[r].origin.y;
+				packet.originZ[lane] = data.rays[r].origin.z;
+				packet.dirX[lane] = data.rays[r].dir.x;
+				packet.dirY[lane] = data.rays[r].dir.y;
+				packet.dirZ[lane] = data.rays[r].dir.z;
+			}
+			data.boxes4.resize(data.objects.size() / 4);
+			data.spheres4.resize(data.objects.size() / 4);
+			for (size_t o = 0; o < 4 * data.boxes4.size(); o++)
+			{
+				const SceneObject & object = data.objects[o];
+				Boxes4 & boxes = data.boxes4[o / 4];
+				Spheres4 & spheres = data.spheres4[o / 4];
+				int lane = (int)(o % 4);
+				boxes.minX[lane] = object.min.x;
+				boxes.minY[lane] = object.min.y;
+				boxes.minZ[lane] = object.min.z;
+				boxes.maxX[lane] = object.max.x;
+				boxes.maxY[lane] = object.max.y;
+				boxes.maxZ[lane] = object.max.z;
+				spheres.x[lane] = object.pos.x;
+				spheres.y[lane] = object.pos.y;
+				spheres.z[lane] = object.pos.z;
+				spheres.r[lane] = object.r;
+			}
+
+			std::vector<float> reference(data.rays.size()), closest(data.rays.size());
+			intersectScalar(data, reference.data());
+			int hits = 0;
+			for (size_t r = 0; r < reference.size(); r++)
+				hits += reference[r] > 0.0f;
+
+			for (int k = 0; k < 3; k++)
+			{
+				kernels[k](data, closest.data());
+				int differences = 0;
+				for (size_t r = 0; r < closest.size(); r++)
+					differences += fabsf(closest[r] - reference[r]) > 1e-4f * fabsf(reference[r]);
+				mismatches += differences;
+
+				double nsPerTest[INTERSECT_BENCH_RUNS];
+				for (int run = 0; run < INTERSECT_BENCH_RUNS; run++)
+				{
+					int sweeps = 0;
+					double elapsedMs = 0.0;
+					std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+					while (elapsedMs < INTERSECT_BENCH_RUN_MS)
+					{
+						kernels[k](data, closest.data());
+						sweeps++;
+						elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+					}
+					nsPerTest[run] = elapsedMs * 1e6 / ((double)sweeps * data.rays.size() * data.objects.size());
+				}
+				std::sort(nsPerTest, nsPerTest + INTERSECT_BENCH_RUNS);
+				double median = nsPerTest[INTERSECT_BENCH_RUNS / 2];
+				fprintf(stdout, "  %-6s %-8s %-7s %7.3f ns (best %.3f, spread %4.1f%%), %d hits%s\n", data.boxes ? "box" : "sphere",
+					coherent ? "coherent" : "random", kernelNames[k], median, nsPerTest[0],
+					100.0 * (nsPerTest[INTERSECT_BENCH_RUNS - 1] - nsPerTest[0]) / median, hits,
+					differences ? ", DIFFERS from scalar" : "");
+			}
+		}
+	if (mismatches > 0)
+		fprintf(stdout, "%d closest hits differ from the scalar kernel\n", mismatches);
+	return mismatches == 0 ? 1 : -1;
+}
@@ -0,0 +1,245 @@
+#include "Denoiser.h"
+#include "JobSystem.h"
+
+#include <math.h>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DENOISE_SSE
+#include <emmintrin.h>
+#endif
+
+//Rows filtered by each job of the parallel passes
+#define DENOISE_ROWS_PER_JOB 4
+
+//B3 spline, the 5x5 kernel is its outer product
+static const float kernel[5] = { 1.0f / 16.0f, 1.0f / 4.0f, 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f };
+
+bool AtrousDenoiser::simdAvailable()
+{
+#ifdef DENOISE_SSE
+	return true;
+#else
+	return false;
+#endif
+}
+
+void AtrousDenoiser::denoise(const float* color, const float* albedo, const float* normalDepth, int width, int height, float* output, bool simd)
+{
+	//Split the RGBA images into planes, only reallocated when the size changes
+	size_t pixels = (size_t)width * height;
+	_width = width;
+	_height = height;
+	for (int c = 0; c < 3; c++)
+	{
+		_albedo[c].resize(pixels);
+		_normal[c].resize(pixels);
+		_color[0][c].resize(pixels);
+		_color[1][c].resize(pixels);
+	}
+	_depth.resize(pixels);
+	jobs_ParallelFor(0, height, DENOISE_ROWS_PER_JOB, [&](int rowBegin, int rowEnd)
+	{
+		for (size_t p = (size_t)rowBegin * width; p < (size_t)rowEnd * width; p++)
+		{
+			for (int c = 0; c < 3; c++)
+			{
+				_color[0][c][p] = color[4 * p + c];
+				_albedo[c][p] = albedo[4 * p + c];
+				_normal[c][p] = normalDepth[4 * p + c];
+			}
+			_depth[p] = normalDepth[4 * p + 3];
+		}
+	});
+
+#ifndef DENOISE_SSE
+	simd = false;
+#endif
+	float sigmaColor = DENOISE_SIGMA_COLOR;
+	for (int pass = 0; pass < DENOISE_PASSES; pass++)
+	{
+		int step = 1 << pass;
+		const std::vector<float>* in = _color[pass % 2];
+		std::vector<float>* out = _color[(pass + 1) % 2];
+		//Pixels whose taps all fall inside the row go 4 at a time, the borders clamp their taps one by one
+		int simdBegin = simd ? 2 * step : width;
+		int simdEnd = simd ? width - 2 * step - 3 : 0;
+		jobs_ParallelFor(0, height, DENOISE_ROWS_PER_JOB, [&](int rowBegin, int rowEnd)
+		{
+			for (int y = rowBegin; y < rowEnd; y++)
+			{
+				int x = 0;
+				for (; x < simdBegin && x < width; x++)
+					filterPixel(x, y, step, sigmaColor, in, out);
+				for (; x < simdEnd; x += 4)
+					filterPixels4(x, y, step, sigmaColor, in, out);
+				for (; x < width; x++)
+					filterPixel(x, y, step, sigmaColor, in, out);
+			}
+		});
+		sigmaColor *= 0.5f;
+	}
+
+	const std::vector<float>* result = _color[DENOISE_PASSES % 2];
+	jobs_ParallelFor(0, height, DENOISE_ROWS_PER_JOB, [&](int rowBegin, int rowEnd)
+	{
+		for (size_t p = (size_t)rowBegin * width; p < (size_t)rowEnd * width; p++)
+		{
+			for (int c = 0; c < 3; c++)
+				output[4 * p + c] = result[c][p];
+			output[4 * p + 3] = color[4 * p + 3];
+		}
+	});
+}
+
+void AtrousDenoiser::filterPixel(int x, int y, int step, float sigmaColor, const std::vector<float>* in, std::vector<float>* out)
+{
+	size_t p = (size_t)y * _width + x;
+	float depth = _depth[p];
+	//Background, nothing to filter
+	if (depth < 0.0f)
+	{
+		for (int c = 0; c < 3; c++)
+			out[c][p] = in[c][p];
+		return;
+	}
+
+	float colorScale = 1.0f / (sigmaColor * sigmaColor);
+	float albedoScale = 1.0f / (DENOISE_SIGMA_ALBEDO * DENOISE_SIGMA_ALBEDO);
+	float depthScale = 1.0f / (DENOISE_SIGMA_DEPTH * step * depth);
+	float sum[3] = { 0.0f, 0.0f, 0.0f };
+	float weightSum = 0.0f;
+	for (int dy = -2; dy <= 2; dy++)
+	{
+		int qy = std::min(std::max(y + dy * step, 0), _height - 1);
+		for (int dx = -2; dx <= 2; dx++)
+		{
+			int qx = std::min(std::max(x + dx * step, 0), _width - 1);
+			size_t q = (size_t)qy * _width + qx;
+
+			float colorDist = 0.0f, albedoDist = 0.0f, normalDot = 0.0f;
+			for (int c = 0; c < 3; c++)
+			{
+				float dc = in[c][q] - in[c][p];
+				float da = _albedo[c][q] - _albedo[c][p];
+				colorDist += dc * dc;
+				albedoDist += da * da;
+				normalDot += _normal[c][q] * _normal[c][p];
+			}
+			//Normal weight: the dot product to the power 64
+			float normalWeight = std::max(normalDot, 0.0f);
+			for (int s = 0; s < 6; s++)
+				normalWeight *= normalWeight;
+
+			float exponent = colorDist * colorScale + albedoDist * albedoScale + fabsf(_depth[q] - depth) * depthScale;
+			float weight = kernel[dx + 2] * kernel[dy + 2] * normalWeight * expf(-exponent);
+			for (int c = 0; c < 3; c++)
+				sum[c] += weight * in[c][q];
+			weightSum += weight;
+		}
+	}
+	for (int c = 0; c < 3; c++)
+		out[c][p] = sum[c] / weightSum;
+}
+
+#ifdef DENOISE_SSE
+
+//exp(x) for x <= 0: 2^(x log2(e)) split into an integer power built in the exponent bits and a polynomial
+//of the fraction. Relative error under 1e-6
+static inline __m128 expNegative(__m128 x)
+{
+	__m128 t = _mm_mul_ps(_mm_max_ps(x, _mm_set1_ps(-80.0f)), _mm_set1_ps(1.44269504f));
+	__m128i i = _mm_cvttps_epi32(t);
+	__m128 fi = _mm_cvtepi32_ps(i);
+	//Truncation rounds the negative values up, step back to the floor
+	__m128 above = _mm_cmpgt_ps(fi, t);
+	fi = _mm_sub_ps(fi, _mm_and_ps(above, _mm_set1_ps(1.0f)));
+	i = _mm_add_epi32(i, _mm_castps_si128(above));
+	__m128 f = _mm_sub_ps(t, fi);
+
+	__m128 p = _mm_set1_ps(1.333355e-3f);
+	p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(9.618129e-3f));
+	p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(5.550357e-2f));
+	p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(2.402265e-1f));
+	p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(6.931472e-1f));
+	p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(1.0f));
+	__m128 power = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(i, _mm_set1_epi32(127)), 23));
+	return _mm_mul_ps(p, power);
+}
+
+//Same as filterPixel for the pixels x to x+3 of the row, all their taps must be inside the row
+void AtrousDenoiser::filterPixels4(int x, int y, int step, float sigmaColor, const std::vector<float>* in, std::vector<float>* out)
+{
+	size_t p = (size_t)y * _width + x;
+	__m128 depth = _mm_loadu_ps(&_depth[p]);
+	__m128 background = _mm_cmplt_ps(depth, _mm_setzero_ps());
+	__m128 color[3], albedo[3], normal[3];
+	for (int c = 0; c < 3; c++)
+	{
+		color[c] = _mm_loadu_ps(&in[c][p]);
+		albedo[c] = _mm_loadu_ps(&_albedo[c][p]);
+		normal[c] = _mm_loadu_ps(&_normal[c][p]);
+	}
+	if (_mm_movemask_ps(background) == 0xF)
+	{
+		for (int c = 0; c < 3; c++)
+			_mm_storeu_ps(&out[c][p], color[c]);
+		return;
+	}
+
+	__m128 colorScale = _mm_set1_ps(1.0f / (sigmaColor * sigmaColor));
+	__m128 albedoScale = _mm_set1_ps(1.0f / (DENOISE_SIGMA_ALBEDO * DENOISE_SIGMA_ALBEDO));
+	__m128 depthScale = _mm_div_ps(_mm_set1_ps(1.0f), _mm_mul_ps(_mm_set1_ps(DENOISE_SIGMA_DEPTH * step), depth));
+	__m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+	__m128 sum[3] = { _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps() };
+	__m128 weightSum = _mm_setzero_ps();
+	for (int dy = -2; dy <= 2; dy++)
+	{
+		int qy = std::min(std::max(y + dy * step, 0), _height - 1);
+		for (int dx = -2; dx <= 2; dx++)
+		{
+			size_t q = (size_t)qy * _width + x + dx * step;
+
+			__m128 colorDist = _mm_setzero_ps(), albedoDist = _mm_setzero_ps(), normalDot = _mm_setzero_ps();
+			__m128 tap[3];
+			for (int c = 0; c < 3; c++)
+			{
+				tap[c] = _mm_loadu_ps(&in[c][q]);
+				__m128 dc = _mm_sub_ps(tap[c], color[c]);
+				__m128 da = _mm_sub_ps(_mm_loadu_ps(&_albedo[c][q]), albedo[c]);
+				colorDist = _mm_add_ps(colorDist, _mm_mul_ps(dc, dc));
+				albedoDist = _mm_add_ps(albedoDist, _mm_mul_ps(da, da));
+				normalDot = _mm_add_ps(normalDot, _mm_mul_ps(_mm_loadu_ps(&_normal[c][q]), normal[c]));
+			}
+			__m128 normalWeight = _mm_max_ps(normalDot, _mm_setzero_ps());
+			for (int s = 0; s < 6; s++)
+				normalWeight = _mm_mul_ps(normalWeight, normalWeight);
+
+			__m128 depthDist = _mm_and_ps(_mm_sub_ps(_mm_loadu_ps(&_depth[q]), depth), absMask);
+			__m128 exponent = _mm_add_ps(_mm_add_ps(_mm_mul_ps(colorDist, colorScale), _mm_mul_ps(albedoDist, albedoScale)),
+				_mm_mul_ps(depthDist, depthScale));
+			__m128 weight = _mm_mul_ps(_mm_set1_ps(kernel[dx + 2] * kernel[dy + 2]),
+				_mm_mul_ps(normalWeight, expNegative(_mm_sub_ps(_mm_setzero_ps(), exponent))));
+			for (int c = 0; c < 3; c++)
+				sum[c] = _mm_add_ps(sum[c], _mm_mul_ps(weight, tap[c]));
+			weightSum = _mm_add_ps(weightSum, weight);
+		}
+	}
+
+	//The background pixels keep their color, their weights are all 0
+	for (int c = 0; c < 3; c++)
+	{
+		__m128 filtered = _mm_div_ps(sum[c], weightSum);
+		_mm_storeu_ps(&out[c][p], _mm_or_ps(_mm_and_ps(background, color[c]), _mm_andnot_ps(background, filtered)));
+	}
+}
+
+#else
+
+void AtrousDenoiser::filterPixels4(int x, int y, int step, float sigmaColor, const std::vector<float>* in, std::vector<float>* out)
+{
+	for (int i = 0; i < 4; i++)
+		filterPixel(x + i, y, step, sigmaColor, in, out);
+}
+
+#endif
@@ -0,0 +1,387 @@
+#include "Distributed.h"
+#include "Utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <algorithm>
+#include <deque>
+#include <chrono>
+
+//Tiles queued on each worker, so that it does not wait for the coordinator between two tiles
+#define TILES_IN_FLIGHT 2
+//Time the workers have to connect, a spawned worker creates its GL context and builds the programs first
+#define WORKERS_CONNECT_TIMEOUT_MS 30000
+
+//The results are read as their data arrives, a worker sending a tile slowly never stalls the others
+struct WorkerState
+{
+	NetSocket socket;
+	std::vector<int> inFlight;
+	int tilesRendered;
+	//Bytes received that do not make a complete result yet
+	std::vector<char> received;
+};
+
+//Tiles of the frame and their progress
+struct TileQueue
+{
+	std::vector<TileJob> tiles;
+	std::deque<int> pending;
+	std::vector<int> issued;
+	std::vector<bool> done;
+	int remaining;
+	int duplicates;
+};
+
+bool sendSetup(NetSocket socket, const RenderSetup & setup, const Scene & scene)
+{
+	std::vector<char> sceneData;
+	serializeScene(scene, sceneData);
+
+	std::vector<char> payload(sizeof(RenderSetup));
+	memcpy(payload.data(), &setup, sizeof(RenderSetup));
+	payload.insert(payload.end(), sceneData.begin(), sceneData.end());
+	return net_SendMessage(socket, MSG_SETUP, payload.data(), payload.size());
+}
+
+bool decodeSetup(const std::vector<char> & payload, RenderSetup & setup, Scene & scene)
+{
+	if (payload.size() < sizeof(RenderSetup))
+		return false;
+	memcpy(&setup, payload.data(), sizeof(RenderSetup));
+	return deserializeScene(payload.data() + sizeof(RenderSetup), payload.size() - sizeof(RenderSetup), scene);
+}
+
+//Next tile for a worker with room in its queue: a pending one, or else the oldest tile still
+//rendered by another worker, so that a slow worker does not hold the end of the frame
+static int nextTile(TileQueue & queue, const std::vector<WorkerState> & workers, const WorkerState & idle)
+{
+	if (!queue.pending.empty())
+	{
+		int id = queue.pending.front();
+		queue.pending.pop_front();
+		return id;
+	}
+	for (const WorkerState & worker : workers)
+	{
+		if (&worker == &idle || worker.socket == INVALID_NET_SOCKET)
+			continue;
+		for (int id : worker.inFlight)
+			if (!queue.done[id] && queue.issued[id] == 1)
+			{
+				queue.duplicates++;
+				return id;
+			}
+	}
+	return -1;
+}
+
+static bool fillWorker(TileQueue & queue, std::vector<WorkerState> & workers, WorkerState & worker)
+{
+	while (worker.inFlight.size() < TILES_IN_FLIGHT)
+	{
+		int id = nextTile(queue, workers, worker);
+		if (id < 0)
+			break;
+		queue.issued[id]++;
+		worker.inFlight.push_back(id);
+		if (!net_SendMessage(worker.socket, MSG_TILE, &queue.tiles[id], sizeof(TileJob)))
+			return false;
+	}
+	return true;
+}
+
+//Copies a tile rendered by the worker into the image, the first copy of a duplicated tile wins
+static bool storeResult(TileQueue & queue, WorkerState & worker, const std::vector<char> & payload,
+	const RenderSetup & setup, std::vector<unsigned char> & image)
+{
+	TileJob job;
+	if (payload.size() < sizeof(TileJob))
+		return false;
+	memcpy(&job, payload.data(), sizeof(TileJob));
+	if (job.id < 0 || job.id >= (int)queue.tiles.size())
+		return false;
+	const TileJob & tile = queue.tiles[job.id];
+	if (payload.size() != sizeof(TileJob) + (size_t)tile.width * tile.height * 3)
+		return false;
+
+	for (size_t i = 0; i < worker.inFlight.size(); i++)
+		if (worker.inFlight[i] == tile.id)
+		{
+			worker.inFlight.erase(worker.inFlight.begin() + i);
+			break;
+		}
+	if (queue.done[tile.id])
+		return true;
+
+	//Rows arrive bottom first, the image is stored top first
+	const unsigned char* texels = (const unsigned char*)payload.data() + sizeof(TileJob);
+	for (int row = 0; row < tile.height; row++)
+	{
+		size_t imageRow = (size_t)(setup.height - 1 - (tile.y + row));
+		memcpy(&image[(imageRow * setup.width + tile.x) * 3], texels + (size_t)row * tile.width * 3, (size_t)tile.width * 3);
+	}
+	queue.done[tile.id] = true;
+	queue.remaining--;
+	worker.tilesRendered++;
+	return true;
+}
+
+static void spawnWorker(const char* command)
+{
+#ifdef _WIN32
+	std::string line = std::string("start \"\" /b ") + command;
+#else
+	std::string line = std::string(command) + " &";
+#endif
+	if (system(line.c_str()) != 0)
+		fprintf(stderr, "Could not start a local worker: %s\n", command);
+}
+
+bool runCoordinator(const char* address, int workersNbr, const char* spawnCommand,
+	const RenderSetup & setup, const Scene & scene, const char* outputPath, double* seconds)
+{
+	if (!net_Init())
+		return false;
+	NetSocket listener = net_Listen(address);
+	if (listener == INVALID_NET_SOCKET)
+	{
+		net_Shutdown();
+		return false;
+	}
+
+	if (spawnCommand)
+		for (int w = 0; w < workersNbr; w++)
+			spawnWorker(spawnCommand);
+
+	fprintf(stdout, "Waiting for %d workers on %s\n", workersNbr, address);
+	std::vector<WorkerState> workers;
+	std::vector<NetSocket> listening(1, listener);
+	std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(WORKERS_CONNECT_TIMEOUT_MS);
+	while ((int)workers.size() < workersNbr && std::chrono::steady_clock::now() < deadline)
+	{
+		if (net_WaitReadable(listening, 1000) < 0)
+			continue;
+		NetSocket socket = net_Accept(listener);
+		if (socket == INVALID_NET_SOCKET)
+			continue;
+		if (!sendSetup(socket, setup, scene))
+		{
+			net_Close(socket);
+			continue;
+		}
+		workers.push_back({ socket, std::vector<int>(), 0, std::vector<char>() });
+	}
+	net_Close(listener);
+	if (workers.empty())
+	{
+		fprintf(stderr, "No worker connected within %d s\n", WORKERS_CONNECT_TIMEOUT_MS / 1000);
+		net_Shutdown();
+		return false;
+	}
+	if ((int)workers.size() < workersNbr)
+		fprintf(stderr, "Only %d of %d workers connected within %d s, rendering with them\n", (int)workers.size(), workersNbr,
+			WORKERS_CONNECT_TIMEOUT_MS / 1000);
+
+	//Tiles in scanline order, the edge tiles are cropped to the frame
+	TileQueue queue;
+	for (int y = 0; y < setup.height; y += setup.tileSize)
+		for (int x = 0; x < setup.width; x += setup.tileSize)
+		{
+			TileJob tile = { (int32_t)queue.tiles.size(), x, y, std::min(setup.tileSize, setup.width - x), std::min(setup.tileSize, setup.height - y) };
+			queue.pending.push_back(tile.id);
+			queue.tiles.push_back(tile);
+		}
+	queue.issued.assign(queue.tiles.size(), 0);
+	queue.done.assign(queue.tiles.size(), false);
+	queue.remaining = (int)queue.tiles.size();
+	queue.duplicates = 0;
+
+	std::vector<unsigned char> image((size_t)setup.width * setup.height * 3);
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	for (WorkerState & worker : workers)
+		fillWorker(queue, workers, worker);
+
+	std::vector<NetSocket> sockets;
+	std::vector<int> socketWorker;
+	std::vector<char> payload;
+	while (queue.remaining > 0)
+	{
+		sockets.clear();
+		socketWorker.clear();
+		for (size_t w = 0; w < workers.size(); w++)
+			if (workers[w].socket != INVALID_NET_SOCKET)
+			{
+				sockets.push_back(workers[w].socket);
+				socketWorker.push_back((int)w);
+			}
+		if (sockets.empty())
+		{
+			fprintf(stderr, "No worker left, %d tiles were not rendered\n", queue.remaining);
+			break;
+		}
+
+		int ready = net_WaitReadable(sockets, 1000);
+		if (ready < 0)
+			continue;
+		WorkerState & worker = workers[socketWorker[ready]];
+
+		//Only what the worker already sent is read, its complete results are stored
+		bool connected = net_RecvAvailable(worker.socket, worker.received);
+		uint32_t type;
+		bool invalid = false;
+		while (connected && net_PopMessage(worker.received, type, payload, invalid))
+			connected = type == MSG_RESULT && storeResult(queue, worker, payload, setup, image) &&
+				fillWorker(queue, workers, worker);
+		if (!connected || invalid)
+		{
+			//Hand its unfinished tiles to the other workers
+			fprintf(stderr, "Lost worker %d\n", socketWorker[ready]);
+			for (int id : worker.inFlight)
+				if (!queue.done[id] && --queue.issued[id] == 0)
+					queue.pending.push_front(id);
+			worker.inFlight.clear();
+			worker.received.clear();
+			net_Close(worker.socket);
+			worker.socket = INVALID_NET_SOCKET;
+			for (WorkerState & other : workers)
+				if (other.socket != INVALID_NET_SOCKET)
+					fillWorker(queue, workers, other);
+		}
+	}
+
+	double renderSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	if (seconds)
+		*seconds = renderSeconds;
+	for (WorkerState & worker : workers)
+		if (worker.socket != INVALID_NET_SOCKET)
+		{
+			net_SendMessage(worker.socket, MSG_DONE, NULL, 0);
+			net_Close(worker.socket);
+		}
+	net_Shutdown();
+
+	if (queue.remaining > 0)
+		return false;
+
+	fprintf(stdout, "Rendered %dx%d depth %d in %d tiles of %d pixels on %d workers: %.3f s, %.2f Mpixels/s\n",
+		setup.width, setup.height, setup.depth, (int)queue.tiles.size(), setup.tileSize, (int)workers.size(),
+		renderSeconds, (double)setup.width * setup.height / renderSeconds * 1e-6);
+	for (size_t w = 0; w < workers.size(); w++)
+		fprintf(stdout, "  worker %d: %d tiles\n", (int)w, workers[w].tilesRendered);
+	if (queue.duplicates > 0)
+		fprintf(stdout, "  %d tiles handed out again to idle workers\n", queue.duplicates);
+
+	return write_PPM(outputPath, setup.width, setup.height, image);
+}
+
+bool runSpeedupSweep(const char* address, int workersNbr, const char* spawnCommand,
+	const RenderSetup & setup, const Scene & scene, const char* outputPath)
+{
+	std::vector<int> counts;
+	for (int n = 1; n < workersNbr; n *= 2)
+		counts.push_back(n);
+	counts.push_back(workersNbr);
+
+	std::vector<double> seconds(counts.size());
+	for (size_t c = 0; c < counts.size(); c++)
+		if (!runCoordinator(address, counts[c], spawnCommand, setup, scene, outputPath, &seconds[c]))
+			return false;
+
+	fprintf(stdout, "Speedup of %dx%d depth %d in tiles of %d pixels against 1 worker:\n", setup.width, setup.height, setup.depth, setup.tileSize);
+	for (size_t c = 0; c < counts.size(); c++)
+		fprintf(stdout, "  %2d workers: %.3f s, x%.2f, %.0f%% efficiency\n", counts[c], seconds[c], seconds[0] / seconds[c],
+			100.0 * seconds[0] / seconds[c] / counts[c]);
+	return true;
+}
+
+static bool sendScene(NetSocket socket, const char* name, const Scene & scene)
+{
+	std::vector<char> sceneData;
+	serializeScene(scene, sceneData);
+
+	std::vector<char> payload(SCENE_NAME_SIZE, '\0');
+	memcpy(payload.data(), name, std::min(strlen(name), (size_t)SCENE_NAME_SIZE - 1));
+	payload.insert(payload.end(), sceneData.begin(), sceneData.end());
+	return net_SendMessage(socket, MSG_SCENE, payload.data(), payload.size());
+}
+
+bool runClient(const char* address, const RenderJob & job, const Scene & scene, int jobsNbr, const char* outputPath)
+{
+	if (!net_Init())
+		return false;
+	NetSocket socket = net_Connect(address);
+	if (socket == INVALID_NET_SOCKET)
+	{
+		net_Shutdown();
+		return false;
+	}
+
+	std::vector<char> payload;
+	std::vector<double> latencies;
+	double serverMs = 0.0;
+	bool sceneSent = false;
+	bool success = true;
+	while ((int)latencies.size() < jobsNbr && success)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		uint32_t type;
+		success = net_SendMessage(socket, MSG_RENDER, &job, sizeof(RenderJob)) && net_RecvMessage(socket, type, payload);
+		if (!success)
+		{
+			fprintf(stderr, "Lost the connection to the render server\n");
+			break;
+		}
+
+		//Unknown scene: upload it once and resend the job
+		if (type == MSG_ERROR)
+		{
+			fprintf(stderr, "Render server: %.*s\n", (int)payload.size(), payload.data());
+			success = !sceneSent && sendScene(socket, job.scene, scene);
+			sceneSent = true;
+			continue;
+		}
+
+		ImageHeader header;
+		success = type == MSG_IMAGE && payload.size() >= sizeof(ImageHeader);
+		if (success)
+		{
+			memcpy(&header, payload.data(), sizeof(ImageHeader));
+			success = payload.size() == sizeof(ImageHeader) + (size_t)header.width * header.height * 3;
+		}
+		if (!success)
+		{
+			fprintf(stderr, "Invalid reply from the render server\n");
+			break;
+		}
+		latencies.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+		serverMs += header.renderMs;
+		fprintf(stdout, "Job %d: %.2f ms round trip, %.2f ms on the server\n", (int)latencies.size(), latencies.back(), header.renderMs);
+	}
+	net_Close(socket);
+	net_Shutdown();
+	if (!success)
+		return false;
+
+	double total = 0.0, best = 1e30;
+	for (double latency : latencies)
+	{
+		total += latency;
+		best = std::min(best, latency);
+	}
+	fprintf(stdout, "%d jobs %dx%d depth %d on scene %s: %.2f ms average round trip (best %.2f ms), %.2f ms average on the server\n",
+		jobsNbr, job.width, job.height, job.depth, job.scene, total / jobsNbr, best, serverMs / jobsNbr);
+
+	//Rows arrive bottom first
+	ImageHeader header;
+	memcpy(&header, payload.data(), sizeof(ImageHeader));
+	size_t rowSize = (size_t)header.width * 3;
+	const unsigned char* texels = (const unsigned char*)payload.data() + sizeof(ImageHeader);
+	std::vector<unsigned char> image(rowSize * header.height);
+	for (int row = 0; row < header.height; row++)
+		memcpy(&image[(header.height - 1 - row) * rowSize], texels + row * rowSize, rowSize);
+	return write_PPM(outputPath, header.width, header.height, image);
+}
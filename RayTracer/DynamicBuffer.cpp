@@ -0,0 +1,115 @@
+#include "DynamicBuffer.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+
+void waitFence(GLsync fence, double & waitMs, int & waits)
+{
+	if (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0) == GL_TIMEOUT_EXPIRED)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED)
+			;
+		waitMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		waits++;
+	}
+	glDeleteSync(fence);
+}
+
+bool DynamicBuffer::init(GLsizeiptr regionSize)
+{
+	release();
+	GLint uniformAlignment = 256, storageAlignment = 256;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformAlignment);
+	glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &storageAlignment);
+	_alignment = std::max(std::max(uniformAlignment, storageAlignment), 16);
+	_regionSize = (regionSize + _alignment - 1) / _alignment * _alignment;
+	_fences.assign(DYNAMIC_BUFFER_REGIONS, nullptr);
+
+	GLsizeiptr size = _regionSize * DYNAMIC_BUFFER_REGIONS;
+	glGenBuffers(1, &_buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, _buffer);
+	if (GLAD_GL_VERSION_4_4 && glBufferStorage)
+	{
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_COPY_WRITE_BUFFER, size, NULL, flags);
+		_mapped = (char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, flags);
+		if (!_mapped)
+			fprintf(stderr, "DynamicBuffer: could not map the buffer persistently\n");
+	}
+	else
+		glBufferData(GL_COPY_WRITE_BUFFER, size, NULL, GL_STREAM_DRAW);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	return !GLAD_GL_VERSION_4_4 || !glBufferStorage || _mapped;
+}
+
+void DynamicBuffer::release()
+{
+	for (size_t f = 0; f < _fences.size(); f++)
+		if (_fences[f])
+			glDeleteSync(_fences[f]);
+	_fences.clear();
+	if (_mapped)
+	{
+		glBindBuffer(GL_COPY_WRITE_BUFFER, _buffer);
+		glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+	if (_buffer)
+		glDeleteBuffers(1, &_buffer);
+	_buffer = 0;
+	_mapped = nullptr;
+	_region = 0;
+	_used = 0;
+}
+
+GLintptr DynamicBuffer::write(const void* data, GLsizeiptr size)
+{
+	if (size > _regionSize)
+	{
+		fprintf(stderr, "DynamicBuffer: %lld bytes do not fit in a region of %lld bytes\n", (long long)size, (long long)_regionSize);
+		return -1;
+	}
+	if (_used + size > _regionSize)
+		nextRegion();
+	GLintptr offset = _region * _regionSize + _used;
+	_used += (size + _alignment - 1) / _alignment * _alignment;
+
+	if (_mapped)
+		memcpy(_mapped + offset, data, size);
+	else
+	{
+		glBindBuffer(GL_COPY_WRITE_BUFFER, _buffer);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, data);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+	return offset;
+}
+
+void DynamicBuffer::nextRegion()
+{
+	if (_used == 0)
+		return;
+	_fences[_region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	_region = (_region + 1) % DYNAMIC_BUFFER_REGIONS;
+	_used = 0;
+
+	//The GPU may still read the region written DYNAMIC_BUFFER_REGIONS frames ago
+	GLsync fence = _fences[_region];
+	if (!fence)
+		return;
+	waitFence(fence, _waitMs, _waits);
+	_fences[_region] = nullptr;
+}
+
+double DynamicBuffer::takeWaitMs(int* waits)
+{
+	double waitMs = _waitMs;
+	if (waits)
+		*waits = _waits;
+	_waitMs = 0.0;
+	_waits = 0;
+	return waitMs;
+}
@@ -0,0 +1,81 @@
+#include "GpuTimer.h"
+
+void GpuTimer::init(int latency)
+{
+	release();
+	_queries.resize(latency);
+	_results.resize(latency);
+	_tags.resize(latency);
+	glGenQueries(latency, _queries.data());
+}
+
+void GpuTimer::release()
+{
+	if (!_queries.empty())
+		glDeleteQueries((GLsizei)_queries.size(), _queries.data());
+	_queries.clear();
+	_oldest = 0;
+	_usedNbr = 0;
+	_readyNbr = 0;
+}
+
+void GpuTimer::begin()
+{
+	//The ring is full, the oldest query has to be read before it can be reused
+	if (_usedNbr == (int)_queries.size())
+	{
+		if (_readyNbr == 0)
+			collect(true);
+		_oldest = (_oldest + 1) % (int)_queries.size();
+		_usedNbr--;
+		_readyNbr--;
+	}
+
+	glBeginQuery(GL_TIME_ELAPSED, _queries[(_oldest + _usedNbr) % _queries.size()]);
+}
+
+void GpuTimer::end(int tag)
+{
+	glEndQuery(GL_TIME_ELAPSED);
+	_tags[(_oldest + _usedNbr) % _queries.size()] = tag;
+	_usedNbr++;
+}
+
+bool GpuTimer::fetch(double & elapsedMs, int* tag)
+{
+	collect(false);
+	if (_readyNbr == 0)
+		return false;
+
+	elapsedMs = _results[_oldest];
+	if (tag)
+		*tag = _tags[_oldest];
+	_oldest = (_oldest + 1) % (int)_queries.size();
+	_usedNbr--;
+	_readyNbr--;
+	return true;
+}
+
+void GpuTimer::finish()
+{
+	while (_readyNbr < _usedNbr)
+		collect(true);
+}
+
+void GpuTimer::collect(bool wait)
+{
+	while (_readyNbr < _usedNbr)
+	{
+		int slot = (_oldest + _readyNbr) % (int)_queries.size();
+		GLint available = 0;
+		glGetQueryObjectiv(_queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available && !wait)
+			return;
+
+		GLuint64 elapsedNs = 0;
+		glGetQueryObjectui64v(_queries[slot], GL_QUERY_RESULT, &elapsedNs);
+		_results[slot] = elapsedNs * 1e-6;
+		_readyNbr++;
+		wait = false;
+	}
+}
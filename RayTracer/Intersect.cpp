@@ -0,0 +1,128 @@
+#include "Intersect.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define INTERSECT_SSE
+#include <emmintrin.h>
+#endif
+
+bool intersectSimdAvailable()
+{
+#ifdef INTERSECT_SSE
+	return true;
+#else
+	return false;
+#endif
+}
+
+#ifdef INTERSECT_SSE
+
+//Lanes of the mask take -1, the other ones the distance
+static inline __m128 missed(__m128 mask, __m128 dist)
+{
+	return _mm_or_ps(_mm_and_ps(mask, _mm_set1_ps(-1.0f)), _mm_andnot_ps(mask, dist));
+}
+
+//Slabs test of the shader, on four lanes
+static inline __m128 slabs(__m128 originX, __m128 originY, __m128 originZ, __m128 dirX, __m128 dirY, __m128 dirZ,
+	__m128 minX, __m128 minY, __m128 minZ, __m128 maxX, __m128 maxY, __m128 maxZ)
+{
+	__m128 tMinX = _mm_div_ps(_mm_sub_ps(minX, originX), dirX);
+	__m128 tMinY = _mm_div_ps(_mm_sub_ps(minY, originY), dirY);
+	__m128 tMinZ = _mm_div_ps(_mm_sub_ps(minZ, originZ), dirZ);
+	__m128 tMaxX = _mm_div_ps(_mm_sub_ps(maxX, originX), dirX);
+	__m128 tMaxY = _mm_div_ps(_mm_sub_ps(maxY, originY), dirY);
+	__m128 tMaxZ = _mm_div_ps(_mm_sub_ps(maxZ, originZ), dirZ);
+
+	__m128 tN = _mm_max_ps(_mm_max_ps(_mm_min_ps(tMinX, tMaxX), _mm_min_ps(tMinY, tMaxY)), _mm_min_ps(tMinZ, tMaxZ));
+	__m128 tF = _mm_min_ps(_mm_min_ps(_mm_max_ps(tMinX, tMaxX), _mm_max_ps(tMinY, tMaxY)), _mm_max_ps(tMinZ, tMaxZ));
+	return missed(_mm_cmpgt_ps(tN, tF), tN);
+}
+
+void boxIntersect4(const Ray & ray, const Boxes4 & boxes, float distances[4])
+{
+	__m128 dist = slabs(_mm_set1_ps(ray.origin.x), _mm_set1_ps(ray.origin.y), _mm_set1_ps(ray.origin.z),
+		_mm_set1_ps(ray.dir.x), _mm_set1_ps(ray.dir.y), _mm_set1_ps(ray.dir.z),
+		_mm_loadu_ps(boxes.minX), _mm_loadu_ps(boxes.minY), _mm_loadu_ps(boxes.minZ),
+		_mm_loadu_ps(boxes.maxX), _mm_loadu_ps(boxes.maxY), _mm_loadu_ps(boxes.maxZ));
+	_mm_storeu_ps(distances, dist);
+}
+
+void boxIntersectPacket(const RayPacket4 & rays, const glm::vec3 & minCorner, const glm::vec3 & maxCorner, float distances[4])
+{
+	__m128 dist = slabs(_mm_loadu_ps(rays.originX), _mm_loadu_ps(rays.originY), _mm_loadu_ps(rays.originZ),
+		_mm_loadu_ps(rays.dirX), _mm_loadu_ps(rays.dirY), _mm_loadu_ps(rays.dirZ),
+		_mm_set1_ps(minCorner.x), _mm_set1_ps(minCorner.y), _mm_set1_ps(minCorner.z),
+		_mm_set1_ps(maxCorner.x), _mm_set1_ps(maxCorner.y), _mm_set1_ps(maxCorner.z));
+	_mm_storeu_ps(distances, dist);
+}
+
+//-b - sqrt(b * b - c) with oc = origin - center, b = dot(oc, dir) and c = dot(oc, oc) - r * r
+static inline void quadratic(__m128 ocX, __m128 ocY, __m128 ocZ, __m128 dirX, __m128 dirY, __m128 dirZ, __m128 radius, float distances[4])
+{
+	__m128 b = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ocX, dirX), _mm_mul_ps(ocY, dirY)), _mm_mul_ps(ocZ, dirZ));
+	__m128 c = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ocX, ocX), _mm_mul_ps(ocY, ocY)), _mm_mul_ps(ocZ, ocZ)), _mm_mul_ps(radius, radius));
+	__m128 h = _mm_sub_ps(_mm_mul_ps(b, b), c);
+	__m128 miss = _mm_cmplt_ps(h, _mm_setzero_ps());
+	if (_mm_movemask_ps(miss) == 0xF)
+	{
+		_mm_storeu_ps(distances, _mm_set1_ps(-1.0f));
+		return;
+	}
+	__m128 dist = _mm_sub_ps(_mm_sub_ps(_mm_setzero_ps(), b), _mm_sqrt_ps(_mm_max_ps(h, _mm_setzero_ps())));
+	_mm_storeu_ps(distances, missed(miss, dist));
+}
+
+void sphereIntersect4(const Ray & ray, const Spheres4 & spheres, float distances[4])
+{
+	quadratic(_mm_sub_ps(_mm_set1_ps(ray.origin.x), _mm_loadu_ps(spheres.x)), _mm_sub_ps(_mm_set1_ps(ray.origin.y), _mm_loadu_ps(spheres.y)),
+		_mm_sub_ps(_mm_set1_ps(ray.origin.z), _mm_loadu_ps(spheres.z)),
+		_mm_set1_ps(ray.dir.x), _mm_set1_ps(ray.dir.y), _mm_set1_ps(ray.dir.z), _mm_loadu_ps(spheres.r), distances);
+}
+
+void sphereIntersectPacket(const RayPacket4 & rays, const glm::vec3 & center, float radius, float distances[4])
+{
+	quadratic(_mm_sub_ps(_mm_loadu_ps(rays.originX), _mm_set1_ps(center.x)), _mm_sub_ps(_mm_loadu_ps(rays.originY), _mm_set1_ps(center.y)),
+		_mm_sub_ps(_mm_loadu_ps(rays.originZ), _mm_set1_ps(center.z)),
+		_mm_loadu_ps(rays.dirX), _mm_loadu_ps(rays.dirY), _mm_loadu_ps(rays.dirZ), _mm_set1_ps(radius), distances);
+}
+
+#else
+
+static inline Ray packetRay(const RayPacket4 & rays, int lane)
+{
+	Ray ray;
+	ray.origin = glm::vec3(rays.originX[lane], rays.originY[lane], rays.originZ[lane]);
+	ray.dir = glm::vec3(rays.dirX[lane], rays.dirY[lane], rays.dirZ[lane]);
+	return ray;
+}
+
+void boxIntersect4(const Ray & ray, const Boxes4 & boxes, float distances[4])
+{
+	glm::vec3 normal;
+	for (int lane = 0; lane < 4; lane++)
+		distances[lane] = boxIntersect(ray, glm::vec3(boxes.minX[lane], boxes.minY[lane], boxes.minZ[lane]),
+			glm::vec3(boxes.maxX[lane], boxes.maxY[lane], boxes.maxZ[lane]), normal);
+}
+
+void sphereIntersect4(const Ray & ray, const Spheres4 & spheres, float distances[4])
+{
+	glm::vec3 normal;
+	for (int lane = 0; lane < 4; lane++)
+		distances[lane] = sphereIntersect(ray, glm::vec3(spheres.x[lane], spheres.y[lane], spheres.z[lane]), spheres.r[lane], normal);
+}
+
+void boxIntersectPacket(const RayPacket4 & rays, const glm::vec3 & minCorner, const glm::vec3 & maxCorner, float distances[4])
+{
+	glm::vec3 normal;
+	for (int lane = 0; lane < 4; lane++)
+		distances[lane] = boxIntersect(packetRay(rays, lane), minCorner, maxCorner, normal);
+}
+
+void sphereIntersectPacket(const RayPacket4 & rays, const glm::vec3 & center, float radius, float distances[4])
+{
+	glm::vec3 normal;
+	for (int lane = 0; lane < 4; lane++)
+		distances[lane] = sphereIntersect(packetRay(rays, lane), center, radius, normal);
+}
+
+#endif
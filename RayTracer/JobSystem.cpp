@@ -0,0 +1,267 @@
+#include "JobSystem.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <malloc.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+//Jobs a thread can have queued, a power of 2. Spawning more runs them inline
+#define DEQUE_CAPACITY 4096
+//Idle rounds a worker yields before going to sleep until jobs are queued
+#define SPINS_BEFORE_SLEEP 256
+
+//Chase-Lev deque with a fixed capacity, following the C11 version of Le et al. "Correct and efficient work-stealing
+//for weak memory models". The owner pushes and pops at the bottom, the other threads steal at the top
+class WorkDeque
+{
+public:
+	//new only honors the alignment of the members from C++17 on, the project builds as C++14
+	static void* operator new(size_t size)
+	{
+		void* memory = NULL;
+#ifdef _WIN32
+		memory = _aligned_malloc(size, 64);
+#else
+		if (posix_memalign(&memory, 64, size) != 0)
+			memory = NULL;
+#endif
+		if (!memory)
+			throw std::bad_alloc();
+		return memory;
+	}
+
+	static void operator delete(void* memory)
+	{
+#ifdef _WIN32
+		_aligned_free(memory);
+#else
+		free(memory);
+#endif
+	}
+
+	bool push(Job* job)
+	{
+		int64_t bottom = _bottom.load(std::memory_order_relaxed);
+		int64_t top = _top.load(std::memory_order_acquire);
+		if (bottom - top >= DEQUE_CAPACITY)
+			return false;
+		_jobs[bottom & (DEQUE_CAPACITY - 1)].store(job, std::memory_order_relaxed);
+		//Publishes the job to the thieves reading the bottom
+		_bottom.store(bottom + 1, std::memory_order_release);
+		return true;
+	}
+
+	Job* pop()
+	{
+		int64_t bottom = _bottom.load(std::memory_order_relaxed) - 1;
+		_bottom.store(bottom, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t top = _top.load(std::memory_order_relaxed);
+		if (top > bottom)
+		{
+			_bottom.store(bottom + 1, std::memory_order_relaxed);
+			return nullptr;
+		}
+
+		Job* job = _jobs[bottom & (DEQUE_CAPACITY - 1)].load(std::memory_order_relaxed);
+		//Last job, race the thieves for it
+		if (top == bottom)
+		{
+			if (!_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+				job = nullptr;
+			_bottom.store(bottom + 1, std::memory_order_relaxed);
+		}
+		return job;
+	}
+
+	Job* steal()
+	{
+		int64_t top = _top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t bottom = _bottom.load(std::memory_order_acquire);
+		if (top >= bottom)
+			return nullptr;
+
+		Job* job = _jobs[top & (DEQUE_CAPACITY - 1)].load(std::memory_order_relaxed);
+		if (!_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			return nullptr;
+		return job;
+	}
+
+private:
+	//On separate cache lines, the thieves hammer the top while the owner works at the bottom
+	alignas(64) std::atomic<int64_t> _top{ 0 };
+	alignas(64) std::atomic<int64_t> _bottom{ 0 };
+	std::atomic<Job*> _jobs[DEQUE_CAPACITY];
+};
+
+static std::vector<std::unique_ptr<WorkDeque>> deques;
+static std::vector<std::thread> workers;
+static std::atomic<bool> quit{ false };
+//Jobs in the deques, the sleeping workers wait for it to be positive
+static std::atomic<int> queuedJobs{ 0 };
+static std::atomic<int> sleepers{ 0 };
+static std::mutex sleepMutex;
+static std::condition_variable wakeUp;
+//Index of the deque of the thread, -1 outside of the job system
+static thread_local int threadIndex = -1;
+static thread_local uint32_t victimSeed = 0;
+
+static void pinThread(int core)
+{
+	core %= std::max(1, (int)std::thread::hardware_concurrency());
+#ifdef _WIN32
+	SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << (core % (sizeof(DWORD_PTR) * 8)));
+#elif defined(__linux__)
+	cpu_set_t cores;
+	CPU_ZERO(&cores);
+	CPU_SET(core % CPU_SETSIZE, &cores);
+	pthread_setaffinity_np(pthread_self(), sizeof(cores), &cores);
+#endif
+}
+
+//Own jobs first, newest first, then the oldest job of the other threads starting from a random one
+static Job* findJob(int index)
+{
+	Job* job = deques[index]->pop();
+	int count = (int)deques.size();
+	if (!job && count > 1)
+	{
+		victimSeed ^= victimSeed << 13;
+		victimSeed ^= victimSeed >> 17;
+		victimSeed ^= victimSeed << 5;
+		int first = (int)(victimSeed % (uint32_t)count);
+		for (int v = 0; v < count && !job; v++)
+		{
+			int victim = (first + v) % count;
+			if (victim != index)
+				job = deques[victim]->steal();
+		}
+	}
+	if (job)
+		queuedJobs.fetch_sub(1);
+	return job;
+}
+
+//The job may be released by its owner as soon as the counter drops, it is not touched after
+static void execute(Job* job)
+{
+	JobCounter* counter = job->counter;
+	job->fn(job->data);
+	counter->pending.fetch_sub(1, std::memory_order_release);
+}
+
+static void workerLoop(int index, bool pin)
+{
+	threadIndex = index;
+	victimSeed = 2654435761u * (uint32_t)(index + 1);
+	if (pin)
+		pinThread(index);
+
+	int idle = 0;
+	while (!quit.load(std::memory_order_acquire))
+	{
+		Job* job = findJob(index);
+		if (job)
+		{
+			execute(job);
+			idle = 0;
+			continue;
+		}
+		if (++idle < SPINS_BEFORE_SLEEP)
+		{
+			std::this_thread::yield();
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		sleepers.fetch_add(1);
+		wakeUp.wait(lock, [] { return quit.load() || queuedJobs.load() > 0; });
+		sleepers.fetch_sub(1);
+		idle = 0;
+	}
+}
+
+bool jobs_Init(int threads, bool pin)
+{
+	jobs_Shutdown();
+	if (threads <= 0)
+		threads = std::max(1, (int)std::thread::hardware_concurrency());
+
+	for (int t = 0; t < threads; t++)
+		deques.emplace_back(new WorkDeque());
+	threadIndex = 0;
+	victimSeed = 2654435761u;
+	if (pin)
+		pinThread(0);
+	for (int t = 1; t < threads; t++)
+		workers.emplace_back(workerLoop, t, pin);
+	return true;
+}
+
+void jobs_Shutdown()
+{
+	if (deques.empty())
+		return;
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		quit.store(true);
+	}
+	wakeUp.notify_all();
+	for (size_t t = 0; t < workers.size(); t++)
+		workers[t].join();
+	workers.clear();
+	deques.clear();
+	queuedJobs.store(0);
+	quit.store(false);
+	threadIndex = -1;
+}
+
+int jobs_ThreadCount()
+{
+	return std::max(1, (int)deques.size());
+}
+
+void jobs_Spawn(Job & job, JobCounter & counter)
+{
+	job.counter = &counter;
+	counter.pending.fetch_add(1, std::memory_order_relaxed);
+	if (threadIndex < 0 || !deques[threadIndex]->push(&job))
+	{
+		execute(&job);
+		return;
+	}
+
+	queuedJobs.fetch_add(1);
+	if (sleepers.load() > 0)
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		wakeUp.notify_one();
+	}
+}
+
+void jobs_Wait(JobCounter & counter)
+{
+	while (counter.pending.load(std::memory_order_acquire) > 0)
+	{
+		Job* job = threadIndex >= 0 ? findJob(threadIndex) : nullptr;
+		if (job)
+			execute(job);
+		else
+			std::this_thread::yield();
+	}
+}
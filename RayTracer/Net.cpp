@@ -0,0 +1,354 @@
+#include "Net.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <chrono>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "Ws2_32.lib")
+#define closesocket_ closesocket
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <unistd.h>
+#define closesocket_ close
+#endif
+
+//Writing to a socket closed by the peer must fail instead of raising SIGPIPE
+#ifdef MSG_NOSIGNAL
+#define SEND_FLAGS MSG_NOSIGNAL
+#else
+#define SEND_FLAGS 0
+#endif
+
+bool net_Init()
+{
+#ifdef _WIN32
+	WSADATA wsaData;
+	if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+	{
+		fprintf(stderr, "Winsock initialisation failed\n");
+		return false;
+	}
+#endif
+	return true;
+}
+
+void net_Shutdown()
+{
+#ifdef _WIN32
+	WSACleanup();
+#endif
+}
+
+static bool isUnixAddress(const char* address)
+{
+	return strncmp(address, "unix:", 5) == 0;
+}
+
+//Splits "host:port", an empty or "*" host stands for any interface
+static bool splitAddress(const char* address, std::string & host, std::string & port)
+{
+	const char* colon = strrchr(address, ':');
+	if (!colon || colon[1] == '\0')
+	{
+		fprintf(stderr, "Invalid address %s, expected host:port or unix:path\n", address);
+		return false;
+	}
+	host.assign(address, colon - address);
+	port = colon + 1;
+	if (host == "*")
+		host.clear();
+	return true;
+}
+
+static void setNoDelay(NetSocket socket)
+{
+	int on = 1;
+	setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, (const char*)&on, sizeof(on));
+}
+
+#ifndef _WIN32
+static bool unixSocketAddress(const char* address, sockaddr_un & addr)
+{
+	const char* path = address + 5;
+	if (strlen(path) >= sizeof(addr.sun_path))
+	{
+		fprintf(stderr, "Unix socket path too long: %s\n", path);
+		return false;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	return true;
+}
+#endif
+
+NetSocket net_Listen(const char* address)
+{
+	if (isUnixAddress(address))
+	{
+#ifdef _WIN32
+		fprintf(stderr, "Unix domain sockets are not supported on this platform\n");
+		return INVALID_NET_SOCKET;
+#else
+		sockaddr_un addr;
+		if (!unixSocketAddress(address, addr))
+			return INVALID_NET_SOCKET;
+		NetSocket listener = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (listener == INVALID_NET_SOCKET)
+			return INVALID_NET_SOCKET;
+		unlink(addr.sun_path);
+		if (bind(listener, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(listener, SOMAXCONN) != 0)
+		{
+			fprintf(stderr, "Could not listen on %s\n", address);
+			closesocket_(listener);
+			return INVALID_NET_SOCKET;
+		}
+		return listener;
+#endif
+	}
+
+	std::string host, port;
+	if (!splitAddress(address, host, port))
+		return INVALID_NET_SOCKET;
+
+	addrinfo hints, *result = NULL;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE;
+	if (getaddrinfo(host.empty() ? NULL : host.c_str(), port.c_str(), &hints, &result) != 0)
+	{
+		fprintf(stderr, "Could not resolve %s\n", address);
+		return INVALID_NET_SOCKET;
+	}
+
+	NetSocket listener = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+	if (listener != INVALID_NET_SOCKET)
+	{
+		int on = 1;
+		setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, (const char*)&on, sizeof(on));
+		if (bind(listener, result->ai_addr, (int)result->ai_addrlen) != 0 || listen(listener, SOMAXCONN) != 0)
+		{
+			closesocket_(listener);
+			listener = INVALID_NET_SOCKET;
+		}
+	}
+	freeaddrinfo(result);
+
+	if (listener == INVALID_NET_SOCKET)
+		fprintf(stderr, "Could not listen on %s\n", address);
+	return listener;
+}
+
+NetSocket net_Accept(NetSocket listener)
+{
+	NetSocket client = accept(listener, NULL, NULL);
+	if (client != INVALID_NET_SOCKET)
+		setNoDelay(client);
+	return client;
+}
+
+//One connection attempt
+static NetSocket tryConnect(const char* address)
+{
+	if (isUnixAddress(address))
+	{
+#ifdef _WIN32
+		return INVALID_NET_SOCKET;
+#else
+		sockaddr_un addr;
+		if (!unixSocketAddress(address, addr))
+			return INVALID_NET_SOCKET;
+		NetSocket client = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (client != INVALID_NET_SOCKET && connect(client, (sockaddr*)&addr, sizeof(addr)) != 0)
+		{
+			closesocket_(client);
+			client = INVALID_NET_SOCKET;
+		}
+		return client;
+#endif
+	}
+
+	std::string host, port;
+	if (!splitAddress(address, host, port))
+		return INVALID_NET_SOCKET;
+
+	addrinfo hints, *result = NULL;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	if (getaddrinfo(host.empty() ? "localhost" : host.c_str(), port.c_str(), &hints, &result) != 0)
+		return INVALID_NET_SOCKET;
+
+	NetSocket client = INVALID_NET_SOCKET;
+	for (addrinfo* info = result; info && client == INVALID_NET_SOCKET; info = info->ai_next)
+	{
+		client = socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+		if (client != INVALID_NET_SOCKET && connect(client, info->ai_addr, (int)info->ai_addrlen) != 0)
+		{
+			closesocket_(client);
+			client = INVALID_NET_SOCKET;
+		}
+	}
+	freeaddrinfo(result);
+
+	if (client != INVALID_NET_SOCKET)
+		setNoDelay(client);
+	return client;
+}
+
+NetSocket net_Connect(const char* address, int timeoutMs)
+{
+	const int retryMs = 100;
+	for (int waited = 0; ; waited += retryMs)
+	{
+		NetSocket client = tryConnect(address);
+		if (client != INVALID_NET_SOCKET || waited >= timeoutMs)
+		{
+			if (client == INVALID_NET_SOCKET)
+				fprintf(stderr, "Could not connect to %s\n", address);
+			return client;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(retryMs));
+	}
+}
+
+void net_Close(NetSocket socket)
+{
+	if (socket != INVALID_NET_SOCKET)
+		closesocket_(socket);
+}
+
+bool net_SetTimeout(NetSocket socket, int timeoutMs)
+{
+#ifdef _WIN32
+	DWORD timeout = (DWORD)timeoutMs;
+#else
+	timeval timeout;
+	timeout.tv_sec = timeoutMs / 1000;
+	timeout.tv_usec = (timeoutMs % 1000) * 1000;
+#endif
+	return setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout)) == 0 &&
+		setsockopt(socket, SOL_SOCKET, SO_SNDTIMEO, (const char*)&timeout, sizeof(timeout)) == 0;
+}
+
+bool net_SendAll(NetSocket socket, const void* data, size_t size)
+{
+	const char* bytes = (const char*)data;
+	while (size > 0)
+	{
+		int chunk = size > (1 << 30) ? (1 << 30) : (int)size;
+		int sent = send(socket, bytes, chunk, SEND_FLAGS);
+		if (sent <= 0)
+			return false;
+		bytes += sent;
+		size -= sent;
+	}
+	return true;
+}
+
+bool net_RecvAll(NetSocket socket, void* data, size_t size)
+{
+	char* bytes = (char*)data;
+	while (size > 0)
+	{
+		int chunk = size > (1 << 30) ? (1 << 30) : (int)size;
+		int received = recv(socket, bytes, chunk, 0);
+		if (received <= 0)
+			return false;
+		bytes += received;
+		size -= received;
+	}
+	return true;
+}
+
+bool net_SendMessage(NetSocket socket, uint32_t type, const void* payload, size_t size)
+{
+	if (size > NET_MAX_PAYLOAD)
+	{
+		fprintf(stderr, "Net: message of %zu bytes over the %zu bytes limit not sent\n", size, NET_MAX_PAYLOAD);
+		return false;
+	}
+	uint32_t header[2] = { type, (uint32_t)size };
+	return net_SendAll(socket, header, sizeof(header)) && net_SendAll(socket, payload, size);
+}
+
+bool net_RecvMessage(NetSocket socket, uint32_t & type, std::vector<char> & payload)
+{
+	uint32_t header[2];
+	if (!net_RecvAll(socket, header, sizeof(header)))
+		return false;
+	type = header[0];
+	if (header[1] > NET_MAX_PAYLOAD)
+	{
+		fprintf(stderr, "Net: message of %u bytes over the %zu bytes limit received\n", header[1], NET_MAX_PAYLOAD);
+		return false;
+	}
+	payload.resize(header[1]);
+	return net_RecvAll(socket, payload.data(), payload.size());
+}
+
+bool net_RecvAvailable(NetSocket socket, std::vector<char> & buffer)
+{
+	const size_t chunk = 65536;
+	size_t size = buffer.size();
+	buffer.resize(size + chunk);
+	int received = recv(socket, buffer.data() + size, (int)chunk, 0);
+	buffer.resize(size + (received > 0 ? received : 0));
+	return received > 0;
+}
+
+bool net_PopMessage(std::vector<char> & buffer, uint32_t & type, std::vector<char> & payload, bool & invalid)
+{
+	uint32_t header[2];
+	invalid = false;
+	if (buffer.size() < sizeof(header))
+		return false;
+	memcpy(header, buffer.data(), sizeof(header));
+	if (header[1] > NET_MAX_PAYLOAD)
+	{
+		fprintf(stderr, "Net: message of %u bytes over the %zu bytes limit received\n", header[1], NET_MAX_PAYLOAD);
+		invalid = true;
+		return false;
+	}
+	if (buffer.size() < sizeof(header) + header[1])
+		return false;
+	type = header[0];
+	payload.assign(buffer.begin() + sizeof(header), buffer.begin() + sizeof(header) + header[1]);
+	buffer.erase(buffer.begin(), buffer.begin() + sizeof(header) + header[1]);
+	return true;
+}
+
+int net_WaitReadable(const std::vector<NetSocket> & sockets, int timeoutMs)
+{
+	fd_set readable;
+	FD_ZERO(&readable);
+	NetSocket maxSocket = 0;
+	for (NetSocket socket : sockets)
+	{
+		FD_SET(socket, &readable);
+		maxSocket = socket > maxSocket ? socket : maxSocket;
+	}
+
+	timeval timeout;
+	timeout.tv_sec = timeoutMs / 1000;
+	timeout.tv_usec = (timeoutMs % 1000) * 1000;
+	if (select((int)maxSocket + 1, &readable, NULL, NULL, &timeout) <= 0)
+		return -1;
+
+	for (size_t i = 0; i < sockets.size(); i++)
+		if (FD_ISSET(sockets[i], &readable))
+			return (int)i;
+	return -1;
+}
@@ -0,0 +1,96 @@
+#include "PerfCounters.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+//Type and config of each event
+static const unsigned long long perfEvents[PERF_EVENTS_NBR][2] = {
+	{ PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_ACCESS << 16) },
+	{ PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES },
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+};
+
+bool PerfCounters::open()
+{
+	close();
+	bool opened = false;
+	for (int e = 0; e < PERF_EVENTS_NBR; e++)
+	{
+		perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = (unsigned int)perfEvents[e][0];
+		attr.config = perfEvents[e][1];
+		attr.disabled = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+		_fds[e] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+		opened = opened || _fds[e] >= 0;
+	}
+	return opened;
+}
+
+void PerfCounters::close()
+{
+	for (int e = 0; e < PERF_EVENTS_NBR; e++)
+	{
+		if (_fds[e] >= 0)
+			::close(_fds[e]);
+		_fds[e] = -1;
+	}
+}
+
+void PerfCounters::start()
+{
+	for (int e = 0; e < PERF_EVENTS_NBR; e++)
+		if (_fds[e] >= 0)
+		{
+			ioctl(_fds[e], PERF_EVENT_IOC_RESET, 0);
+			ioctl(_fds[e], PERF_EVENT_IOC_ENABLE, 0);
+		}
+}
+
+void PerfCounters::stop(long long counts[PERF_EVENTS_NBR])
+{
+	for (int e = 0; e < PERF_EVENTS_NBR; e++)
+	{
+		counts[e] = -1;
+		if (_fds[e] < 0)
+			continue;
+		ioctl(_fds[e], PERF_EVENT_IOC_DISABLE, 0);
+		//Value, time enabled, time running
+		unsigned long long values[3];
+		if (read(_fds[e], values, sizeof(values)) != (ssize_t)sizeof(values) || values[2] == 0)
+			continue;
+		counts[e] = (long long)(values[0] * ((double)values[1] / values[2]));
+	}
+}
+
+#else
+
+bool PerfCounters::open()
+{
+	return false;
+}
+
+void PerfCounters::close()
+{
+}
+
+void PerfCounters::start()
+{
+}
+
+void PerfCounters::stop(long long counts[PERF_EVENTS_NBR])
+{
+	for (int e = 0; e < PERF_EVENTS_NBR; e++)
+		counts[e] = -1;
+}
+
+#endif
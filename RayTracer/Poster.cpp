@@ -0,0 +1,136 @@
+#include "Poster.h"
+#include "RayTracer.h"
+#include "TiledTiff.h"
+#include "JobSystem.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <vector>
+
+//*** Poster *****************************************************************************************
+
+//Readbacks in flight: the GPU traces the next tiles while the CPU writes the oldest one
+#define POSTER_BUFFERS 3
+
+struct PosterReadback
+{
+	GLuint pbo;
+	GLsync fence;
+	int tileX, tileY;
+	int width, height;
+};
+
+//Waits for the oldest readback and appends its tile to the file
+static bool writePosterTile(PosterReadback & readback, int tileSize, std::vector<unsigned char> & rgb, TiledTiffWriter & tiff)
+{
+	while (glClientWaitSync(readback.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED)
+		;
+	glDeleteSync(readback.fence);
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbo);
+	const unsigned char* rgba = (const unsigned char*)glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+	if (!rgba)
+	{
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		return false;
+	}
+	//The texture rows are bottom first, the tile rows top first
+	std::fill(rgb.begin(), rgb.end(), 0);
+	jobs_ParallelFor(0, readback.height, 16, [&](int rowBegin, int rowEnd)
+	{
+		for (int row = rowBegin; row < rowEnd; row++)
+		{
+			const unsigned char* src = rgba + (size_t)(readback.height - 1 - row) * tileSize * 4;
+			unsigned char* dst = &rgb[(size_t)row * tileSize * 3];
+			for (int x = 0; x < readback.width; x++)
+			{
+				dst[3 * x] = src[4 * x];
+				dst[3 * x + 1] = src[4 * x + 1];
+				dst[3 * x + 2] = src[4 * x + 2];
+			}
+		}
+	});
+	glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	return tiff.writeTile(readback.tileX, readback.tileY, rgb.data());
+}
+
+//Render a width x height image one tile at a time and stream the tiles to a tiled TIFF file.
+//The GPU and CPU memory only depend on the tile size
+bool renderPoster(const char* path, int width, int height, int depth, int tileSize)
+{
+	TiledTiffWriter tiff;
+	if (!tiff.open(path, width, height, tileSize))
+		return false;
+
+	PosterReadback readbacks[POSTER_BUFFERS];
+	for (int b = 0; b < POSTER_BUFFERS; b++)
+	{
+		glGenBuffers(1, &readbacks[b].pbo);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, readbacks[b].pbo);
+		glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)tileSize * tileSize * 4, NULL, GL_STREAM_READ);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+	std::vector<unsigned char> rgb((size_t)tileSize * tileSize * 3);
+	std::deque<int> inFlight;
+	bool success = true;
+	int tilesNbr = tiff.tilesX() * tiff.tilesY(), tilesDone = 0;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	for (int tileY = 0; tileY < tiff.tilesY() && success; tileY++)
+		for (int tileX = 0; tileX < tiff.tilesX() && success; tileX++)
+		{
+			if (inFlight.size() == POSTER_BUFFERS)
+			{
+				success = writePosterTile(readbacks[inFlight.front()], tileSize, rgb, tiff);
+				inFlight.pop_front();
+			}
+
+			//Tiles are counted from the top, the frame from the bottom
+			int regionWidth = std::min(tileSize, width - tileX * tileSize);
+			int regionHeight = std::min(tileSize, height - tileY * tileSize);
+			int regionY = height - tileY * tileSize - regionHeight;
+			traceRegion(width, height, tileX * tileSize, regionY, regionWidth, regionHeight, depth);
+
+			int b = (tileY * tiff.tilesX() + tileX) % POSTER_BUFFERS;
+			readbacks[b].tileX = tileX;
+			readbacks[b].tileY = tileY;
+			readbacks[b].width = regionWidth;
+			readbacks[b].height = regionHeight;
+			glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, readbacks[b].pbo);
+			glBindTexture(GL_TEXTURE_2D, texture);
+			glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+			glBindTexture(GL_TEXTURE_2D, 0);
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+			readbacks[b].fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			inFlight.push_back(b);
+
+			tilesDone++;
+			if (tilesDone % std::max(tilesNbr / 10, 1) == 0)
+				fprintf(stdout, "Poster: %d/%d tiles\n", tilesDone, tilesNbr);
+		}
+	while (!inFlight.empty())
+	{
+		if (success)
+			success = writePosterTile(readbacks[inFlight.front()], tileSize, rgb, tiff);
+		else
+			glDeleteSync(readbacks[inFlight.front()].fence);
+		inFlight.pop_front();
+	}
+	for (int b = 0; b < POSTER_BUFFERS; b++)
+		glDeleteBuffers(1, &readbacks[b].pbo);
+
+	success = tiff.close() && success;
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	double residentMB = ((double)tileSize * tileSize * (16 + 4 * POSTER_BUFFERS + 3) +
+		(double)((tileSize + CULL_TILE_SIZE - 1) / CULL_TILE_SIZE) * ((tileSize + CULL_TILE_SIZE - 1) / CULL_TILE_SIZE) * (TILE_OBJECTS_MAX_NBR + 1) * 4) / (1024.0 * 1024.0);
+	fprintf(stdout, "Poster %dx%d depth %d in %d tiles of %d pixels: %.2f s, %.2f Mpixels/s, %.1f MB of tile buffers\n",
+		width, height, depth, tilesNbr, tileSize, seconds, (double)width * height / seconds * 1e-6, residentMB);
+	return success;
+}
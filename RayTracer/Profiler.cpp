@@ -0,0 +1,304 @@
+#include "Profiler.h"
+
+#include <glad/glad.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+//Zones a thread can record between two frame ends, a power of 2. The zones of a full ring are dropped
+#define PROFILE_RING_SIZE 4096
+//GPU zones in flight, the zones begun when all are in flight are dropped
+#define PROFILE_GPU_ZONES 256
+//Zones reserved per captured frame, the capture only allocates past it
+#define PROFILE_ZONES_PER_FRAME 64
+//Thread of the GPU zones
+#define PROFILE_GPU_THREAD -1
+
+struct ProfileEvent
+{
+	const char* name;
+	int64_t beginNs, endNs;
+	int thread;
+};
+
+//Single producer, single consumer: the owner thread records at the head, profile_FrameEnd collects at the tail
+struct ProfileRing
+{
+	ProfileEvent events[PROFILE_RING_SIZE];
+	alignas(64) std::atomic<uint32_t> head{ 0 };
+	alignas(64) std::atomic<uint32_t> tail{ 0 };
+	int thread;
+
+	//Keeps the head and the tail on their own cache lines, a C++14 new would only align the ring to 16 bytes
+	static void* operator new(size_t size)
+	{
+		void* memory = NULL;
+#ifdef _WIN32
+		memory = _aligned_malloc(size, 64);
+#else
+		if (posix_memalign(&memory, 64, size) != 0)
+			memory = NULL;
+#endif
+		if (!memory)
+			throw std::bad_alloc();
+		return memory;
+	}
+
+	static void operator delete(void* memory)
+	{
+#ifdef _WIN32
+		_aligned_free(memory);
+#else
+		free(memory);
+#endif
+	}
+};
+
+struct GpuZone
+{
+	const char* name;
+	bool ended;
+};
+
+std::atomic<bool> profileCapturing{ false };
+
+//The rings are registered on the first zone of their thread and live until the end of the program
+static std::mutex ringsMutex;
+static std::vector<std::unique_ptr<ProfileRing>> rings;
+static thread_local ProfileRing* threadRing = nullptr;
+static std::atomic<int> droppedZones{ 0 };
+
+//Ring of timestamp query pairs, begin and end, from gpuOldest on
+static GLuint gpuQueries[2 * PROFILE_GPU_ZONES];
+static GpuZone gpuZones[PROFILE_GPU_ZONES];
+static int gpuOldest = 0, gpuUsed = 0;
+//GPU clock minus the host clock
+static int64_t gpuOffsetNs = 0;
+
+static std::vector<ProfileEvent> captured;
+static int captureFrames = 0, capturedFrames = 0;
+static int mainThread = 0;
+static int64_t frameBeginNs = 0;
+
+int64_t profile_Now()
+{
+	static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+static ProfileRing* registerThread()
+{
+	std::lock_guard<std::mutex> lock(ringsMutex);
+	rings.emplace_back(new ProfileRing());
+	threadRing = rings.back().get();
+	threadRing->thread = (int)rings.size() - 1;
+	return threadRing;
+}
+
+void profile_Record(const char* name, int64_t beginNs, int64_t endNs)
+{
+	ProfileRing* ring = threadRing ? threadRing : registerThread();
+	uint32_t head = ring->head.load(std::memory_order_relaxed);
+	if (head - ring->tail.load(std::memory_order_acquire) >= PROFILE_RING_SIZE)
+	{
+		droppedZones.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	ring->events[head & (PROFILE_RING_SIZE - 1)] = { name, beginNs, endNs, ring->thread };
+	//Publishes the zone to the collecting thread
+	ring->head.store(head + 1, std::memory_order_release);
+}
+
+int profile_GpuBegin(const char* name)
+{
+	if (gpuUsed == PROFILE_GPU_ZONES)
+	{
+		droppedZones.fetch_add(1, std::memory_order_relaxed);
+		return -1;
+	}
+	int zone = (gpuOldest + gpuUsed) % PROFILE_GPU_ZONES;
+	gpuZones[zone] = { name, false };
+	gpuUsed++;
+	glQueryCounter(gpuQueries[2 * zone], GL_TIMESTAMP);
+	return zone;
+}
+
+void profile_GpuEnd(int zone)
+{
+	glQueryCounter(gpuQueries[2 * zone + 1], GL_TIMESTAMP);
+	gpuZones[zone].ended = true;
+}
+
+//Moves the zones of the rings to the capture, or drops them
+static void collectRings(bool keep)
+{
+	std::lock_guard<std::mutex> lock(ringsMutex);
+	for (size_t r = 0; r < rings.size(); r++)
+	{
+		ProfileRing & ring = *rings[r];
+		uint32_t tail = ring.tail.load(std::memory_order_relaxed);
+		uint32_t head = ring.head.load(std::memory_order_acquire);
+		for (; keep && tail != head; tail++)
+			captured.push_back(ring.events[tail & (PROFILE_RING_SIZE - 1)]);
+		ring.tail.store(head, std::memory_order_release);
+	}
+}
+
+//Moves the finished GPU zones to the capture in the order they began, or drops them.
+//A zone still open, around the frame end, holds back the ones after it
+static void collectGpu(bool wait, bool keep)
+{
+	while (gpuUsed > 0 && gpuZones[gpuOldest].ended)
+	{
+		GLuint beginQuery = gpuQueries[2 * gpuOldest], endQuery = gpuQueries[2 * gpuOldest + 1];
+		GLint available = 0;
+		if (!wait)
+		{
+			glGetQueryObjectiv(endQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available)
+				return;
+		}
+
+		GLuint64 beginNs = 0, endNs = 0;
+		glGetQueryObjectui64v(beginQuery, GL_QUERY_RESULT, &beginNs);
+		glGetQueryObjectui64v(endQuery, GL_QUERY_RESULT, &endNs);
+		if (keep)
+			captured.push_back({ gpuZones[gpuOldest].name, (int64_t)beginNs - gpuOffsetNs, (int64_t)endNs - gpuOffsetNs, PROFILE_GPU_THREAD });
+		gpuOldest = (gpuOldest + 1) % PROFILE_GPU_ZONES;
+		gpuUsed--;
+	}
+}
+
+void profile_Start(int frames)
+{
+	if (!gpuQueries[0])
+		glGenQueries(2 * PROFILE_GPU_ZONES, gpuQueries);
+	//Zones left over from an earlier capture
+	profileCapturing.store(false);
+	collectGpu(true, false);
+	collectRings(false);
+
+	captured.clear();
+	captured.reserve((size_t)frames * PROFILE_ZONES_PER_FRAME);
+	captureFrames = std::max(frames, 1);
+	capturedFrames = 0;
+	droppedZones.store(0);
+	mainThread = (threadRing ? threadRing : registerThread())->thread;
+
+	//The GPU timestamps are moved to the host clock
+	GLint64 gpuNow = 0;
+	glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+	frameBeginNs = profile_Now();
+	gpuOffsetNs = gpuNow - frameBeginNs;
+	profileCapturing.store(true);
+}
+
+bool profile_Capturing()
+{
+	return profileCapturing.load(std::memory_order_relaxed);
+}
+
+bool profile_FrameEnd()
+{
+	if (!profileCapturing.load(std::memory_order_relaxed))
+		return false;
+
+	int64_t now = profile_Now();
+	captured.push_back({ "Frame", frameBeginNs, now, mainThread });
+	frameBeginNs = now;
+	collectGpu(false, true);
+	collectRings(true);
+	if (++capturedFrames < captureFrames)
+		return false;
+
+	profileCapturing.store(false);
+	collectGpu(true, true);
+	collectRings(true);
+	return true;
+}
+
+bool profile_Write(const char* path)
+{
+	FILE* file = fopen(path, "w");
+	if (!file)
+	{
+		fprintf(stderr, "Profiler: could not open %s\n", path);
+		return false;
+	}
+
+	int64_t originNs = captured.empty() ? 0 : captured[0].beginNs;
+	for (size_t e = 0; e < captured.size(); e++)
+		originNs = std::min(originNs, captured[e].beginNs);
+
+	//The host threads in one process, the GPU in another
+	fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"Host\"}},\n");
+	fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":2,\"tid\":0,\"args\":{\"name\":\"GPU\"}},\n");
+	fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":2,\"tid\":0,\"args\":{\"name\":\"Queue\"}}");
+	{
+		std::lock_guard<std::mutex> lock(ringsMutex);
+		for (size_t r = 0; r < rings.size(); r++)
+		{
+			if ((int)r == mainThread)
+				fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"Main thread\"}}", (int)r);
+			else
+				fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"Thread %d\"}}", (int)r, (int)r);
+		}
+	}
+	for (size_t e = 0; e < captured.size(); e++)
+	{
+		const ProfileEvent & event = captured[e];
+		bool gpu = event.thread == PROFILE_GPU_THREAD;
+		fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d}",
+			event.name, gpu ? "gpu" : "host", (event.beginNs - originNs) * 1e-3, (event.endNs - event.beginNs) * 1e-3,
+			gpu ? 2 : 1, gpu ? 0 : event.thread);
+	}
+	fprintf(file, "\n]}\n");
+	bool success = ferror(file) == 0;
+	success = fclose(file) == 0 && success;
+	if (!success)
+	{
+		fprintf(stderr, "Profiler: could not write %s\n", path);
+		return false;
+	}
+
+	//Time of each zone per frame, the GPU zones apart from the host ones with the same name
+	struct ZoneTotal
+	{
+		const char* name;
+		bool gpu;
+		int calls;
+		int64_t totalNs;
+	};
+	std::vector<ZoneTotal> totals;
+	for (size_t e = 0; e < captured.size(); e++)
+	{
+		const ProfileEvent & event = captured[e];
+		bool gpu = event.thread == PROFILE_GPU_THREAD;
+		size_t z = 0;
+		while (z < totals.size() && (totals[z].gpu != gpu || strcmp(totals[z].name, event.name) != 0))
+			z++;
+		if (z == totals.size())
+			totals.push_back({ event.name, gpu, 0, 0 });
+		totals[z].calls++;
+		totals[z].totalNs += event.endNs - event.beginNs;
+	}
+	std::sort(totals.begin(), totals.end(), [](const ZoneTotal & a, const ZoneTotal & b) { return a.gpu != b.gpu ? !a.gpu : a.totalNs > b.totalNs; });
+
+	fprintf(stdout, "Profile of %d frames written to %s, %d zones dropped\n", capturedFrames, path, droppedZones.load());
+	for (size_t z = 0; z < totals.size(); z++)
+		fprintf(stdout, "  %s %-24s %9.3f ms per frame, %d calls\n", totals[z].gpu ? "GPU " : "Host", totals[z].name,
+			totals[z].totalNs * 1e-6 / std::max(capturedFrames, 1), totals[z].calls);
+	return true;
+}
@@ -2,14 +2,74 @@
 // Raytracer 
 // ---------------
 //  o A simple ratracer using compute shader
-//  o Usage: RayTracer - depth d - width w - height h
+//  o Usage: RayTracer - depth d - width w - height h [-primary trace|raster] [-reflscale s]
+//  o		 [-temporal p] [-orbit a] [-targetms t] [-bench n] [-targets k] [-views v] [-roi x y rw rh] [-progressive]
+//  o		 [-pathtrace e] [-denoise s] [-raystats] [-heatmap]
 //  o		 Depth d is the actual recursion depth of the ray
 //  o		 Width w and height h are the dimensions in pixel of the rendering window
+//  o		 Primary visibility is either ray traced or rasterized into a G-buffer
+//  o		 Reflection scale s traces the reflection bounces at 1/s of the resolution (1, 2 or 4)
+//  o		 and prints the image error against full resolution reflections
+//  o		 Temporal p reuses the shading of the previous frames where the primary hit is unchanged,
+//  o		 and re-traces 1 pixel out of p each frame, or each pixel whose view direction turned by over 4/p degrees
+//  o		 Orbit a rotates the camera around the focus by a degrees each frame, arrow keys orbit too
+//  o		 Target t scales the traced resolution to hold a GPU frame time of t milliseconds
+//  o		 Bench renders n frames without vsync and prints the GPU time per frame and the throughput, and the GPU
+//  o		 time of each pass of the render graph with its barrier and the peak memory of its textures
+//  o		 Targets k traces the frames round robin into k textures (1 to 3, default 2) so that a frame is traced
+//  o		 while the previous one is drawn
+//  o		 Roi only traces and displays the rw x rh rectangle at x, y from the bottom left corner
+//  o		 Progressive traces 1 pixel out of 8x8 first then refines to 1/4, 1/2 and full resolution over
+//  o		 the next frames while the camera does not move, and prints the time of each pass
+//  o		 Pathtrace e accumulates path traced samples while the camera does not move, each tile of
+//  o		 16x16 pixels stops sampling once its relative noise is under e (e.g. 0.02)
+//  o		 Denoise s filters the path traced frames with an edge-aware a-trous wavelet filter guided by the
+//  o		 albedo, normal and depth of the primary hits. Without -pathtrace it benchmarks the GPU and CPU
+//  o		 denoisers on a frame of s samples per pixel against a reference of 1024 samples
+//  o		 Raystats counts the rays and the object tests of each kind and bounce, and prints them every 32 frames
+//  o		 with the Mrays/s, at the end with -bench. Heatmap draws the tests of each pixel from blue to red
+//  o		 Views v traces a turntable of v views of w x h pixels in one batched dispatch and compares it
+//  o		 with one render per view
+//  o Scenes: any mode takes [-generate kind n l] [-seed s] to replace the built-in room with a generated scene of
+//  o		 n objects and l lights, kind is spheres, clusters, city or cornell. -scaling f renders f frames per point
+//  o		 and prints the GPU time over the object count, the light count and the depth, as CSV
+//  o Profile: the window and bench modes take [-profile n file.json] to write the host zones and the GPU
+//  o		 passes of the first n frames as Chrome trace JSON, P captures the next n frames (60 by default)
+//  o Threads: any mode takes [-threads n] [-pin] to run the host side stages on n threads (default one per
+//  o		 hardware thread), pinned to the cores with -pin. RayTracer -threadbench [-pin] prints the scaling
+//  o		 of the job system from 1 to 64 threads
+//  o Baking: any mode takes [-bake] to compile the scene into the tile culling and raytracing shaders as constants,
+//  o		 and prints their compile time and trace time against the shaders that read the scene buffer
+//  o Tuning: any mode takes [-tune] to time the raytracing shader with workgroups of 8x8 to 64x1 pixels on the scene
+//  o		 and keep the fastest, saved per device to workgroups.txt where the later launches read it
+//  o Traversal: any mode takes [-morton] to trace the pixels of each workgroup, and of each 16x16 tile of the CPU trace,
+//  o		 along a Z-curve instead of the rows. -orderbench n times n frames in each order on the GPU, the CPU trace
+//  o		 in each order, and prints the L1 and last level cache miss rates of the CPU trace on Linux
+//  o CPU: -cpucompare renders the frame with the shaders and with the same trace code compiled as C++, and compares them
+//  o Kernels: RayTracer -intersectbench times the C++ ports of the box and sphere intersections, scalar, SIMD and
+//  o		 packets of four rays, on random and coherent rays, and checks them against each other
+//  o Distributed: RayTracer -coordinator address -workers n [-spawn] [-speedup] [-tile s] [-output file] -depth d -width w -height h
+//  o		 and on each node: RayTracer -worker address
+//  o		 The coordinator hands out tiles of s x s pixels to n workers and writes the image to a PPM file,
+//  o		 -spawn starts the n workers locally. Address is host:port, or unix:path for a Unix domain socket
+//  o		 -speedup renders with 1, 2, 4... up to n local workers in turn and prints the speedup of each count
+//  o Poster: RayTracer -poster file.tif [-tile s] -depth d -width w -height h
+//  o		 Renders the image tile by tile into a tiled TIFF file, w and h can exceed the texture size limit
+//  o Render server: RayTracer -serve address [-scenes c]
+//  o		 Keeps the context, the shaders and up to c scenes resident and renders the jobs of the clients:
+//  o		 RayTracer -client address [-scene name] [-jobs n] [-output file] -depth d -width w -height h
+//  o		 sends the job n times and prints the latencies, the scene is uploaded under its name if the server lacks it
 //
 //****************************************************************************************************
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <string>
+#include <vector>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -22,6 +82,19 @@
 #include "RaytraceShader.h"
 #include "DrawingShaders.h"
 #include "Utils.h"
+#include "GpuTimer.h"
+#include "Scene.h"
+#include "Distributed.h"
+#include "Denoiser.h"
+#include "JobSystem.h"
+#include "Arena.h"
+#include "Profiler.h"
+#include "DynamicBuffer.h"
+#include "RenderGraph.h"
+#include "RayTracer.h"
+#include "Benchmarks.h"
+#include "Poster.h"
+#include "RenderServer.h"
 
 
 
@@ -61,47 +134,508 @@ int nb_lights = 3;
 double light_pos[3][3] = { { 50.0, -500.0, 800.0 }, { -350.0, 250.0, 600.0 },{ 50.0, 500.0, 800.0 } };
 double light_color[3][4] = { { 0.5, 0.5, 0.5, 1.0 }, { 0.5, 0.5, 0.5, 1.0 } , { 0.5, 0.5, 0.5, 1.0 } };
 
+//Scene given to the shaders, built from the description above or received by a worker
+Scene scene;
+
+//Procedural scene replacing the description above, see generateScene
+const char* generatedKind = NULL;
+int generatedObjectsNbr = 0, generatedLightsNbr = 0;
+uint32_t sceneSeed = 1;
+//Frames rendered at each point of the -scaling sweeps
+int scalingFrames = 0;
+
 //OpenGL variables
 GLFWwindow  *glContext;
+bool hiddenWindow = false;
 unsigned int quadVAO, quadVBO;
+//Trace target of the current frame, one of traceTargets
 GLuint texture;
+GLuint tileBuffer;
+GLuint sceneBuffer;
+//Pixels covered by a workgroup of the raytracing shader, its shape unless the traversal is in Morton order
 GLint 	groupSizeX, groupSizeY;
-Shader _rayTracingShader, _simpleDraw;
+GLint 	reflectionGroupSizeX, reflectionGroupSizeY;
+GLint 	cullGroupSizeX, cullGroupSizeY;
+Shader _rayTracingShader, _tileCullingShader, _simpleDraw, _gBufferShader;
 glm::mat4 model, view , projection;
 
+//Hybrid mode: primary hits rasterized into a G-buffer, only the secondary rays are traced
+bool rasterPrimary = false;
+GLuint gBufferFBO, gPosition, gNormal, gDepth;
+GLuint emptyVAO;
 
-//*** Setting  The Scene     *************************************************************************
+//Reflection bounces traced at 1/reflectionScale of the resolution then upsampled
+int reflectionScale = 1;
+GLuint reflectionTexture;
+Shader _reflectionShader, _reflectionUpsampleShader;
+
+//Temporal reprojection cache, ping-ponged color and primary hit history of the previous frame. The cached colors
+//include the reflections: they are only reused while the direction from the eye to the hit turns by less than
+//TEMPORAL_VIEW_DEGREES over the temporalRefresh frames a color can be reused
+#define TEMPORAL_VIEW_DEGREES 4.0
+int temporalRefresh = 0;
+int frameIndex = 0;
+GLuint historyColor[2], historyPosition[2];
+GLuint temporalStatsBuffer;
+//Pixels traced with the cache since the last readTracedFraction, at the traced resolution
+double temporalPixels = 0.0;
+glm::mat4 prevProjectionView;
+glm::vec3 prevEye;
+
+//Camera orbit in degrees per frame
+double orbitStep = 0.0;
+
+//Dynamic resolution: the traced resolution is scaled to hold the GPU frame time at targetFrameMs
+double targetFrameMs = 0.0;
+double resolutionScale = 1.0;
+GpuTimer frameTimer;
+
+//Profiling: the first profileFrames frames, and the next ones whenever P is pressed, are written to profilePath
+//as Chrome trace JSON
+#define PROFILE_KEY_FRAMES 60
+int profileFrames = 0;
+const char* profilePath = "profile.json";
+
+//Frames of the render loop before debug builds check that a frame makes no heap allocation,
+//the first ones fill the caches and size the frame arena
+#define ALLOCATION_WARMUP_FRAMES 8
+
+//Region of interest in window pixels (x, y, width, height), the whole window when empty
+glm::ivec4 regionOfInterest(0);
+
+//Progressive preview: stride of the next pass, halved each frame down to 1 then 0 once the frame is complete
+#define PROGRESSIVE_STRIDE 8
+bool progressive = false;
+int progressiveStride = 0;
+
+//Path tracing: the samples accumulate while the camera is still, a tile stops sampling once its noise
+//is under noiseThreshold. Convergence is checked every PATH_CHECK_FRAMES frames
+#define PATH_MIN_SAMPLES 16
+#define PATH_MAX_SAMPLES 4096
+#define PATH_CHECK_FRAMES 16
+bool pathTrace = false;
+double noiseThreshold = 0.02;
+Shader _pathTraceShader;
+GLuint accumTexture, convergenceBuffer;
+int pathTilesNbr;
+int pathFrames = 0;
+double pathGpuMs = 0.0;
+bool pathConverged = false;
+int pathSeed = 0;
+
+//A-trous denoiser of the path traced frames, guided by the albedo, normal and depth of the primary hits
+bool denoisePaths = false;
+int denoiseSamples = 0;
+Shader _atrousShader;
+GLuint albedoTexture, normalDepthTexture;
+
+//Ray statistics: a variant of the raytracing shader counts the rays cast and the objects tested by kind and bounce.
+//-raystats prints them every RAY_STATS_FRAMES frames, -heatmap draws the tests of each pixel in false colours
+#define RAY_STATS_DEPTHS 8
+#define RAY_STATS_FRAMES 32
+bool rayStats = false, heatmap = false;
+Shader _rayStatsShader;
+GLuint rayStatsBuffer;
+//Sums since the last report, the primary, reflection then shadow rays of each bounce
+double statsRays[3 * RAY_STATS_DEPTHS], statsTests[3 * RAY_STATS_DEPTHS];
+double statsGpuMs = 0.0;
+int statsFrames = 0;
+//Tests of the most expensive pixel of the last frame, red in the heatmap
+GLuint heatmapMaxTests = 0;
+
+//Multi-view batches: the views are traced in one dispatch, into one layer of viewsTexture each
+Shader _multiViewShader, _multiViewCullShader;
+GLuint viewsTexture, viewsBuffer, viewsTileBuffer;
+int viewsWidth, viewsHeight, viewsLayers;
+
+//Trace targets used round robin by render(): a frame is traced into one while the previous ones may still be
+//blitted from the others. A fence placed after the blit of a target is waited on before it is traced into again,
+//so at most traceTargetsNbr frames are in flight. The progressive passes refine a single target
+#define TRACE_TARGETS_MAX 3
+int traceTargetsNbr = 2;
+GLuint traceTargets[TRACE_TARGETS_MAX];
+GLsync traceTargetFences[TRACE_TARGETS_MAX];
+int traceTargetIndex = 0;
+double traceTargetWaitMs = 0.0;
+int traceTargetWaits = 0;
+
+//Passes of render() and of the traces out of a frame, declared again each time: the graph places the barriers
+//between them and allocates the transient textures of the denoiser. The host readbacks place their own barrier
+RenderGraph renderGraph;
 
-void setSceneObjects() {
+//Per frame data of the raytracing pass, in a ring of persistently mapped regions: the camera of a frame is copied
+//to a region the GPU is done with instead of going through glUniform. FRAME_DATA_REGION_SIZE bytes per frame
+#define FRAME_DATA_REGION_SIZE 16384
+DynamicBuffer frameDataRing;
 
-	_rayTracingShader.setInt("objectsNbr", nb_boxes + nb_spheres);
-	_rayTracingShader.setInt("lightsNbr", nb_lights);
+//Baked scene: variants of the tile culling and raytracing shaders with the scene compiled in as constants, see
+//bakeSceneGLSL. They are only valid until the scene changes. BAKE_COMPARE_FRAMES frames are timed with each variant
+#define BAKE_COMPARE_FRAMES 16
+bool bakeScene = false;
+Shader _bakedRayTracingShader, _bakedTileCullingShader;
+
+//Workgroup size of the raytracing shader: -tune times each of traceGroupSizes on the scene and keeps the fastest,
+//saved to traceGroupsPath under the vendor, renderer and version strings of the device for the later launches.
+//Every program built from rayTraceCS takes traceGroupGLSL, empty for the default 8x8
+#define TUNE_FRAMES 16
+bool tuneGroups = false;
+const char* traceGroupsPath = "workgroups.txt";
+std::string traceGroupGLSL;
+int traceGroupX = 8, traceGroupY = 8;
+
+//Traversal order of the pixels: the invocations of a raytracing workgroup, and the iterations of a CPU trace in its
+//tiles of TRACE_CPU_TILE pixels, follow a Z-curve instead of the rows. -orderbench compares both orders
+bool mortonOrder = false;
+int orderBenchFrames = 0;
+
+
+//*** Setting  The Scene     *************************************************************************
+
+void buildDefaultScene()
+{
+	scene.objects.clear();
+	scene.lights.clear();
 
 	for (int i = 0; i < nb_spheres; i++)
 	{
-		_rayTracingShader.setFloat("vObjects[" + std::to_string(i) + "].type", 0.0);
-		_rayTracingShader.setVec3("vObjects[" + std::to_string(i) + "].pos", glm::vec3(sphere_center[i][0], sphere_center[i][1], sphere_center[i][2]));
-		_rayTracingShader.setFloat("vObjects[" + std::to_string(i) + "].r", sphere_radius[i]);
-		_rayTracingShader.setVec4("vObjects[" + std::to_string(i) + "].color", glm::vec4(sphere_color[i][0], sphere_color[i][1], sphere_color[i][2], sphere_color[i][3]));
-
+		SceneObject sphere = {};
+		sphere.type = OBJECT_SPHERE;
+		sphere.pos = glm::vec3(sphere_center[i][0], sphere_center[i][1], sphere_center[i][2]);
+		sphere.r = (float)sphere_radius[i];
+		sphere.color = glm::vec4(sphere_color[i][0], sphere_color[i][1], sphere_color[i][2], sphere_color[i][3]);
+		scene.objects.push_back(sphere);
 	}
 	for (int i = 0; i < nb_boxes; i++)
 	{
-		_rayTracingShader.setFloat("vObjects[" + std::to_string(nb_spheres + i) + "].type", 1.0);
-		_rayTracingShader.setVec3("vObjects[" + std::to_string(nb_spheres + i) + "].min", glm::vec3(box_min[i][0], box_min[i][1], box_min[i][2]));
-		_rayTracingShader.setVec3("vObjects[" + std::to_string(nb_spheres + i) + "].max", glm::vec3(box_max[i][0], box_max[i][1], box_max[i][2]));
-		_rayTracingShader.setVec4("vObjects[" + std::to_string(nb_spheres + i) + "].color", glm::vec4(box_color[i][0], box_color[i][1], box_color[i][2], box_color[i][3]));
+		SceneObject box = {};
+		box.type = OBJECT_BOX;
+		box.min = glm::vec3(box_min[i][0], box_min[i][1], box_min[i][2]);
+		box.max = glm::vec3(box_max[i][0], box_max[i][1], box_max[i][2]);
+		box.color = glm::vec4(box_color[i][0], box_color[i][1], box_color[i][2], box_color[i][3]);
+		scene.objects.push_back(box);
 	}
 	for (int i = 0; i < nb_lights; i++)
 	{
-		_rayTracingShader.setVec3("vLights[" + std::to_string(i) + "].pos", glm::vec3(light_pos[i][0], light_pos[i][1], light_pos[i][2]));
-		_rayTracingShader.setVec4("vLights[" + std::to_string(i) + "].color", glm::vec4(light_color[i][0], light_color[i][1], light_color[i][2], light_color[i][3]));
+		SceneLight light;
+		light.pos = glm::vec3(light_pos[i][0], light_pos[i][1], light_pos[i][2]);
+		light.color = glm::vec4(light_color[i][0], light_color[i][1], light_color[i][2], light_color[i][3]);
+		scene.lights.push_back(light);
+	}
+
+	scene.emission = glm::vec4(obj_emmissive[0], obj_emmissive[1], obj_emmissive[2], obj_emmissive[3]);
+	scene.reflection = glm::vec4(obj_reflection[0], obj_reflection[1], obj_reflection[2], obj_reflection[3]);
+}
+
+//std140 layout of the FrameData block of the raytracing shaders
+struct GPUFrameData
+{
+	glm::mat4 invProjectionView;
+	glm::mat4 prevProjectionView;
+	glm::vec4 eye;
+	glm::vec4 prevEye;
+	GLint frameIndex;
+	GLfloat pixelAngle;
+	GLint pixelStride;
+	GLint refinePass;
+	GLfloat historyViewCos;
+};
+
+//std430 layout of the SceneData block of the shaders, vec3 members are aligned on 16 bytes
+struct GPUObject
+{
+	float type;
+	float pad0[3];
+	glm::vec3 pos;
+	float r;
+	glm::vec3 min;
+	float pad1;
+	glm::vec3 max;
+	float pad2;
+	glm::vec4 color;
+};
+
+struct GPULight
+{
+	glm::vec3 pos;
+	float pad;
+	glm::vec4 color;
+};
+
+struct GPUSceneHeader
+{
+	glm::vec4 emission;
+	glm::vec4 reflection;
+	GLint objectsNbr;
+	GLint lightsNbr;
+	GLint pad[2];
+	GPULight lights[LIGHTS_MAX_NBR];
+};
+
+//Write the scene into the storage buffer read by the shaders
+void uploadScene(const Scene & sceneData, GLuint buffer)
+{
+	GPUSceneHeader header = {};
+	header.emission = sceneData.emission;
+	header.reflection = sceneData.reflection;
+	header.objectsNbr = (GLint)sceneData.objects.size();
+	header.lightsNbr = std::min((GLint)sceneData.lights.size(), (GLint)LIGHTS_MAX_NBR);
+	for (int i = 0; i < header.lightsNbr; i++)
+	{
+		header.lights[i].pos = sceneData.lights[i].pos;
+		header.lights[i].color = sceneData.lights[i].color;
+	}
+
+	std::vector<GPUObject> objects(sceneData.objects.size());
+	for (size_t i = 0; i < objects.size(); i++)
+	{
+		const SceneObject & object = sceneData.objects[i];
+		objects[i] = GPUObject();
+		objects[i].type = object.type;
+		objects[i].pos = object.pos;
+		objects[i].r = object.r;
+		objects[i].min = object.min;
+		objects[i].max = object.max;
+		objects[i].color = object.color;
+	}
+
+	GLsizeiptr objectsSize = objects.size() * sizeof(GPUObject);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GPUSceneHeader) + objectsSize, NULL, GL_STATIC_DRAW);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GPUSceneHeader), &header);
+	if (objectsSize > 0)
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, sizeof(GPUSceneHeader), objectsSize, objects.data());
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+//GLSL float literal that reads back as the same float
+static std::string glslFloat(float value)
+{
+	char text[32];
+	snprintf(text, sizeof(text), "%.9g", value);
+	if (!strpbrk(text, ".e"))
+		strcat(text, ".0");
+	return text;
+}
+
+static std::string glslVec(const float* value, int size)
+{
+	std::string text = "vec" + std::to_string(size) + "(";
+	for (int c = 0; c < size; c++)
+		text += (c ? ", " : "") + glslFloat(value[c]);
+	return text + ")";
+}
+
+static bool glslFinite(const float* value, int size)
+{
+	for (int c = 0; c < size; c++)
+		if (!std::isfinite(value[c]))
+			return false;
+	return true;
+}
+
+//Chunk inserted after sceneGLSL that turns the scene into constants: the objects, the lights and the materials
+//become const arrays that the names of the scene buffer are redefined to, and the object and light counts become
+//loop bounds the compiler knows. The arrays hold one element at least, GLSL has no empty arrays. Empty if a value
+//is infinite or NaN, GLSL has no literal for them
+std::string bakeSceneGLSL(const Scene & sceneData)
+{
+	int objectsNbr = (int)sceneData.objects.size();
+	int lightsNbr = std::min((int)sceneData.lights.size(), LIGHTS_MAX_NBR);
+	for (int i = 0; i < objectsNbr; i++)
+	{
+		const SceneObject & object = sceneData.objects[i];
+		if (!glslFinite(&object.type, 1) || !glslFinite(&object.pos[0], 3) || !glslFinite(&object.r, 1) || !glslFinite(&object.min[0], 3) ||
+			!glslFinite(&object.max[0], 3) || !glslFinite(&object.color[0], 4))
+			return std::string();
+	}
+	for (int i = 0; i < lightsNbr; i++)
+		if (!glslFinite(&sceneData.lights[i].pos[0], 3) || !glslFinite(&sceneData.lights[i].color[0], 4))
+			return std::string();
+	if (!glslFinite(&sceneData.emission[0], 4) || !glslFinite(&sceneData.reflection[0], 4))
+		return std::string();
+
+	std::string glsl = "const int bakedObjectsNbr = " + std::to_string(objectsNbr) + ";\n";
+	glsl += "const Object bakedObjects[" + std::to_string(std::max(objectsNbr, 1)) + "] = Object[](";
+	for (int i = 0; i < std::max(objectsNbr, 1); i++)
+	{
+		SceneObject object = i < objectsNbr ? sceneData.objects[i] : SceneObject();
+		glsl += std::string(i ? ",\n\t" : "\n\t") + "Object(" + glslFloat(object.type) + ", " + glslVec(&object.pos[0], 3) + ", " +
+			glslFloat(object.r) + ", " + glslVec(&object.min[0], 3) + ", " + glslVec(&object.max[0], 3) + ", " + glslVec(&object.color[0], 4) + ")";
+	}
+	glsl += ");\n";
+
+	glsl += "const int bakedLightsNbr = " + std::to_string(lightsNbr) + ";\n";
+	glsl += "const Light bakedLights[" + std::to_string(std::max(lightsNbr, 1)) + "] = Light[](";
+	for (int i = 0; i < std::max(lightsNbr, 1); i++)
+	{
+		SceneLight light = i < lightsNbr ? sceneData.lights[i] : SceneLight();
+		glsl += std::string(i ? ",\n\t" : "\n\t") + "Light(" + glslVec(&light.pos[0], 3) + ", " + glslVec(&light.color[0], 4) + ")";
+	}
+	glsl += ");\n";
+
+	glsl += "const vec4 bakedEmission = " + glslVec(&sceneData.emission[0], 4) + ";\n";
+	glsl += "const vec4 bakedReflection = " + glslVec(&sceneData.reflection[0], 4) + ";\n";
+	glsl += "#define objectsNbr bakedObjectsNbr\n#define vObjects bakedObjects\n";
+	glsl += "#define lightsNbr bakedLightsNbr\n#define vLights bakedLights\n";
+	glsl += "#define emission bakedEmission\n#define reflection bakedReflection\n";
+	return glsl;
+}
+
+//Tile covered by a workgroup of x * y invocations in Morton order, square or twice as wide. False unless the count
+//is a power of two
+bool mortonTile(int x, int y, int & tileX, int & tileY)
+{
+	int invocations = x * y, bits = 0;
+	if (invocations <= 0 || (invocations & (invocations - 1)) != 0)
+		return false;
+	while ((1 << bits) < invocations)
+		bits++;
+	tileX = 1 << ((bits + 1) / 2);
+	tileY = invocations / tileX;
+	return true;
+}
+
+//Chunk inserted after shaderVersion in the programs built from rayTraceCS
+static std::string traceGroupDefines(int x, int y)
+{
+	std::string defines = "#define TRACE_GROUP_X " + std::to_string(x) + "\n#define TRACE_GROUP_Y " + std::to_string(y) + "\n";
+	int tileX, tileY;
+	if (mortonOrder && mortonTile(x, y, tileX, tileY))
+		defines += "#define MORTON_ORDER\n#define TRACE_TILE_X " + std::to_string(tileX) + "\n#define TRACE_TILE_Y " + std::to_string(tileY) + "\n";
+	return defines;
+}
+
+//Builds the raytracing shader with workgroups of x * y invocations in the current traversal order, for the
+//programs built from rayTraceCS afterwards too
+bool buildTraceShader(int x, int y)
+{
+	traceGroupX = x;
+	traceGroupY = y;
+	traceGroupGLSL = traceGroupDefines(x, y);
+	glDeleteProgram(_rayTracingShader.getID());
+	if (!_rayTracingShader.initComputeShader({ shaderVersion, traceGroupGLSL.c_str(), sceneGLSL, frameDataGLSL, tileListsGLSL, intersectionGLSL, shadingGLSL, traceShadingGLSL, gBufferGLSL, rayTraceCS }))
+		return false;
+	groupSizeX = x;
+	groupSizeY = y;
+	if (mortonOrder && !mortonTile(x, y, groupSizeX, groupSizeY))
+		fprintf(stderr, "RayTracer: %dx%d workgroups are not a power of two, traced in row-major order\n", x, y);
+	return true;
+}
+
+//Device and driver the workgroup sizes are tuned for
+static std::string deviceString()
+{
+	const char* vendor = (const char*)glGetString(GL_VENDOR);
+	const char* renderer = (const char*)glGetString(GL_RENDERER);
+	const char* version = (const char*)glGetString(GL_VERSION);
+	return std::string(vendor ? vendor : "") + " | " + (renderer ? renderer : "") + " | " + (version ? version : "");
+}
+
+//traceGroupsPath holds one line per device: the workgroup width and height, then the device string
+static bool loadTraceGroup(int & x, int & y)
+{
+	FILE* file = fopen(traceGroupsPath, "r");
+	if (!file)
+		return false;
+	std::string device = deviceString();
+	char line[1024];
+	bool found = false;
+	while (!found && fgets(line, sizeof(line), file))
+	{
+		int offset = 0;
+		line[strcspn(line, "\r\n")] = 0;
+		found = sscanf(line, "%d %d %n", &x, &y, &offset) == 2 && offset > 0 && device == line + offset && x > 0 && y > 0;
+	}
+	fclose(file);
+	return found;
+}
+
+//Replaces the line of the device, keeps the ones of the other devices
+static bool saveTraceGroup(int x, int y)
+{
+	std::string device = deviceString();
+	std::vector<std::string> lines;
+	FILE* file = fopen(traceGroupsPath, "r");
+	if (file)
+	{
+		char line[1024];
+		while (fgets(line, sizeof(line), file))
+		{
+			int lineX, lineY, offset = 0;
+			line[strcspn(line, "\r\n")] = 0;
+			if (line[0] && !(sscanf(line, "%d %d %n", &lineX, &lineY, &offset) == 2 && offset > 0 && device == line + offset))
+				lines.push_back(line);
+		}
+		fclose(file);
+	}
+	file = fopen(traceGroupsPath, "w");
+	if (!file)
+	{
+		fprintf(stderr, "RayTracer: could not write %s\n", traceGroupsPath);
+		return false;
 	}
+	for (size_t l = 0; l < lines.size(); l++)
+		fprintf(file, "%s\n", lines[l].c_str());
+	fprintf(file, "%d %d %s\n", x, y, device.c_str());
+	fclose(file);
+	return true;
+}
 
-	_rayTracingShader.setVec4("emission", glm::vec4(obj_emmissive[0], obj_emmissive[1], obj_emmissive[2], obj_emmissive[3]));
-	_rayTracingShader.setVec4("reflection", glm::vec4(obj_reflection[0], obj_reflection[1], obj_reflection[2], obj_reflection[3]));
+//The hit position and normal textures also keep the traced primary hits of the reduced resolution reflections,
+//the depth and the framebuffer are only made for the rasterized primary visibility
+bool init_GBuffer(const int width, const int height)
+{
+	//Hit position with the object index in w, and normal at the hit
+	glGenTextures(1, &gPosition);
+	glBindTexture(GL_TEXTURE_2D, gPosition);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
+
+	glGenTextures(1, &gNormal);
+	glBindTexture(GL_TEXTURE_2D, gNormal);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	if (!rasterPrimary)
+		return true;
+
+	glGenTextures(1, &gDepth);
+	glBindTexture(GL_TEXTURE_2D, gDepth);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glGenFramebuffers(1, &gBufferFBO);
+	glBindFramebuffer(GL_FRAMEBUFFER, gBufferFBO);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, gPosition, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, gNormal, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, gDepth, 0);
+	GLenum drawBuffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+	glDrawBuffers(2, drawBuffers);
+	bool status = check_FB_Status();
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	//The object boxes are generated in the vertex shader, no vertex data
+	glGenVertexArrays(1, &emptyVAO);
+
+	return status;
+}
+
+//Rotate the eye around the focus point, by azimuth around the up axis and by elevation towards it
+void orbitCamera(double azimuth, double elevation)
+{
+	glm::dvec3 offset(eye[0] - focus[0], eye[1] - focus[1], eye[2] - focus[2]);
+	double radius = glm::length(offset);
+	double theta = atan2(offset.y, offset.x) + azimuth;
+	double phi = glm::clamp(asin(offset.z / radius) + elevation, -1.5, 1.5);
 
+	eye[0] = focus[0] + radius * cos(phi) * cos(theta);
+	eye[1] = focus[1] + radius * cos(phi) * sin(theta);
+	eye[2] = focus[2] + radius * sin(phi);
+	view = glm::lookAt(glm::vec3(eye[0], eye[1], eye[2]), glm::vec3(focus[0], focus[1], focus[2]), glm::vec3(0.0f, 0.0f, 1.0f));
 }
+
 bool setGLVariables(const int width,const int height)
 {
 
@@ -123,6 +657,8 @@ bool setGLVariables(const int width,const int height)
 
 	glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
 	glfwWindowHint(GLFW_DOUBLEBUFFER, GLFW_TRUE);
+	if (hiddenWindow)
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
 
 	// Create the window
 	glContext = glfwCreateWindow(width, height, "Rendering", NULL, NULL);
@@ -143,36 +679,120 @@ bool setGLVariables(const int width,const int height)
 	}
 
 
-	//Initializing the compute shader
-	if (!_rayTracingShader.initComputeShader(rayTraceCS))
+	//Initializing the compute shaders, with the workgroup size tuned on this device by an earlier launch
+	int tunedX = 8, tunedY = 8;
+	loadTraceGroup(tunedX, tunedY);
+	if (!buildTraceShader(tunedX, tunedY))
 	{
 		error_callback(1, "Raytracing Shader Error\n");
 		return false;
 	}
+	if (!_reflectionShader.initComputeShader({ shaderVersion, sceneGLSL, intersectionGLSL, shadingGLSL, traceShadingGLSL, gBufferGLSL, reflectionCS }) ||
+		!_reflectionUpsampleShader.initComputeShader({ shaderVersion, reflectionUpsampleCS }))
+	{
+		error_callback(1, "Reflection Shaders Error\n");
+		return false;
+	}
+	if (!_tileCullingShader.initComputeShader({ shaderVersion, sceneGLSL, tileListsGLSL, tileCullCS }))
+	{
+		error_callback(1, "Tile Culling Shader Error\n");
+		return false;
+	}
 
 
+	if (!frameDataRing.init(FRAME_DATA_REGION_SIZE))
+	{
+		error_callback(1, "Frame Data Buffer Error\n");
+		return false;
+	}
+
 	glfwSwapInterval(1);
-	glfwShowWindow(glContext);
+	if (!hiddenWindow)
+		glfwShowWindow(glContext);
 
-	//Setting the texture for the compute shader
-	glGenTextures(1, &texture);
-	glBindTexture(GL_TEXTURE_2D, texture);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
+	//Setting the textures for the compute shader
+	glGenTextures(traceTargetsNbr, traceTargets);
+	for (int t = 0; t < traceTargetsNbr; t++)
+	{
+		glBindTexture(GL_TEXTURE_2D, traceTargets[t]);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
+	}
 	glBindTexture(GL_TEXTURE_2D, 0);
+	texture = traceTargets[0];
+
+	//Reduced resolution reflections, one texel per block of reflectionScale x reflectionScale pixels
+	if (reflectionScale > 1)
+	{
+		glGenTextures(1, &reflectionTexture);
+		glBindTexture(GL_TEXTURE_2D, reflectionTexture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, (width + reflectionScale - 1) / reflectionScale, (height + reflectionScale - 1) / reflectionScale, 0, GL_RGBA, GL_FLOAT, NULL);
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+
+	//History of the temporal reprojection cache
+	if (temporalRefresh > 0)
+	{
+		glGenTextures(2, historyColor);
+		glGenTextures(2, historyPosition);
+		for (int h = 0; h < 2; h++)
+		{
+			glBindTexture(GL_TEXTURE_2D, historyColor[h]);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
+			glBindTexture(GL_TEXTURE_2D, historyPosition[h]);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
+		}
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		GLuint zero = 0;
+		glGenBuffers(1, &temporalStatsBuffer);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, temporalStatsBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint), &zero, GL_DYNAMIC_READ);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	}
 
-	//Preparing the compute Shader
-	_rayTracingShader.use();
-	setSceneObjects();
+	//Per tile object lists written by the culling pre-pass
+	int tilesNbr = ((width + CULL_TILE_SIZE - 1) / CULL_TILE_SIZE) * ((height + CULL_TILE_SIZE - 1) / CULL_TILE_SIZE);
+	glGenBuffers(1, &tileBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, tileBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, tilesNbr * (TILE_OBJECTS_MAX_NBR + 1) * sizeof(GLint), NULL, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	//Scene shared by all the shaders
+	glGenBuffers(1, &sceneBuffer);
+	uploadScene(scene, sceneBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, sceneBuffer);
+
+	//Preparing the compute Shaders
 	int sizes[3];
-	glGetProgramiv(_rayTracingShader.getID(), GL_COMPUTE_WORK_GROUP_SIZE, sizes);
-	// we only need X and Y groups
-	groupSizeX = sizes[0];
-	groupSizeY = sizes[1];
+	glGetProgramiv(_tileCullingShader.getID(), GL_COMPUTE_WORK_GROUP_SIZE, sizes);
+	cullGroupSizeX = sizes[0];
+	cullGroupSizeY = sizes[1];
+
+	//The trace and the upsample shaders of the reflections have the same size
+	glGetProgramiv(_reflectionShader.getID(), GL_COMPUTE_WORK_GROUP_SIZE, sizes);
+	reflectionGroupSizeX = sizes[0];
+	reflectionGroupSizeY = sizes[1];
 
-	glUseProgram(0);
 
+	//Initializing the G-buffer for the rasterized primary visibility or the reduced resolution reflections
+	if (rasterPrimary && !_gBufferShader.init({ shaderVersion, sceneGLSL, intersectionGLSL, gBufferVS }, { shaderVersion, sceneGLSL, intersectionGLSL, gBufferFS }))
+	{
+		error_callback(1, "G-Buffer Shader Error\n");
+		return false;
+	}
+	if ((rasterPrimary || reflectionScale > 1) && !init_GBuffer(width, height))
+	{
+		error_callback(1, "G-Buffer Error\n");
+		return false;
+	}
 
 	//Initializing the shaders for display
 	if (!_simpleDraw.init(rayTraceVS, rayTraceFS))
@@ -191,103 +811,1654 @@ bool setGLVariables(const int width,const int height)
 	return true;
 }
 
-//*** Rendering ***********************************************************************************
+//*** Path tracing ********************************************************************************
 
-void render(int width , int height, int depth)
+//Restart the accumulation, the first sample of each tile overwrites the previous ones
+void resetAccumulation()
 {
-	//Clearing the rendering 
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	glDisable(GL_DEPTH_TEST);
-	glViewport(0, 0, width, height);
-	glFlush();
-	_rayTracingShader.use();
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, convergenceBuffer);
+	glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	pathFrames = 0;
+	pathGpuMs = 0.0;
+	pathConverged = false;
+}
 
-	// Set shader uniform input
-	_rayTracingShader.setVec3("eye", glm::vec3(eye[0], eye[1], eye[2]));
-	_rayTracingShader.setMat4("inversinvProjectionView", glm::inverse(projection * view));
-	_rayTracingShader.setInt("depthMax", depth);
-	_rayTracingShader.setFloat("dnear", (GLfloat)dnear);
-	_rayTracingShader.setFloat("dfar", (GLfloat)dfar);
+//Accumulation image and per tile convergence state, std430 layout of the Convergence block:
+//the active tiles counter then the samples and the noise of each tile
+bool init_PathTrace(int width, int height)
+{
+	if (!_pathTraceShader.initComputeShader({ shaderVersion, sceneGLSL, intersectionGLSL, shadingGLSL, traceShadingGLSL, pathTraceCS }))
+	{
+		error_callback(1, "Path Tracing Shader Error\n");
+		return false;
+	}
 
-	// Bind level 0 of framebuffer texture as writable image in the shader
-	glBindImageTexture(0, texture, 0, false, 0, GL_WRITE_ONLY, GL_RGBA32F);
+	glGenTextures(1, &accumTexture);
+	glBindTexture(GL_TEXTURE_2D, accumTexture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
 
-	// Compute appropriate invocation dimension (closest next power of 2)
-	int worksizeX = pow(2, ceil(log((float)width) / log(2))); 
-	int worksizeY = pow(2, ceil(log((float)height) / log(2)));
+	//Guides of the denoiser
+	glGenTextures(1, &albedoTexture);
+	glBindTexture(GL_TEXTURE_2D, albedoTexture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
+	glGenTextures(1, &normalDepthTexture);
+	glBindTexture(GL_TEXTURE_2D, normalDepthTexture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
+	glBindTexture(GL_TEXTURE_2D, 0);
 
-	// Invoke the compute shader
-	glDispatchCompute(worksizeX / groupSizeX, worksizeY / groupSizeY, 1);
+	pathTilesNbr = ((width + CULL_TILE_SIZE - 1) / CULL_TILE_SIZE) * ((height + CULL_TILE_SIZE - 1) / CULL_TILE_SIZE);
+	glGenBuffers(1, &convergenceBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, convergenceBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) + pathTilesNbr * 2 * sizeof(GLuint), NULL, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	resetAccumulation();
+	return true;
+}
+
+//Add a sample to every pixel of the tiles that have not converged yet
+void tracePaths(int width, int height, int depth)
+{
+	_pathTraceShader.use();
+	_pathTraceShader.setIVec2("frameSize", glm::ivec2(width, height));
+	_pathTraceShader.setVec3("eye", glm::vec3(eye[0], eye[1], eye[2]));
+	_pathTraceShader.setMat4("inversinvProjectionView", glm::inverse(projection * view));
+	_pathTraceShader.setInt("depthMax", depth);
+	_pathTraceShader.setFloat("dnear", (GLfloat)dnear);
+	_pathTraceShader.setFloat("dfar", (GLfloat)dfar);
+	_pathTraceShader.setFloat("noiseThreshold", (GLfloat)noiseThreshold);
+	_pathTraceShader.setInt("minSamples", PATH_MIN_SAMPLES);
+	_pathTraceShader.setInt("maxSamples", PATH_MAX_SAMPLES);
+	_pathTraceShader.setInt("seed", pathSeed);
+
+	glBindImageTexture(0, texture, 0, false, 0, GL_WRITE_ONLY, GL_RGBA32F);
+	glBindImageTexture(1, accumTexture, 0, false, 0, GL_READ_WRITE, GL_RGBA32F);
+	glBindImageTexture(2, albedoTexture, 0, false, 0, GL_WRITE_ONLY, GL_RGBA32F);
+	glBindImageTexture(3, normalDepthTexture, 0, false, 0, GL_WRITE_ONLY, GL_RGBA32F);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, convergenceBuffer);
+
+	// One workgroup per tile
+	{
+		PROFILE_GPU_ZONE("pathTrace");
+		glDispatchCompute((width + CULL_TILE_SIZE - 1) / CULL_TILE_SIZE, (height + CULL_TILE_SIZE - 1) / CULL_TILE_SIZE, 1);
+	}
 
-	// Reset image binding
 	glBindImageTexture(0, 0, 0, false, 0, GL_READ_WRITE, GL_RGBA32F);
-	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+	glBindImageTexture(1, 0, 0, false, 0, GL_READ_WRITE, GL_RGBA32F);
+	glBindImageTexture(2, 0, 0, false, 0, GL_READ_WRITE, GL_RGBA32F);
+	glBindImageTexture(3, 0, 0, false, 0, GL_READ_WRITE, GL_RGBA32F);
 	glUseProgram(0);
+	pathFrames++;
+}
 
-	// Draw the rendered image on the screen using textured full-scree  quad
-	_simpleDraw.use();
-	glBindVertexArray(quadVAO);
-	glBindTexture(GL_TEXTURE_2D, texture);
-	glDrawArrays(GL_TRIANGLES, 0, 6);
+bool init_Denoiser()
+{
+	if (!_atrousShader.initComputeShader({ shaderVersion, atrousCS }))
+	{
+		error_callback(1, "Denoiser Shader Error\n");
+		return false;
+	}
+	return true;
+}
+
+//One a-trous pass of the denoiser, between two resources of the render graph
+struct AtrousStep
+{
+	int input, output, albedo, normalDepth;
+	int width, height, pass;
+};
+AtrousStep atrousSteps[DENOISE_PASSES];
+
+void atrousPass(void* data)
+{
+	PROFILE_GPU_ZONE("denoise");
+	const AtrousStep & step = *(const AtrousStep*)data;
+	_atrousShader.use();
+	_atrousShader.setIVec2("frameSize", glm::ivec2(step.width, step.height));
+	_atrousShader.setFloat("sigmaAlbedo", DENOISE_SIGMA_ALBEDO);
+	_atrousShader.setFloat("sigmaDepth", DENOISE_SIGMA_DEPTH);
+	_atrousShader.setInt("stepWidth", 1 << step.pass);
+	_atrousShader.setFloat("sigmaColor", DENOISE_SIGMA_COLOR / (1 << step.pass));
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, renderGraph.texture(step.albedo));
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_2D, renderGraph.texture(step.normalDepth));
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, renderGraph.texture(step.input));
+	glBindImageTexture(0, renderGraph.texture(step.output), 0, false, 0, GL_WRITE_ONLY, GL_RGBA32F);
+	glDispatchCompute((step.width + 7) / 8, (step.height + 7) / 8, 1);
+
+	glBindImageTexture(0, 0, 0, false, 0, GL_READ_WRITE, GL_RGBA32F);
 	glBindTexture(GL_TEXTURE_2D, 0);
-	glBindVertexArray(0);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE0);
 	glUseProgram(0);
 }
 
-//*** main *******************************************************************************************
+//Adds the DENOISE_PASSES passes of the denoiser to the render graph and outputs the resource of the filtered
+//frame. Each pass writes a transient texture only read by the next one, the graph aliases them to two textures
+int addDenoisePasses(int color, int albedo, int normalDepth, int width, int height)
+{
+	int input = color;
+	for (int pass = 0; pass < DENOISE_PASSES; pass++)
+	{
+		AtrousStep & step = atrousSteps[pass];
+		step = { input, renderGraph.createTexture("denoised", width, height, GL_RGBA32F), albedo, normalDepth, width, height, pass };
+		int p = renderGraph.addPass("atrous", &atrousPass, &step);
+		renderGraph.read(p, input, RENDER_SAMPLED);
+		renderGraph.read(p, albedo, RENDER_SAMPLED);
+		renderGraph.read(p, normalDepth, RENDER_SAMPLED);
+		renderGraph.write(p, step.output, RENDER_IMAGE);
+		input = step.output;
+	}
+	return input;
+}
 
-int main( int argc, char** argv )
+//Filter the path traced frame on its own, outputs the texture holding the result until the next frame
+GLuint denoiseFrame(int width, int height)
 {
-  // Retrieving input parameters:
+	renderGraph.reset();
+	int color = renderGraph.importTexture("traceTarget", texture, width, height, GL_RGBA32F);
+	int albedo = renderGraph.importTexture("albedo", albedoTexture, width, height, GL_RGBA32F);
+	int normalDepth = renderGraph.importTexture("normalDepth", normalDepthTexture, width, height, GL_RGBA32F);
+	int output = addDenoisePasses(color, albedo, normalDepth, width, height);
+	renderGraph.execute();
+	return renderGraph.texture(output);
+}
 
-  int i, depth, width, height;
-  
-  if( argc < 7 )
-  {
-	  error_callback(1, "Usage: RayTracer -depth d -width w -height h.\n"\
-                "Depth'd' is the actual recursion depth of the ray-tracer.\n"\
-                "Width 'w' and height 'h' are the dimensions in pixel of the rendering window.\n" );
-  }
+//Reads the number of tiles sampled since the last check, the image has converged once none was.
+//Then the samples of the tiles are read back and compared with sampling every tile as much as the noisiest one
+void checkConvergence()
+{
+	PROFILE_ZONE("checkConvergence");
+	GLuint activeTiles = 0, zero = 0;
+	//The counts are written by the path tracing shader
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, convergenceBuffer);
+	glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint), &activeTiles);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint), &zero);
+	if (activeTiles > 0)
+	{
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		fprintf(stdout, "Path tracing: frame %d, %.1f%% of the tiles still sampling, %.3f ms of GPU time\n",
+			pathFrames, 100.0 * activeTiles / ((double)pathTilesNbr * PATH_CHECK_FRAMES), pathGpuMs);
+		return;
+	}
 
-  // Check inputs
-  for( i = 1; i < ( argc - 1 ); i++ )
-  {
-    if( strcmp( argv[ i ], "-depth" ) == 0 )
-    {
-      sscanf( argv[ i + 1 ], "%d", &depth );
-    }
-    if( strcmp( argv[ i ], "-width" ) == 0 )
-    {
-      sscanf( argv[ i + 1 ], "%d", &width );
-    }
-    if( strcmp( argv[ i ], "-height" ) == 0 )
-    {
-      sscanf( argv[ i + 1 ], "%d", &height );
-    }
-  }
+	GLuint* tiles = arena_Frame().allocArray<GLuint>(pathTilesNbr * 2);
+	glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint), pathTilesNbr * 2 * sizeof(GLuint), tiles);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	double totalSamples = 0.0;
+	GLuint maxSamples = 1, minSamples = PATH_MAX_SAMPLES;
+	for (int t = 0; t < pathTilesNbr; t++)
+	{
+		totalSamples += tiles[2 * t];
+		maxSamples = std::max(maxSamples, tiles[2 * t]);
+		minSamples = std::min(minSamples, tiles[2 * t]);
+	}
 
-  if( width <= 0 || height <= 0 )
-  {
-	  error_callback(1, "RayTracer: Error, invalid image dimensions.\n" );
-  }
+	pathConverged = true;
+	fprintf(stdout, "Path tracing converged under a noise of %.3f in %.3f ms of GPU time: %u to %u samples per pixel, %.1f%% of the samples of a uniform sampling\n",
+		noiseThreshold, pathGpuMs, minSamples, maxSamples, 100.0 * totalSamples / ((double)pathTilesNbr * maxSamples));
+}
 
-  depth = ( depth < 0 ) ? 0 : ( depth > 100 ) ? 100 : depth;
-  
-  //Preparing OpenGL environment
-  if (!setGLVariables(width, height))
-  {
-	  error_callback(1, "Could not init!\n");
-	  return -1;
-  }
+//*** Ray statistics ******************************************************************************
 
-  //Rendering
-  glfwSetInputMode(glContext, GLFW_STICKY_KEYS, GL_TRUE);
+//std430 layout of the RayStats buffer of the shaders
+struct RayStats
+{
+	GLuint maxPixelTests;
+	GLuint rays[3 * RAY_STATS_DEPTHS];
+	GLuint tests[3 * RAY_STATS_DEPTHS];
+};
 
-  while (glfwGetKey(glContext, GLFW_KEY_ESCAPE) != GLFW_PRESS && glfwWindowShouldClose(glContext) == 0)
-  {
-	  glfwPollEvents();
-	  render(width, height, depth);
-	  glfwSwapBuffers(glContext);
+bool init_RayStats()
+{
+	if (!_rayStatsShader.initComputeShader({ shaderVersion, traceGroupGLSL.c_str(), rayStatsDefine, sceneGLSL, frameDataGLSL, tileListsGLSL, intersectionGLSL, shadingGLSL, traceShadingGLSL, gBufferGLSL, rayTraceCS }))
+	{
+		error_callback(1, "Ray Statistics Shader Error\n");
+		return false;
+	}
+
+	RayStats zero = {};
+	glGenBuffers(1, &rayStatsBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, rayStatsBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(RayStats), &zero, GL_DYNAMIC_READ);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	return true;
+}
+
+//Adds the counts of the last frame to the sums and clears them for the next one
+void readRayStats()
+{
+	PROFILE_ZONE("readRayStats");
+	RayStats frame;
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, rayStatsBuffer);
+	glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(RayStats), &frame);
+	glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	for (int s = 0; s < 3 * RAY_STATS_DEPTHS; s++)
+	{
+		statsRays[s] += frame.rays[s];
+		statsTests[s] += frame.tests[s];
+	}
+	heatmapMaxTests = frame.maxPixelTests;
+	statsFrames++;
+}
+
+void resetRayStats()
+{
+	std::fill(statsRays, statsRays + 3 * RAY_STATS_DEPTHS, 0.0);
+	std::fill(statsTests, statsTests + 3 * RAY_STATS_DEPTHS, 0.0);
+	statsGpuMs = 0.0;
+	statsFrames = 0;
+}
+
+//Prints the rays and the tests per frame of each bounce since the last report, and their rate over the GPU time
+//of the frames. The counting variant of the shader is slower than the plain one, the rate is a lower bound
+void reportRayStats()
+{
+	static const char* kinds[3] = { "primary", "reflection", "shadow" };
+	double rays = 0.0, tests = 0.0;
+	for (int s = 0; s < 3 * RAY_STATS_DEPTHS; s++)
+	{
+		rays += statsRays[s];
+		tests += statsTests[s];
+	}
+	int frames = std::max(statsFrames, 1);
+	fprintf(stdout, "Ray stats over %d frames: %.3f Mrays and %.3f M tests per frame, %.2f Mrays/s at %.3f ms of GPU time per frame\n",
+		statsFrames, rays / frames * 1e-6, tests / frames * 1e-6, statsGpuMs > 0.0 ? rays / statsGpuMs * 1e-3 : 0.0, statsGpuMs / frames);
+	for (int d = 0; d < RAY_STATS_DEPTHS; d++)
+		for (int k = 0; k < 3; k++)
+		{
+			int s = k * RAY_STATS_DEPTHS + d;
+			if (statsRays[s] > 0.0)
+				fprintf(stdout, "  Bounce %d%s %-10s %9.3f Mrays %9.3f M tests, %.1f tests per ray\n", d, d == RAY_STATS_DEPTHS - 1 ? "+" : " ",
+					kinds[k], statsRays[s] / frames * 1e-6, statsTests[s] / frames * 1e-6, statsTests[s] / statsRays[s]);
+		}
+	if (heatmap)
+		fprintf(stdout, "  Heatmap: blue for no test to red for %u tests per pixel\n", heatmapMaxTests);
+	resetRayStats();
+}
+
+//*** Rendering ***********************************************************************************
+
+//Parameters of the passes of the frame, see render and traceRegion
+struct RenderFrame
+{
+	int width, height, depth;
+	int regionX, regionY, regionWidth, regionHeight;
+	int stride;
+	bool refine;
+	glm::ivec4 region;
+	int windowWidth, windowHeight;
+	int shown;
+};
+RenderFrame renderFrame;
+
+//Binds the G-buffer to the texture units of the gPosition and gNormal samplers, or unbinds it
+void bindGBuffer(bool bind)
+{
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, bind ? gPosition : 0);
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_2D, bind ? gNormal : 0);
+	glActiveTexture(GL_TEXTURE0);
+}
+
+//Rasterize the primary hits into the G-buffer
+void gBufferPass(void* data)
+{
+	PROFILE_GPU_ZONE("gBuffer");
+	const RenderFrame & frame = *(const RenderFrame*)data;
+	int width = frame.regionWidth, height = frame.regionHeight;
+	//Shift by half a pixel so that pixel centers match the texel corners the compute shader shoots rays through
+	glm::mat4 texelAlign = glm::translate(glm::mat4(1.0f), glm::vec3(1.0f / width, 1.0f / height, 0.0f));
+	glm::mat4 projectionView = texelAlign * projection * view;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, gBufferFBO);
+	glViewport(0, 0, width, height);
+	glEnable(GL_DEPTH_TEST);
+	GLfloat noHit[4] = { 0.0f, 0.0f, 0.0f, -1.0f };
+	GLfloat noNormal[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	glClearBufferfv(GL_COLOR, 0, noHit);
+	glClearBufferfv(GL_COLOR, 1, noNormal);
+	glClear(GL_DEPTH_BUFFER_BIT);
+
+	_gBufferShader.use();
+	_gBufferShader.setMat4("projectionView", projectionView);
+	_gBufferShader.setVec3("eye", glm::vec3(eye[0], eye[1], eye[2]));
+	glBindVertexArray(emptyVAO);
+	glDrawArraysInstanced(GL_TRIANGLES, 0, 36, (GLsizei)scene.objects.size());
+	glBindVertexArray(0);
+	glUseProgram(0);
+
+	glDisable(GL_DEPTH_TEST);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+// Build the per tile object lists for the primary rays
+void tileCullPass(void* data)
+{
+	PROFILE_GPU_ZONE("tileCulling");
+	const RenderFrame & frame = *(const RenderFrame*)data;
+	int tilesX = (frame.regionWidth + CULL_TILE_SIZE - 1) / CULL_TILE_SIZE;
+	int tilesY = (frame.regionHeight + CULL_TILE_SIZE - 1) / CULL_TILE_SIZE;
+	Shader & cullShader = bakeScene ? _bakedTileCullingShader : _tileCullingShader;
+	cullShader.use();
+	cullShader.setMat4("projectionView", projection * view);
+	cullShader.setIVec2("frameSize", glm::ivec2(frame.width, frame.height));
+	cullShader.setIVec2("regionOrigin", glm::ivec2(frame.regionX, frame.regionY));
+	cullShader.setIVec2("regionSize", glm::ivec2(frame.regionWidth, frame.regionHeight));
+	cullShader.setFloat("dnear", (GLfloat)dnear);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, tileBuffer);
+	glDispatchCompute((tilesX + cullGroupSizeX - 1) / cullGroupSizeX, (tilesY + cullGroupSizeY - 1) / cullGroupSizeY, 1);
+	glUseProgram(0);
+}
+
+//Trace the region of the frame into the texture, whose texel (0,0) receives the pixel (regionX, regionY).
+//With a stride, one pixel per stride x stride block is traced, refine skips the pixels of the previous stride
+void tracePass(void* data)
+{
+	PROFILE_ZONE("traceRegion");
+	const RenderFrame & frame = *(const RenderFrame*)data;
+	int width = frame.regionWidth, height = frame.regionHeight, stride = frame.stride;
+
+	//The counting variant when the rays are counted, the scene constants when it is baked
+	Shader & rayShader = rayStats ? _rayStatsShader : bakeScene ? _bakedRayTracingShader : _rayTracingShader;
+	rayShader.use();
+	if (rayStats)
+	{
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, rayStatsBuffer);
+		rayShader.setFloat("heatmapScale", heatmap ? 1.0f / std::max(heatmapMaxTests, 1u) : 0.0f);
+	}
+	{
+		PROFILE_ZONE("uniforms");
+		rayShader.setInt("rasterPrimary", rasterPrimary);
+		rayShader.setInt("reflectionScale", reflectionScale);
+		rayShader.setInt("temporalRefresh", temporalRefresh);
+		rayShader.setIVec2("frameSize", glm::ivec2(frame.width, frame.height));
+		rayShader.setIVec2("regionOrigin", glm::ivec2(frame.regionX, frame.regionY));
+		rayShader.setIVec2("regionSize", glm::ivec2(width, height));
+		rayShader.setInt("depthMax", frame.depth);
+		rayShader.setFloat("dnear", (GLfloat)dnear);
+		rayShader.setFloat("dfar", (GLfloat)dfar);
+
+		// The camera and the pass change every frame, they are copied to the dynamic buffer ring
+		GPUFrameData frameData;
+		frameData.invProjectionView = glm::inverse(projection * view);
+		frameData.prevProjectionView = prevProjectionView;
+		frameData.eye = glm::vec4(eye[0], eye[1], eye[2], 1.0);
+		frameData.prevEye = glm::vec4(prevEye, 1.0f);
+		frameData.frameIndex = frameIndex;
+		frameData.pixelAngle = 2.0f * tan((GLfloat)hfov / 2.0f) / frame.height;
+		frameData.pixelStride = stride;
+		frameData.refinePass = frame.refine;
+		frameData.historyViewCos = (GLfloat)cos(glm::radians(TEMPORAL_VIEW_DEGREES) / std::max(temporalRefresh, 1));
+		GLintptr frameOffset = frameDataRing.write(&frameData, sizeof(frameData));
+		if (frameOffset < 0)
+		{
+			glUseProgram(0);
+			return;
+		}
+		glBindBufferRange(GL_UNIFORM_BUFFER, 0, frameDataRing.buffer(), frameOffset, sizeof(frameData));
+	}
+
+	// Bind level 0 of framebuffer texture as writable image in the shader
+	glBindImageTexture(0, texture, 0, false, 0, GL_WRITE_ONLY, GL_RGBA32F);
+	// The rasterized primary hits are read, the traced ones are kept for the reduced resolution reflections
+	if (rasterPrimary)
+		bindGBuffer(true);
+	else if (reflectionScale > 1)
+	{
+		glBindImageTexture(1, gPosition, 0, false, 0, GL_WRITE_ONLY, GL_RGBA32F);
+		glBindImageTexture(2, gNormal, 0, false, 0, GL_WRITE_ONLY, GL_RGBA16F);
+	}
+
+	// The history written last frame is read back, the other one is written
+	if (temporalRefresh > 0)
+	{
+		int previous = (frameIndex + 1) % 2, current = frameIndex % 2;
+		glActiveTexture(GL_TEXTURE3);
+		glBindTexture(GL_TEXTURE_2D, historyColor[previous]);
+		glActiveTexture(GL_TEXTURE4);
+		glBindTexture(GL_TEXTURE_2D, historyPosition[previous]);
+		glActiveTexture(GL_TEXTURE0);
+		glBindImageTexture(3, historyColor[current], 0, false, 0, GL_WRITE_ONLY, GL_RGBA32F);
+		glBindImageTexture(4, historyPosition[current], 0, false, 0, GL_WRITE_ONLY, GL_RGBA32F);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, temporalStatsBuffer);
+		temporalPixels += (double)width * height;
+		prevProjectionView = projection * view;
+		prevEye = glm::vec3(eye[0], eye[1], eye[2]);
+		frameIndex++;
+	}
+
+	// Compute appropriate invocation dimension (closest next power of 2)
+	int worksizeX = pow(2, ceil(log((float)((width + stride - 1) / stride)) / log(2)));
+	int worksizeY = pow(2, ceil(log((float)((height + stride - 1) / stride)) / log(2)));
+
+	// Invoke the compute shader
+	{
+		PROFILE_GPU_ZONE("rayTrace");
+		glDispatchCompute((worksizeX + groupSizeX - 1) / groupSizeX, (worksizeY + groupSizeY - 1) / groupSizeY, 1);
+	}
+
+	// Reset image binding
+	glBindImageTexture(0, 0, 0, false, 0, GL_READ_WRITE, GL_RGBA32F);
+	glBindImageTexture(1, 0, 0, false, 0, GL_READ_WRITE, GL_RGBA32F);
+	glBindImageTexture(2, 0, 0, false, 0, GL_READ_WRITE, GL_RGBA16F);
+	if (rasterPrimary)
+		bindGBuffer(false);
+	if (temporalRefresh > 0)
+	{
+		glBindImageTexture(3, 0, 0, false, 0, GL_READ_WRITE, GL_RGBA32F);
+		glBindImageTexture(4, 0, 0, false, 0, GL_READ_WRITE, GL_RGBA32F);
+		glActiveTexture(GL_TEXTURE3);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		glActiveTexture(GL_TEXTURE4);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		glActiveTexture(GL_TEXTURE0);
+	}
+	glUseProgram(0);
+}
+
+//Trace the reflection bounces at reduced resolution from the primary hits
+void reflectionPass(void* data)
+{
+	PROFILE_GPU_ZONE("reflections");
+	const RenderFrame & frame = *(const RenderFrame*)data;
+	int reflectionWidth = (frame.regionWidth + reflectionScale - 1) / reflectionScale;
+	int reflectionHeight = (frame.regionHeight + reflectionScale - 1) / reflectionScale;
+
+	_reflectionShader.use();
+	_reflectionShader.setVec3("eye", glm::vec3(eye[0], eye[1], eye[2]));
+	_reflectionShader.setInt("depthMax", frame.depth);
+	_reflectionShader.setFloat("dnear", (GLfloat)dnear);
+	_reflectionShader.setFloat("dfar", (GLfloat)dfar);
+	_reflectionShader.setInt("reflectionScale", reflectionScale);
+	_reflectionShader.setIVec2("frameSize", glm::ivec2(frame.regionWidth, frame.regionHeight));
+	bindGBuffer(true);
+	glBindImageTexture(0, reflectionTexture, 0, false, 0, GL_WRITE_ONLY, GL_RGBA32F);
+	glDispatchCompute((reflectionWidth + reflectionGroupSizeX - 1) / reflectionGroupSizeX, (reflectionHeight + reflectionGroupSizeY - 1) / reflectionGroupSizeY, 1);
+
+	glBindImageTexture(0, 0, 0, false, 0, GL_READ_WRITE, GL_RGBA32F);
+	bindGBuffer(false);
+	glUseProgram(0);
+}
+
+//Composite the reduced resolution reflections over the direct lighting
+void compositePass(void* data)
+{
+	PROFILE_GPU_ZONE("composite");
+	const RenderFrame & frame = *(const RenderFrame*)data;
+	_reflectionUpsampleShader.use();
+	_reflectionUpsampleShader.setVec3("eye", glm::vec3(eye[0], eye[1], eye[2]));
+	_reflectionUpsampleShader.setVec4("reflection", scene.reflection);
+	_reflectionUpsampleShader.setInt("reflectionScale", reflectionScale);
+	_reflectionUpsampleShader.setIVec2("frameSize", glm::ivec2(frame.regionWidth, frame.regionHeight));
+	bindGBuffer(true);
+	glBindImageTexture(0, texture, 0, false, 0, GL_READ_WRITE, GL_RGBA32F);
+	glActiveTexture(GL_TEXTURE3);
+	glBindTexture(GL_TEXTURE_2D, reflectionTexture);
+	glDispatchCompute((frame.regionWidth + reflectionGroupSizeX - 1) / reflectionGroupSizeX, (frame.regionHeight + reflectionGroupSizeY - 1) / reflectionGroupSizeY, 1);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE0);
+
+	glBindImageTexture(0, 0, 0, false, 0, GL_READ_WRITE, GL_RGBA32F);
+	bindGBuffer(false);
+	glUseProgram(0);
+}
+
+//Adds to the render graph the passes tracing the region of the frame into the target: the primary hits, rasterized
+//or from the tile lists, the rays, and the reduced resolution reflections. The G-buffer, the reduced resolution
+//reflections and the temporal cache need the region to be the whole frame
+void addTracePasses(RenderFrame & frame, int target)
+{
+	int position = -1, normal = -1, tiles = -1;
+	if (rasterPrimary || reflectionScale > 1)
+	{
+		position = renderGraph.importTexture("gPosition", gPosition, frame.regionWidth, frame.regionHeight, GL_RGBA32F);
+		normal = renderGraph.importTexture("gNormal", gNormal, frame.regionWidth, frame.regionHeight, GL_RGBA16F);
+	}
+	if (rasterPrimary)
+	{
+		int pass = renderGraph.addPass("gBuffer", &gBufferPass, &frame);
+		renderGraph.write(pass, position, RENDER_ATTACHMENT);
+		renderGraph.write(pass, normal, RENDER_ATTACHMENT);
+	}
+	else
+	{
+		tiles = renderGraph.importBuffer("tileLists", tileBuffer);
+		int pass = renderGraph.addPass("tileCulling", &tileCullPass, &frame);
+		renderGraph.write(pass, tiles, RENDER_STORAGE);
+	}
+
+	int trace = renderGraph.addPass("trace", &tracePass, &frame);
+	renderGraph.write(trace, target, RENDER_IMAGE);
+	if (rasterPrimary)
+	{
+		renderGraph.read(trace, position, RENDER_SAMPLED);
+		renderGraph.read(trace, normal, RENDER_SAMPLED);
+	}
+	else
+	{
+		renderGraph.read(trace, tiles, RENDER_STORAGE);
+		if (reflectionScale > 1)
+		{
+			renderGraph.write(trace, position, RENDER_IMAGE);
+			renderGraph.write(trace, normal, RENDER_IMAGE);
+		}
+	}
+	if (temporalRefresh > 0)
+	{
+		int previous = (frameIndex + 1) % 2, current = frameIndex % 2;
+		int stats = renderGraph.importBuffer("temporalStats", temporalStatsBuffer);
+		renderGraph.read(trace, renderGraph.importTexture("historyColor", historyColor[previous], frame.width, frame.height, GL_RGBA32F), RENDER_SAMPLED);
+		renderGraph.read(trace, renderGraph.importTexture("historyPosition", historyPosition[previous], frame.width, frame.height, GL_RGBA32F), RENDER_SAMPLED);
+		renderGraph.write(trace, renderGraph.importTexture("historyColor", historyColor[current], frame.width, frame.height, GL_RGBA32F), RENDER_IMAGE);
+		renderGraph.write(trace, renderGraph.importTexture("historyPosition", historyPosition[current], frame.width, frame.height, GL_RGBA32F), RENDER_IMAGE);
+		renderGraph.read(trace, stats, RENDER_STORAGE);
+		renderGraph.write(trace, stats, RENDER_STORAGE);
+	}
+	if (rayStats)
+	{
+		int stats = renderGraph.importBuffer("rayStats", rayStatsBuffer);
+		renderGraph.read(trace, stats, RENDER_STORAGE);
+		renderGraph.write(trace, stats, RENDER_STORAGE);
+	}
+
+	if (reflectionScale > 1)
+	{
+		int reflections = renderGraph.importTexture("reflections", reflectionTexture, (frame.regionWidth + reflectionScale - 1) / reflectionScale,
+			(frame.regionHeight + reflectionScale - 1) / reflectionScale, GL_RGBA32F);
+		int pass = renderGraph.addPass("reflections", &reflectionPass, &frame);
+		renderGraph.read(pass, position, RENDER_SAMPLED);
+		renderGraph.read(pass, normal, RENDER_SAMPLED);
+		renderGraph.write(pass, reflections, RENDER_IMAGE);
+
+		pass = renderGraph.addPass("composite", &compositePass, &frame);
+		renderGraph.read(pass, position, RENDER_SAMPLED);
+		renderGraph.read(pass, normal, RENDER_SAMPLED);
+		renderGraph.read(pass, reflections, RENDER_SAMPLED);
+		renderGraph.read(pass, target, RENDER_IMAGE);
+		renderGraph.write(pass, target, RENDER_IMAGE);
+	}
+}
+
+//Declares the passes tracing a rectangle of the frame into the texture, whose texel (0,0) receives the pixel
+//(regionX, regionY), see tracePass, and outputs the resource of the texture
+int addTraceRegion(int frameWidth, int frameHeight, int regionX, int regionY, int width, int height, int depth,
+	int stride, bool refine)
+{
+	renderFrame = { frameWidth, frameHeight, depth, regionX, regionY, width, height, stride, refine, glm::ivec4(0), width, height, 0 };
+	renderFrame.shown = renderGraph.importTexture("traceTarget", texture, width, height, GL_RGBA32F);
+	addTracePasses(renderFrame, renderFrame.shown);
+	return renderFrame.shown;
+}
+
+//Trace a rectangle of the frame into the texture on its own, out of a frame drawn to the window
+void traceRegion(int frameWidth, int frameHeight, int regionX, int regionY, int width, int height, int depth,
+	int stride, bool refine)
+{
+	renderGraph.reset();
+	addTraceRegion(frameWidth, frameHeight, regionX, regionY, width, height, depth, stride, refine);
+	renderGraph.execute();
+}
+
+void pathTracePass(void* data)
+{
+	const RenderFrame & frame = *(const RenderFrame*)data;
+	tracePaths(frame.width, frame.height, frame.depth);
+}
+
+//Adds the path tracing pass to the render graph and outputs the resources of the guides of the denoiser it writes
+//with the target. The accumulation and the tile counts are read back by the next frame
+void addPathTracePass(RenderFrame & frame, int target, int & albedo, int & normalDepth)
+{
+	albedo = renderGraph.importTexture("albedo", albedoTexture, frame.width, frame.height, GL_RGBA32F);
+	normalDepth = renderGraph.importTexture("normalDepth", normalDepthTexture, frame.width, frame.height, GL_RGBA32F);
+	int accumulation = renderGraph.importTexture("accumulation", accumTexture, frame.width, frame.height, GL_RGBA32F);
+	int convergence = renderGraph.importBuffer("convergence", convergenceBuffer);
+	int pass = renderGraph.addPass("pathTrace", &pathTracePass, &frame);
+	renderGraph.write(pass, target, RENDER_IMAGE);
+	renderGraph.write(pass, albedo, RENDER_IMAGE);
+	renderGraph.write(pass, normalDepth, RENDER_IMAGE);
+	renderGraph.read(pass, accumulation, RENDER_IMAGE);
+	renderGraph.write(pass, accumulation, RENDER_IMAGE);
+	renderGraph.read(pass, convergence, RENDER_STORAGE);
+	renderGraph.write(pass, convergence, RENDER_STORAGE);
+}
+
+//Add a sample to the frame on its own, out of a frame drawn to the window
+void pathTraceFrame(int width, int height, int depth)
+{
+	renderFrame = { width, height, depth, 0, 0, width, height, 1, false, glm::ivec4(0), width, height, 0 };
+	renderGraph.reset();
+	int target = renderGraph.importTexture("traceTarget", texture, width, height, GL_RGBA32F);
+	int albedo, normalDepth;
+	addPathTracePass(renderFrame, target, albedo, normalDepth);
+	renderGraph.execute();
+}
+
+// Draw the rendered image on the screen using textured full-scree  quad
+void blitPass(void* data)
+{
+	PROFILE_ZONE("blit");
+	PROFILE_GPU_ZONE("blit");
+	const RenderFrame & frame = *(const RenderFrame*)data;
+	glViewport(frame.region.x, frame.region.y, frame.region.z, frame.region.w);
+	_simpleDraw.use();
+	_simpleDraw.setVec2("texScale", glm::vec2((float)frame.regionWidth / frame.windowWidth, (float)frame.regionHeight / frame.windowHeight));
+	glBindVertexArray(quadVAO);
+	glBindTexture(GL_TEXTURE_2D, renderGraph.texture(frame.shown));
+	glDrawArrays(GL_TRIANGLES, 0, 6);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glBindVertexArray(0);
+	glUseProgram(0);
+}
+
+//Only the region of the window is traced and drawn, the whole window when the region is empty
+void render(int width , int height, int depth, glm::ivec4 region)
+{
+	PROFILE_ZONE("render");
+	//The blit covers the window, only a region of interest leaves the rest of it to clear
+	if (region.z > 0 && region.w > 0 && (region.x > 0 || region.y > 0 || region.z < width || region.w < height))
+	{
+		PROFILE_ZONE("clear");
+		glViewport(0, 0, width, height);
+		glClear(GL_COLOR_BUFFER_BIT);
+	}
+
+	//Next trace target, once the GPU is done drawing the frame it holds
+	if (traceTargetsNbr > 1)
+	{
+		PROFILE_ZONE("targetWait");
+		traceTargetIndex = (traceTargetIndex + 1) % traceTargetsNbr;
+		texture = traceTargets[traceTargetIndex];
+		GLsync fence = traceTargetFences[traceTargetIndex];
+		if (fence)
+			waitFence(fence, traceTargetWaitMs, traceTargetWaits);
+		traceTargetFences[traceTargetIndex] = nullptr;
+	}
+
+	//Traced resolution, upscaled to the window when drawing
+	int windowWidth = width, windowHeight = height;
+	width = std::max(1, (int)(windowWidth * resolutionScale + 0.5));
+	height = std::max(1, (int)(windowHeight * resolutionScale + 0.5));
+
+	//The temporal history does not match a new resolution
+	static int prevWidth = width, prevHeight = height;
+	if (width != prevWidth || height != prevHeight)
+		frameIndex = 0;
+	prevWidth = width;
+	prevHeight = height;
+
+	//Region at the traced resolution
+	if (region.z <= 0 || region.w <= 0)
+		region = glm::ivec4(0, 0, windowWidth, windowHeight);
+	int regionX = std::min((int)(region.x * resolutionScale), width - 1);
+	int regionY = std::min((int)(region.y * resolutionScale), height - 1);
+	int regionWidth = std::max(1, std::min((int)(region.z * resolutionScale + 0.5), width - regionX));
+	int regionHeight = std::max(1, std::min((int)(region.w * resolutionScale + 0.5), height - regionY));
+
+	//Progressive preview: nothing left to trace once the full resolution pass is done
+	int stride = progressive ? progressiveStride : 1;
+	renderFrame = { width, height, depth, regionX, regionY, regionWidth, regionHeight, stride, progressive && stride < PROGRESSIVE_STRIDE,
+		region, windowWidth, windowHeight, 0 };
+
+	//Passes of the frame, the graph places the barriers between them
+	renderGraph.reset();
+	int target = renderGraph.importTexture("traceTarget", texture, windowWidth, windowHeight, GL_RGBA32F);
+	renderFrame.shown = target;
+	if (pathTrace)
+	{
+		int albedo, normalDepth;
+		addPathTracePass(renderFrame, target, albedo, normalDepth);
+		if (denoisePaths)
+			renderFrame.shown = addDenoisePasses(target, albedo, normalDepth, width, height);
+	}
+	else if (stride > 0)
+		addTracePasses(renderFrame, target);
+	int blit = renderGraph.addPass("blit", &blitPass, &renderFrame);
+	renderGraph.read(blit, renderFrame.shown, RENDER_SAMPLED);
+	renderGraph.execute();
+	if (progressive)
+		progressiveStride /= 2;
+
+	if (traceTargetsNbr > 1)
+		traceTargetFences[traceTargetIndex] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	//The next frame writes its data to another region
+	frameDataRing.nextRegion();
+}
+
+//*** Multi-view batches ****************************************************************************
+
+//std430 layout of the View struct of the shaders
+struct GPUView
+{
+	glm::mat4 projectionView;
+	glm::mat4 invProjectionView;
+	glm::vec4 eye;
+};
+
+bool init_MultiView()
+{
+	if (!_multiViewShader.initComputeShader({ shaderVersion, traceGroupGLSL.c_str(), multiViewDefine, sceneGLSL, multiViewGLSL, tileListsGLSL, intersectionGLSL, shadingGLSL, traceShadingGLSL, gBufferGLSL, rayTraceCS }) ||
+		!_multiViewCullShader.initComputeShader({ shaderVersion, multiViewDefine, sceneGLSL, multiViewGLSL, tileListsGLSL, tileCullCS }))
+	{
+		error_callback(1, "Multi-View Shaders Error\n");
+		return false;
+	}
+	glGenTextures(1, &viewsTexture);
+	glGenBuffers(1, &viewsBuffer);
+	glGenBuffers(1, &viewsTileBuffer);
+	viewsWidth = viewsHeight = viewsLayers = 0;
+	return true;
+}
+
+//Layers and per view tile lists for a batch of views
+void resizeViewTargets(int width, int height, int layers)
+{
+	int tilesX = (width + CULL_TILE_SIZE - 1) / CULL_TILE_SIZE;
+	int tilesY = (height + CULL_TILE_SIZE - 1) / CULL_TILE_SIZE;
+	if (width != viewsWidth || height != viewsHeight || layers > viewsLayers)
+	{
+		viewsWidth = width;
+		viewsHeight = height;
+		viewsLayers = layers;
+		glBindTexture(GL_TEXTURE_2D_ARRAY, viewsTexture);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA32F, width, height, layers, 0, GL_RGBA, GL_FLOAT, NULL);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, viewsTileBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)tilesX * tilesY * layers * (TILE_OBJECTS_MAX_NBR + 1) * sizeof(GLint), NULL, GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	}
+}
+
+//Parameters of the passes of a batch of views, see traceViews
+struct ViewBatch
+{
+	int width, height, depth, layers;
+};
+ViewBatch viewBatch;
+
+// Per tile object lists of all the views
+void viewCullPass(void* data)
+{
+	const ViewBatch & batch = *(const ViewBatch*)data;
+	int tilesX = (batch.width + CULL_TILE_SIZE - 1) / CULL_TILE_SIZE;
+	int tilesY = (batch.height + CULL_TILE_SIZE - 1) / CULL_TILE_SIZE;
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, viewsBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, viewsTileBuffer);
+	_multiViewCullShader.use();
+	_multiViewCullShader.setIVec2("frameSize", glm::ivec2(batch.width, batch.height));
+	_multiViewCullShader.setIVec2("regionOrigin", glm::ivec2(0, 0));
+	_multiViewCullShader.setIVec2("regionSize", glm::ivec2(batch.width, batch.height));
+	_multiViewCullShader.setFloat("dnear", (GLfloat)dnear);
+	glDispatchCompute((tilesX + cullGroupSizeX - 1) / cullGroupSizeX, (tilesY + cullGroupSizeY - 1) / cullGroupSizeY, batch.layers);
+	glUseProgram(0);
+}
+
+void viewTracePass(void* data)
+{
+	const ViewBatch & batch = *(const ViewBatch*)data;
+	_multiViewShader.use();
+	_multiViewShader.setInt("rasterPrimary", 0);
+	_multiViewShader.setInt("reflectionScale", 1);
+	_multiViewShader.setInt("temporalRefresh", 0);
+	_multiViewShader.setIVec2("frameSize", glm::ivec2(batch.width, batch.height));
+	_multiViewShader.setIVec2("regionOrigin", glm::ivec2(0, 0));
+	_multiViewShader.setIVec2("regionSize", glm::ivec2(batch.width, batch.height));
+	_multiViewShader.setInt("depthMax", batch.depth);
+	_multiViewShader.setFloat("dnear", (GLfloat)dnear);
+	_multiViewShader.setFloat("dfar", (GLfloat)dfar);
+	glBindImageTexture(0, viewsTexture, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+	glDispatchCompute((batch.width + groupSizeX - 1) / groupSizeX, (batch.height + groupSizeY - 1) / groupSizeY, batch.layers);
+
+	glBindImageTexture(0, 0, 0, false, 0, GL_READ_WRITE, GL_RGBA32F);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, tileBuffer);
+	glUseProgram(0);
+}
+
+//Trace the scene seen by each camera into a layer of viewsTexture, the views share the projection
+void traceViews(const std::vector<glm::mat4> & cameras, int width, int height, int depth)
+{
+	int layers = (int)cameras.size();
+	resizeViewTargets(width, height, layers);
+
+	std::vector<GPUView> views(layers);
+	for (int v = 0; v < layers; v++)
+	{
+		views[v].projectionView = projection * cameras[v];
+		views[v].invProjectionView = glm::inverse(views[v].projectionView);
+		views[v].eye = glm::inverse(cameras[v])[3];
+	}
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, viewsBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, layers * sizeof(GPUView), views.data(), GL_STREAM_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	viewBatch = { width, height, depth, layers };
+	renderGraph.reset();
+	int tiles = renderGraph.importBuffer("viewTileLists", viewsTileBuffer);
+	int target = renderGraph.importTexture("views", viewsTexture, width, height * layers, GL_RGBA32F);
+	int cull = renderGraph.addPass("viewCulling", &viewCullPass, &viewBatch);
+	renderGraph.write(cull, tiles, RENDER_STORAGE);
+	int trace = renderGraph.addPass("viewTrace", &viewTracePass, &viewBatch);
+	renderGraph.read(trace, tiles, RENDER_STORAGE);
+	renderGraph.write(trace, target, RENDER_IMAGE);
+	renderGraph.execute();
+}
+
+//*** Progressive preview ****************************************************************************
+
+//Collects the GPU time of the passes of a progression, printed once the full resolution pass is timed
+void reportProgressive(int stride, double passMs)
+{
+	static double strideMs[PROGRESSIVE_STRIDE + 1];
+	if (stride == PROGRESSIVE_STRIDE)
+		std::fill(strideMs, strideMs + PROGRESSIVE_STRIDE + 1, 0.0);
+	strideMs[stride] = passMs;
+	if (stride != 1)
+		return;
+
+	double totalMs = 0.0;
+	for (int s = PROGRESSIVE_STRIDE; s >= 1; s /= 2)
+		totalMs += strideMs[s];
+	fprintf(stdout, "Progressive: first preview at 1/%d in %.3f ms, %.1f%% of the %.3f ms to full resolution (",
+		PROGRESSIVE_STRIDE, strideMs[PROGRESSIVE_STRIDE], 100.0 * strideMs[PROGRESSIVE_STRIDE] / totalMs, totalMs);
+	for (int s = PROGRESSIVE_STRIDE / 2; s > 1; s /= 2)
+		fprintf(stdout, "1/%d +%.3f ms, ", s, strideMs[s]);
+	fprintf(stdout, "full +%.3f ms)\n", strideMs[1]);
+}
+
+//*** Dynamic resolution *****************************************************************************
+
+//Update the resolution scale from a measured GPU frame time
+void governResolution(double frameMs)
+{
+	static int frame = 0;
+	static int settleFrames = 0;
+	frame++;
+
+	//Measurements lag behind by the frames in flight, let them catch up with the last change
+	if (settleFrames > 0)
+	{
+		settleFrames--;
+	}
+	//Hysteresis band around the target so that the scale does not oscillate
+	else if (frameMs > targetFrameMs * 1.05 || frameMs < targetFrameMs * 0.85)
+	{
+		//The cost is roughly proportional to the number of traced pixels
+		double scale = resolutionScale * sqrt(targetFrameMs / frameMs);
+		scale = glm::clamp(scale, resolutionScale * 0.8, resolutionScale * 1.1);
+		scale = glm::clamp(scale, 0.25, 1.0);
+		if (fabs(scale - resolutionScale) > 0.01)
+		{
+			resolutionScale = scale;
+			settleFrames = 4;
+		}
+	}
+	fprintf(stdout, "Frame %d: %.3f ms, resolution scale %.2f\n", frame, frameMs, resolutionScale);
+}
+
+//*** Frame timing ***********************************************************************************
+
+//Fraction of the pixels traced with the temporal cache since the last call that were shaded from scratch
+double readTracedFraction()
+{
+	GLuint traced = 0, zero = 0;
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, temporalStatsBuffer);
+	glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint), &traced);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint), &zero);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	double pixels = temporalPixels;
+	temporalPixels = 0.0;
+	return pixels > 0.0 ? traced / pixels : 0.0;
+}
+
+//GPU time per frame of the next frames, the camera does not move
+double timeFrames(int width, int height, int depth, int frames)
+{
+	GpuTimer timer;
+	timer.init();
+	double totalMs = 0.0, elapsedMs;
+	for (int f = 0; f < frames; f++)
+	{
+		timer.begin();
+		render(width, height, depth);
+		timer.end();
+		glfwSwapBuffers(glContext);
+		glfwPollEvents();
+		while (timer.fetch(elapsedMs))
+			totalMs += elapsedMs;
+	}
+	timer.finish();
+	while (timer.fetch(elapsedMs))
+		totalMs += elapsedMs;
+	timer.release();
+	return totalMs / frames;
+}
+
+//Compiles the shaders with the scene baked in, and the runtime ones again to time both the same way. Renders the
+//first frame with each, where drivers may finish compiling, then BAKE_COMPARE_FRAMES timed frames, and prints how
+//many frames the faster trace takes to pay for the longer build. The baked shaders render from then on. A scene
+//that cannot be baked keeps the scene buffer
+bool init_BakedScene(int width, int height, int depth)
+{
+	std::string bakedGLSL = bakeSceneGLSL(scene);
+	if (bakedGLSL.empty())
+	{
+		fprintf(stdout, "The scene has infinite or NaN values that cannot be baked, ignoring -bake\n");
+		bakeScene = false;
+		return true;
+	}
+	const char* baked = bakedGLSL.c_str();
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	Shader runtimeTracing, runtimeCulling;
+	bool compiled = runtimeTracing.initComputeShader({ shaderVersion, traceGroupGLSL.c_str(), sceneGLSL, frameDataGLSL, tileListsGLSL, intersectionGLSL, shadingGLSL, traceShadingGLSL, gBufferGLSL, rayTraceCS }) &&
+		runtimeCulling.initComputeShader({ shaderVersion, sceneGLSL, tileListsGLSL, tileCullCS });
+	double runtimeBuildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	glDeleteProgram(runtimeTracing.getID());
+	glDeleteProgram(runtimeCulling.getID());
+
+	start = std::chrono::steady_clock::now();
+	compiled = compiled &&
+		_bakedRayTracingShader.initComputeShader({ shaderVersion, traceGroupGLSL.c_str(), sceneGLSL, baked, frameDataGLSL, tileListsGLSL, intersectionGLSL, shadingGLSL, traceShadingGLSL, gBufferGLSL, rayTraceCS }) &&
+		_bakedTileCullingShader.initComputeShader({ shaderVersion, sceneGLSL, baked, tileListsGLSL, tileCullCS });
+	double bakedBuildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	if (!compiled)
+	{
+		error_callback(1, "Baked Scene Shader Error\n");
+		return false;
+	}
+
+	//Each pass of the progressive preview would trace fewer pixels than the last
+	bool wasProgressive = progressive;
+	progressive = false;
+	double firstMs[2], frameMs[2];
+	for (int variant = 0; variant < 2; variant++)
+	{
+		bakeScene = variant == 1;
+		start = std::chrono::steady_clock::now();
+		render(width, height, depth);
+		glFinish();
+		firstMs[variant] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		frameMs[variant] = timeFrames(width, height, depth, BAKE_COMPARE_FRAMES);
+	}
+	progressive = wasProgressive;
+
+	fprintf(stdout, "Baked scene, %d objects and %d lights, %dx%d depth %d:\n", (int)scene.objects.size(),
+		std::min((int)scene.lights.size(), LIGHTS_MAX_NBR), width, height, depth);
+	fprintf(stdout, "  Runtime shaders: compile and link %.1f ms, first frame %.1f ms, %.3f ms/frame\n", runtimeBuildMs, firstMs[0], frameMs[0]);
+	fprintf(stdout, "  Baked shaders:   compile and link %.1f ms, first frame %.1f ms, %.3f ms/frame\n", bakedBuildMs, firstMs[1], frameMs[1]);
+	double extraMs = bakedBuildMs + firstMs[1] - runtimeBuildMs - firstMs[0];
+	double savedMs = frameMs[0] - frameMs[1];
+	if (savedMs > 0.0)
+		fprintf(stdout, "  Trace speedup x%.2f, the extra build time is paid back after %d frames\n", frameMs[0] / frameMs[1],
+			extraMs > 0.0 ? (int)ceil(extraMs / savedMs) : 0);
+	else
+		fprintf(stdout, "  Trace speedup x%.2f, baking does not pay off for this scene\n", frameMs[0] / frameMs[1]);
+	return true;
+}
+
+//Workgroup shapes tried by -tune: square, wide and one row of pixels
+static const int traceGroupSizes[][2] = { { 8, 8 }, { 16, 8 }, { 16, 16 }, { 8, 4 }, { 32, 4 }, { 32, 8 }, { 64, 1 } };
+
+//Builds the raytracing shader with each workgroup size the device supports, renders a first frame where drivers may
+//finish compiling, then times TUNE_FRAMES frames of the scene. Keeps the fastest and saves it for the device
+bool init_TuneGroups(int width, int height, int depth)
+{
+	GLint maxInvocations = 0;
+	glGetIntegerv(GL_MAX_COMPUTE_WORK_GROUP_INVOCATIONS, &maxInvocations);
+	bool wasProgressive = progressive;
+	progressive = false;
+
+	fprintf(stdout, "Workgroup sizes of the raytracing shader, %dx%d depth %d, %d frames each:\n", width, height, depth, TUNE_FRAMES);
+	int bestX = 0, bestY = 0;
+	double bestMs = 0.0, defaultMs = 0.0;
+	for (size_t g = 0; g < sizeof(traceGroupSizes) / sizeof(traceGroupSizes[0]); g++)
+	{
+		int x = traceGroupSizes[g][0], y = traceGroupSizes[g][1];
+		if (x * y > maxInvocations)
+			continue;
+		if (!buildTraceShader(x, y))
+		{
+			fprintf(stderr, "  %dx%d: the raytracing shader does not build\n", x, y);
+			continue;
+		}
+		render(width, height, depth);
+		glFinish();
+		double ms = timeFrames(width, height, depth, TUNE_FRAMES);
+		fprintf(stdout, "  %2dx%-2d %9.3f ms/frame\n", x, y, ms);
+		if (x == 8 && y == 8)
+			defaultMs = ms;
+		if (bestX == 0 || ms < bestMs)
+		{
+			bestX = x;
+			bestY = y;
+			bestMs = ms;
+		}
+	}
+	progressive = wasProgressive;
+	if (bestX == 0)
+	{
+		error_callback(1, "Raytracing Shader Error\n");
+		return false;
+	}
+
+	if (!buildTraceShader(bestX, bestY))
+	{
+		error_callback(1, "Raytracing Shader Error\n");
+		return false;
+	}
+	fprintf(stdout, "  Fastest %dx%d, x%.2f against 8x8, saved to %s for %s\n", bestX, bestY, defaultMs > 0.0 ? defaultMs / bestMs : 1.0,
+		traceGroupsPath, deviceString().c_str());
+	saveTraceGroup(bestX, bestY);
+	return true;
+}
+
+//*** Options ****************************************************************************************
+
+//Settles the options once they are all parsed: clamps each value to its range, then drops the options that the
+//modes cannot combine, with a message for each. Exits on the errors
+void validateOptions(int & width, int & height, int & depth, int & tileSize, bool posterTiles, bool cpuCompare,
+	int & workersNbr, int & jobsNbr)
+{
+	if (width <= 0 || height <= 0)
+		error_callback(1, "RayTracer: Error, invalid image dimensions.\n");
+	if (scalingFrames > 0 && !generatedKind)
+		error_callback(1, "RayTracer: Error, -scaling needs a -generate scene.\n");
+
+	depth = (depth < 0) ? 0 : (depth > 100) ? 100 : depth;
+	reflectionScale = (reflectionScale >= 4) ? 4 : (reflectionScale >= 2) ? 2 : 1;
+	temporalRefresh = (temporalRefresh < 0) ? 0 : temporalRefresh;
+	traceTargetsNbr = glm::clamp(traceTargetsNbr, 1, TRACE_TARGETS_MAX);
+	if (generatedKind)
+	{
+		generatedObjectsNbr = std::max(generatedObjectsNbr, 1);
+		generatedLightsNbr = glm::clamp(generatedLightsNbr, 1, LIGHTS_MAX_NBR);
+	}
+	workersNbr = std::max(workersNbr, 1);
+	jobsNbr = std::max(jobsNbr, 1);
+	//The poster tiles are traced by whole tiles of the culling pass
+	tileSize = glm::clamp(tileSize, 16, 4096);
+	if (posterTiles)
+		tileSize = tileSize / 16 * 16;
+	if (regionOfInterest.z > 0 && regionOfInterest.w > 0)
+	{
+		regionOfInterest.x = glm::clamp(regionOfInterest.x, 0, width - 1);
+		regionOfInterest.y = glm::clamp(regionOfInterest.y, 0, height - 1);
+		regionOfInterest.z = std::min(regionOfInterest.z, width - regionOfInterest.x);
+		regionOfInterest.w = std::min(regionOfInterest.w, height - regionOfInterest.y);
+	}
+
+	if (temporalRefresh > 0 && reflectionScale > 1)
+	{
+		fprintf(stdout, "The temporal cache needs full resolution reflections, ignoring -reflscale\n");
+		reflectionScale = 1;
+	}
+
+	//The CPU trace has the shared code only: traced primary rays and full resolution reflections on a still camera
+	if (cpuCompare && (rasterPrimary || reflectionScale > 1 || temporalRefresh > 0 || pathTrace || progressive || targetFrameMs > 0.0 ||
+		regionOfInterest.z > 0 || heatmap || rayStats))
+	{
+		fprintf(stdout, "-cpucompare renders whole traced frames, ignoring -primary, -reflscale, -temporal, -pathtrace, -progressive, -targetms, -roi, -raystats and -heatmap\n");
+		rasterPrimary = false;
+		reflectionScale = 1;
+		temporalRefresh = 0;
+		pathTrace = false;
+		progressive = false;
+		targetFrameMs = 0.0;
+		regionOfInterest = glm::ivec4(0);
+		rayStats = heatmap = false;
+	}
+
+	//The rays are counted in the full resolution raytracing pass
+	rayStats = rayStats || heatmap;
+	if (rayStats && (pathTrace || reflectionScale > 1))
+	{
+		fprintf(stdout, "-raystats and -heatmap count the rays of the full resolution raytracing pass, ignoring -pathtrace and -reflscale\n");
+		pathTrace = false;
+		reflectionScale = 1;
+	}
+
+	//Path tracing accumulates whole frames of traced primary rays
+	if (pathTrace && (progressive || regionOfInterest.z > 0 || rasterPrimary || reflectionScale > 1 || temporalRefresh > 0 || targetFrameMs > 0.0))
+	{
+		fprintf(stdout, "-pathtrace accumulates whole frames at a fixed resolution, ignoring -primary, -reflscale, -temporal, -targetms, -roi and -progressive\n");
+		rasterPrimary = false;
+		reflectionScale = 1;
+		temporalRefresh = 0;
+		targetFrameMs = 0.0;
+		regionOfInterest = glm::ivec4(0);
+		progressive = false;
+	}
+
+	//Only the tile culling and the raytracing passes are baked, for the scene given at startup
+	if (bakeScene && (pathTrace || rayStats || scalingFrames > 0))
+	{
+		fprintf(stdout, "-bake specializes the raytracing pass to a fixed scene, ignoring it with -pathtrace, -raystats, -heatmap and -scaling\n");
+		bakeScene = false;
+	}
+
+	//The region of interest and the progressive passes only cover part of the frame
+	bool partialFrame = progressive || (regionOfInterest.z > 0 && regionOfInterest.w > 0);
+	if (partialFrame && (rasterPrimary || reflectionScale > 1 || temporalRefresh > 0 || targetFrameMs > 0.0))
+	{
+		fprintf(stdout, "-roi and -progressive need the traced primary visibility at a fixed resolution, ignoring -primary, -reflscale, -temporal and -targetms\n");
+		rasterPrimary = false;
+		reflectionScale = 1;
+		temporalRefresh = 0;
+		targetFrameMs = 0.0;
+	}
+
+	//The progressive passes and the path tracer build the frame over the previous ones, in a single trace target
+	if (progressive || pathTrace)
+		traceTargetsNbr = 1;
+}
+
+//*** main *******************************************************************************************
+
+int main( int argc, char** argv )
+{
+  // Retrieving input parameters:
+
+  int i, depth, width, height;
+  int benchFrames = 0;
+  int viewsNbr = 0;
+  const char* coordinatorAddress = NULL;
+  const char* posterPath = NULL;
+  const char* clientAddress = NULL;
+  const char* sceneName = "default";
+  int jobsNbr = 1;
+  const char* outputPath = "render.ppm";
+  int workersNbr = 1;
+  int tileSize = 256;
+  bool spawnWorkers = false;
+  bool speedupSweep = false;
+  bool cpuCompare = false;
+  int threadsNbr = 0;
+  bool pinThreads = false;
+  bool threadBench = false;
+  bool intersectBench = false;
+
+  //Host side stages run on the job system, one thread per hardware thread unless -threads is given
+  for( i = 1; i < argc; i++ )
+  {
+    if( strcmp( argv[ i ], "-threads" ) == 0 && i + 1 < argc )
+    {
+      sscanf( argv[ i + 1 ], "%d", &threadsNbr );
+    }
+    if( strcmp( argv[ i ], "-pin" ) == 0 )
+    {
+      pinThreads = true;
+    }
+    if( strcmp( argv[ i ], "-threadbench" ) == 0 )
+    {
+      threadBench = true;
+    }
+    if( strcmp( argv[ i ], "-intersectbench" ) == 0 )
+    {
+      intersectBench = true;
+    }
+  }
+  if( threadBench )
+  {
+	  return benchmarkThreads( pinThreads );
+  }
+  if( intersectBench )
+  {
+	  return benchmarkIntersections();
+  }
+  jobs_Init( threadsNbr, pinThreads );
+  atexit( jobs_Shutdown );
+
+  //Worker of a distributed render, everything else comes from the coordinator
+  if( argc == 3 && strcmp( argv[ 1 ], "-worker" ) == 0 )
+  {
+	  return runWorker( argv[ 2 ] );
+  }
+
+  //Render server, the jobs bring their own resolution and camera
+  if( argc >= 3 && strcmp( argv[ 1 ], "-serve" ) == 0 )
+  {
+	  int scenesNbr = 8;
+	  if( argc >= 5 && strcmp( argv[ 3 ], "-scenes" ) == 0 )
+	  {
+		  sscanf( argv[ 4 ], "%d", &scenesNbr );
+	  }
+	  return runServer( argv[ 2 ], scenesNbr );
+  }
+  
+  if( argc < 7 )
+  {
+	  error_callback(1, "Usage: RayTracer -depth d -width w -height h.\n"\
+                "Depth'd' is the actual recursion depth of the ray-tracer.\n"\
+                "Width 'w' and height 'h' are the dimensions in pixel of the rendering window.\n" );
+  }
+
+  // Check inputs
+  for( i = 1; i < ( argc - 1 ); i++ )
+  {
+    if( strcmp( argv[ i ], "-depth" ) == 0 )
+    {
+      sscanf( argv[ i + 1 ], "%d", &depth );
+    }
+    if( strcmp( argv[ i ], "-width" ) == 0 )
+    {
+      sscanf( argv[ i + 1 ], "%d", &width );
+    }
+    if( strcmp( argv[ i ], "-height" ) == 0 )
+    {
+      sscanf( argv[ i + 1 ], "%d", &height );
+    }
+    if( strcmp( argv[ i ], "-primary" ) == 0 )
+    {
+      rasterPrimary = strcmp( argv[ i + 1 ], "raster" ) == 0;
+    }
+    if( strcmp( argv[ i ], "-reflscale" ) == 0 )
+    {
+      sscanf( argv[ i + 1 ], "%d", &reflectionScale );
+    }
+    if( strcmp( argv[ i ], "-temporal" ) == 0 )
+    {
+      sscanf( argv[ i + 1 ], "%d", &temporalRefresh );
+    }
+    if( strcmp( argv[ i ], "-orbit" ) == 0 )
+    {
+      sscanf( argv[ i + 1 ], "%lf", &orbitStep );
+    }
+    if( strcmp( argv[ i ], "-targetms" ) == 0 )
+    {
+      sscanf( argv[ i + 1 ], "%lf", &targetFrameMs );
+    }
+    if( strcmp( argv[ i ], "-pathtrace" ) == 0 )
+    {
+      pathTrace = true;
+      sscanf( argv[ i + 1 ], "%lf", &noiseThreshold );
+    }
+    if( strcmp( argv[ i ], "-denoise" ) == 0 )
+    {
+      sscanf( argv[ i + 1 ], "%d", &denoiseSamples );
+    }
+    if( strcmp( argv[ i ], "-roi" ) == 0 && i + 4 < argc )
+    {
+      sscanf( argv[ i + 1 ], "%d", &regionOfInterest.x );
+      sscanf( argv[ i + 2 ], "%d", &regionOfInterest.y );
+      sscanf( argv[ i + 3 ], "%d", &regionOfInterest.z );
+      sscanf( argv[ i + 4 ], "%d", &regionOfInterest.w );
+    }
+    if( strcmp( argv[ i ], "-profile" ) == 0 && i + 2 < argc )
+    {
+      sscanf( argv[ i + 1 ], "%d", &profileFrames );
+      profilePath = argv[ i + 2 ];
+    }
+    if( strcmp( argv[ i ], "-bench" ) == 0 )
+    {
+      sscanf( argv[ i + 1 ], "%d", &benchFrames );
+    }
+    if( strcmp( argv[ i ], "-views" ) == 0 )
+    {
+      sscanf( argv[ i + 1 ], "%d", &viewsNbr );
+    }
+    if( strcmp( argv[ i ], "-coordinator" ) == 0 )
+    {
+      coordinatorAddress = argv[ i + 1 ];
+    }
+    if( strcmp( argv[ i ], "-workers" ) == 0 )
+    {
+      sscanf( argv[ i + 1 ], "%d", &workersNbr );
+    }
+    if( strcmp( argv[ i ], "-tile" ) == 0 )
+    {
+      sscanf( argv[ i + 1 ], "%d", &tileSize );
+    }
+    if( strcmp( argv[ i ], "-output" ) == 0 )
+    {
+      outputPath = argv[ i + 1 ];
+    }
+    if( strcmp( argv[ i ], "-poster" ) == 0 )
+    {
+      posterPath = argv[ i + 1 ];
+    }
+    if( strcmp( argv[ i ], "-client" ) == 0 )
+    {
+      clientAddress = argv[ i + 1 ];
+    }
+    if( strcmp( argv[ i ], "-scene" ) == 0 )
+    {
+      sceneName = argv[ i + 1 ];
+    }
+    if( strcmp( argv[ i ], "-jobs" ) == 0 )
+    {
+      sscanf( argv[ i + 1 ], "%d", &jobsNbr );
+    }
+    if( strcmp( argv[ i ], "-generate" ) == 0 && i + 3 < argc )
+    {
+      generatedKind = argv[ i + 1 ];
+      sscanf( argv[ i + 2 ], "%d", &generatedObjectsNbr );
+      sscanf( argv[ i + 3 ], "%d", &generatedLightsNbr );
+    }
+    if( strcmp( argv[ i ], "-seed" ) == 0 )
+    {
+      sscanf( argv[ i + 1 ], "%u", &sceneSeed );
+    }
+    if( strcmp( argv[ i ], "-scaling" ) == 0 )
+    {
+      sscanf( argv[ i + 1 ], "%d", &scalingFrames );
+    }
+    if( strcmp( argv[ i ], "-targets" ) == 0 )
+    {
+      sscanf( argv[ i + 1 ], "%d", &traceTargetsNbr );
+    }
+    if( strcmp( argv[ i ], "-orderbench" ) == 0 )
+    {
+      sscanf( argv[ i + 1 ], "%d", &orderBenchFrames );
+    }
+  }
+  for( i = 1; i < argc; i++ )
+  {
+    if( strcmp( argv[ i ], "-spawn" ) == 0 )
+    {
+      spawnWorkers = true;
+    }
+    if( strcmp( argv[ i ], "-speedup" ) == 0 )
+    {
+      speedupSweep = true;
+    }
+    if( strcmp( argv[ i ], "-raystats" ) == 0 )
+    {
+      rayStats = true;
+    }
+    if( strcmp( argv[ i ], "-heatmap" ) == 0 )
+    {
+      heatmap = true;
+    }
+    if( strcmp( argv[ i ], "-cpucompare" ) == 0 )
+    {
+      cpuCompare = true;
+    }
+    if( strcmp( argv[ i ], "-bake" ) == 0 )
+    {
+      bakeScene = true;
+    }
+    if( strcmp( argv[ i ], "-tune" ) == 0 )
+    {
+      tuneGroups = true;
+    }
+    if( strcmp( argv[ i ], "-morton" ) == 0 )
+    {
+      mortonOrder = true;
+    }
+    if( strcmp( argv[ i ], "-progressive" ) == 0 )
+    {
+      progressive = true;
+      progressiveStride = PROGRESSIVE_STRIDE;
+    }
+  }
+
+  validateOptions( width, height, depth, tileSize, posterPath != NULL, cpuCompare, workersNbr, jobsNbr );
+
+  if( generatedKind )
+  {
+	  if( !generateScene( generatedKind, generatedObjectsNbr, generatedLightsNbr, sceneSeed, scene ) )
+	  {
+		  error_callback(1, "RayTracer: Error, unknown scene kind, use spheres, clusters, city or cornell.\n" );
+	  }
+	  fprintf(stdout, "Generated %s scene: %d objects, %d lights, seed %u\n", generatedKind, generatedObjectsNbr, generatedLightsNbr, sceneSeed);
+  }
+  else
+	  buildDefaultScene();
+
+  //Distributed still: the coordinator only hands out the tiles, the workers render them
+  if( coordinatorAddress )
+  {
+	  RenderSetup setup = {};
+	  setup.width = width;
+	  setup.height = height;
+	  setup.depth = depth;
+	  setup.tileSize = tileSize;
+	  for( int c = 0; c < 3; c++ )
+	  {
+		  setup.eye[ c ] = eye[ c ];
+		  setup.focus[ c ] = focus[ c ];
+	  }
+	  setup.hfov = hfov;
+	  setup.dnear = dnear;
+	  setup.dfar = dfar;
+
+	  std::string spawnCommand = std::string( "\"" ) + argv[ 0 ] + "\" -worker " + coordinatorAddress;
+	  //The sweep starts its own workers, each count on a fresh set
+	  if( speedupSweep )
+	  {
+		  return runSpeedupSweep( coordinatorAddress, workersNbr, spawnCommand.c_str(), setup, scene, outputPath ) ? 1 : -1;
+	  }
+	  bool rendered = runCoordinator( coordinatorAddress, workersNbr, spawnWorkers ? spawnCommand.c_str() : NULL,
+		  setup, scene, outputPath );
+	  return rendered ? 1 : -1;
+  }
+
+  //Render server client: the server renders, the built-in scene is uploaded under the scene name if needed
+  if( clientAddress )
+  {
+	  RenderJob job = {};
+	  strncpy( job.scene, sceneName, SCENE_NAME_SIZE - 1 );
+	  job.width = width;
+	  job.height = height;
+	  job.depth = depth;
+	  for( int c = 0; c < 3; c++ )
+	  {
+		  job.eye[ c ] = eye[ c ];
+		  job.focus[ c ] = focus[ c ];
+	  }
+	  job.hfov = hfov;
+	  return runClient( clientAddress, job, scene, jobsNbr, outputPath ) ? 1 : -1;
+  }
+
+  //Poster: the image is never held in memory, only one tile of it at a time
+  if( posterPath )
+  {
+	  hiddenWindow = true;
+	  if( !setGLVariables( tileSize, tileSize ) )
+	  {
+		  error_callback(1, "Could not init!\n");
+		  return -1;
+	  }
+	  projection = glm::perspective( (GLfloat)hfov, (GLfloat)width / (GLfloat)height, (GLfloat)dnear, (GLfloat)dfar );
+	  bool rendered = renderPoster( posterPath, width, height, depth, tileSize );
+	  glfwTerminate();
+	  return rendered ? 1 : -1;
+  }
+
+  //Preparing OpenGL environment
+  if (!setGLVariables(width, height))
+  {
+	  error_callback(1, "Could not init!\n");
+	  return -1;
+  }
+
+  //Before the other programs built from rayTraceCS, they take the tuned size
+  if (tuneGroups && !init_TuneGroups(width, height, depth))
+  {
+	  glfwTerminate();
+	  return -1;
+  }
+
+  //With -pathtrace the displayed frames are denoised, otherwise -denoise benchmarks the denoiser
+  denoisePaths = pathTrace && denoiseSamples > 0;
+  if ((pathTrace || denoiseSamples > 0) && (!init_PathTrace(width, height) || !init_Denoiser()))
+  {
+	  glfwTerminate();
+	  return -1;
+  }
+
+  if (rayStats && !init_RayStats())
+  {
+	  glfwTerminate();
+	  return -1;
+  }
+
+  if (bakeScene && !init_BakedScene(width, height, depth))
+  {
+	  glfwTerminate();
+	  return -1;
+  }
+
+  if (cpuCompare)
+  {
+	  bool match = compareCpuTrace(width, height, depth);
+	  glfwTerminate();
+	  return match ? 1 : -1;
+  }
+
+  if (orderBenchFrames > 0)
+  {
+	  benchmarkTraversal(width, height, depth, orderBenchFrames);
+	  glfwTerminate();
+	  return 1;
+  }
+
+  if (reflectionScale > 1)
+	  reportReflectionError(width, height, depth);
+
+  if (viewsNbr > 0)
+  {
+	  if (init_MultiView())
+		  benchmarkViews(width, height, depth, viewsNbr);
+	  glfwTerminate();
+	  return 1;
+  }
+
+  if (denoiseSamples > 0 && !pathTrace)
+  {
+	  benchmarkDenoiser(width, height, depth, denoiseSamples);
+	  glfwTerminate();
+	  return 1;
+  }
+
+  if (scalingFrames > 0)
+  {
+	  benchmarkScaling(width, height, depth, scalingFrames);
+	  glfwTerminate();
+	  return 1;
+  }
+
+  if (benchFrames > 0)
+  {
+	  benchmark(width, height, depth, benchFrames);
+	  glfwTerminate();
+	  return 1;
+  }
+
+  //Rendering
+  glfwSetInputMode(glContext, GLFW_STICKY_KEYS, GL_TRUE);
+  if (targetFrameMs > 0.0 || progressive || pathTrace || rayStats)
+	  frameTimer.init();
+  //Drivers may compile the shaders on their first dispatch, keep that out of the time of the first preview and the ray rate
+  if (progressive || pathTrace || rayStats)
+  {
+	  render(width, height, depth, regionOfInterest);
+	  glFinish();
+	  progressiveStride = PROGRESSIVE_STRIDE;
+	  if (pathTrace)
+		  resetAccumulation();
+	  if (rayStats)
+	  {
+		  readRayStats();
+		  resetRayStats();
+	  }
+  }
+  int loopFrames = 0;
+  if (profileFrames > 0)
+	  profile_Start(profileFrames);
+
+  while (glfwGetKey(glContext, GLFW_KEY_ESCAPE) != GLFW_PRESS && glfwWindowShouldClose(glContext) == 0)
+  {
+	  arena_Frame().reset();
+	  long long allocations = heap_AllocationCount();
+
+	  //A converged image is final, sleep until the user does something
+	  if (pathConverged && orbitStep == 0.0 && !profile_Capturing())
+		  glfwWaitEvents();
+	  else
+		  glfwPollEvents();
+	  if (glfwGetKey(glContext, GLFW_KEY_P) == GLFW_PRESS && !profile_Capturing())
+		  profile_Start(profileFrames > 0 ? profileFrames : PROFILE_KEY_FRAMES);
+
+	  //Orbit around the focus
+	  double azimuth = glm::radians(orbitStep), elevation = 0.0;
+	  if (glfwGetKey(glContext, GLFW_KEY_LEFT) == GLFW_PRESS) azimuth -= 0.02;
+	  if (glfwGetKey(glContext, GLFW_KEY_RIGHT) == GLFW_PRESS) azimuth += 0.02;
+	  if (glfwGetKey(glContext, GLFW_KEY_DOWN) == GLFW_PRESS) elevation -= 0.02;
+	  if (glfwGetKey(glContext, GLFW_KEY_UP) == GLFW_PRESS) elevation += 0.02;
+	  orbitCamera(azimuth, elevation);
+
+	  //The preview starts over whenever the camera moves
+	  if (progressive && (azimuth != 0.0 || elevation != 0.0))
+		  progressiveStride = PROGRESSIVE_STRIDE;
+	  if (pathTrace && (azimuth != 0.0 || elevation != 0.0))
+		  resetAccumulation();
+
+	  bool timed = targetFrameMs > 0.0 || (progressive && progressiveStride > 0) || (pathTrace && !pathConverged) || rayStats;
+	  //Tagged with the stride of the pass, the render moves on to the next one
+	  int stride = progressiveStride;
+	  if (timed)
+		  frameTimer.begin();
+	  render(width, height, depth, regionOfInterest);
+	  if (timed)
+		  frameTimer.end(stride);
+	  double frameMs;
+	  int timedStride;
+	  while (frameTimer.fetch(frameMs, &timedStride))
+	  {
+		  if (progressive)
+			  reportProgressive(timedStride, frameMs);
+		  else if (pathTrace)
+			  pathGpuMs += frameMs;
+		  else if (targetFrameMs > 0.0)
+			  governResolution(frameMs);
+		  statsGpuMs += frameMs;
+	  }
+	  if (rayStats)
+	  {
+		  readRayStats();
+		  if (statsFrames == RAY_STATS_FRAMES)
+			  reportRayStats();
+	  }
+	  if (pathTrace && !pathConverged && pathFrames % PATH_CHECK_FRAMES == 0)
+		  checkConvergence();
+	  {
+		  PROFILE_ZONE("swapBuffers");
+		  glfwSwapBuffers(glContext);
+	  }
+	  if (profile_FrameEnd())
+		  profile_Write(profilePath);
+
+	  if (temporalRefresh > 0 && frameIndex % 100 == 0)
+		  fprintf(stdout, "Temporal cache: %.1f%% of the pixels shaded from scratch\n", 100.0 * readTracedFraction());
+
+	  //Debug builds check that the frames past the warm up do not allocate
+	  loopFrames++;
+	  if (allocations >= 0 && loopFrames > ALLOCATION_WARMUP_FRAMES && heap_AllocationCount() > allocations)
+		  fprintf(stdout, "Frame %d: %lld heap allocations\n", loopFrames, heap_AllocationCount() - allocations);
   }
 
 
@@ -0,0 +1,299 @@
+#include "RenderGraph.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+//Barrier making shader writes visible to an access
+static GLbitfield barrierBit(RenderAccess access)
+{
+	switch (access)
+	{
+	case RENDER_IMAGE: return GL_SHADER_IMAGE_ACCESS_BARRIER_BIT;
+	case RENDER_SAMPLED: return GL_TEXTURE_FETCH_BARRIER_BIT;
+	case RENDER_STORAGE: return GL_SHADER_STORAGE_BARRIER_BIT;
+	case RENDER_ATTACHMENT: return GL_FRAMEBUFFER_BARRIER_BIT;
+	case RENDER_COPY: return GL_TEXTURE_UPDATE_BARRIER_BIT;
+	}
+	return GL_ALL_BARRIER_BITS;
+}
+
+static size_t texelBytes(GLenum format)
+{
+	switch (format)
+	{
+	case GL_RGBA32F: return 16;
+	case GL_RGBA16F: return 8;
+	case GL_R32F: case GL_R32UI: case GL_RGBA8: return 4;
+	}
+	return 16;
+}
+
+void RenderGraph::reset()
+{
+	_resources.clear();
+	_accesses.clear();
+	_passes.clear();
+}
+
+int RenderGraph::importTexture(const char* name, GLuint texture, int width, int height, GLenum format)
+{
+	_resources.push_back({ name, texture, width, height, format, false, -1, -1, -1, true, 0 });
+	return (int)_resources.size() - 1;
+}
+
+int RenderGraph::importBuffer(const char* name, GLuint buffer)
+{
+	_resources.push_back({ name, buffer, 0, 0, GL_NONE, false, -1, -1, -1, true, 0 });
+	return (int)_resources.size() - 1;
+}
+
+int RenderGraph::createTexture(const char* name, int width, int height, GLenum format)
+{
+	_resources.push_back({ name, 0, width, height, format, true, -1, -1, -1, false, 0 });
+	return (int)_resources.size() - 1;
+}
+
+int RenderGraph::addPass(const char* name, void (*fn)(void* data), void* data)
+{
+	_passes.push_back({ name, fn, data, 0 });
+	return (int)_passes.size() - 1;
+}
+
+bool RenderGraph::checkAccess(int pass, int resource) const
+{
+	if (pass < 0 || pass >= (int)_passes.size() || resource < 0 || resource >= (int)_resources.size())
+	{
+		fprintf(stderr, "RenderGraph: access of pass %d to resource %d ignored, neither was added to the graph\n", pass, resource);
+		return false;
+	}
+	return true;
+}
+
+void RenderGraph::read(int pass, int resource, RenderAccess access)
+{
+	if (checkAccess(pass, resource))
+		_accesses.push_back({ pass, resource, access, false });
+}
+
+void RenderGraph::write(int pass, int resource, RenderAccess access)
+{
+	if (checkAccess(pass, resource))
+		_accesses.push_back({ pass, resource, access, true });
+}
+
+GLuint RenderGraph::texture(int resource) const
+{
+	const Resource & r = _resources[resource];
+	return r.transient ? (r.physical >= 0 ? _pool[r.physical].texture : 0) : r.object;
+}
+
+//Lifetimes span from the first to the last pass accessing the resource. The transient textures take, in the order
+//they are first used, a texture of the pool with their size and format that no live resource holds
+void RenderGraph::allocateTransients()
+{
+	for (size_t a = 0; a < _accesses.size(); a++)
+	{
+		Resource & r = _resources[_accesses[a].resource];
+		r.firstPass = r.firstPass < 0 ? _accesses[a].pass : std::min(r.firstPass, _accesses[a].pass);
+		r.lastPass = std::max(r.lastPass, _accesses[a].pass);
+	}
+	for (size_t p = 0; p < _pool.size(); p++)
+	{
+		_pool[p].busyUntil = -1;
+		_pool[p].used = false;
+	}
+
+	size_t bytes = 0, unaliasedBytes = 0, importedBytes = 0;
+	for (int pass = 0; pass < (int)_passes.size(); pass++)
+		for (size_t i = 0; i < _resources.size(); i++)
+		{
+			Resource & r = _resources[i];
+			if (r.firstPass != pass)
+				continue;
+			size_t size = (size_t)r.width * r.height * texelBytes(r.format);
+			if (!r.transient)
+			{
+				importedBytes += size;
+				continue;
+			}
+			unaliasedBytes += size;
+
+			r.physical = -1;
+			for (size_t p = 0; p < _pool.size() && r.physical < 0; p++)
+				if (_pool[p].busyUntil < pass && _pool[p].width == r.width && _pool[p].height == r.height && _pool[p].format == r.format)
+					r.physical = (int)p;
+			if (r.physical < 0)
+			{
+				Physical physical = { 0, r.width, r.height, r.format, -1, false };
+				glGenTextures(1, &physical.texture);
+				glBindTexture(GL_TEXTURE_2D, physical.texture);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+				glTexStorage2D(GL_TEXTURE_2D, 1, r.format, r.width, r.height);
+				glBindTexture(GL_TEXTURE_2D, 0);
+				_pool.push_back(physical);
+				r.physical = (int)_pool.size() - 1;
+			}
+			if (!_pool[r.physical].used)
+				bytes += size;
+			_pool[r.physical].busyUntil = r.lastPass;
+			_pool[r.physical].used = true;
+		}
+
+	//Textures left from another resolution or mode
+	for (size_t p = _pool.size(); p-- > 0;)
+		if (!_pool[p].used)
+		{
+			glDeleteTextures(1, &_pool[p].texture);
+			_pool[p] = _pool.back();
+			_pool.pop_back();
+			for (size_t i = 0; i < _resources.size(); i++)
+				if (_resources[i].physical == (int)_pool.size())
+					_resources[i].physical = (int)p;
+		}
+
+	_peakBytes = std::max(_peakBytes, bytes);
+	_peakUnaliasedBytes = std::max(_peakUnaliasedBytes, unaliasedBytes);
+	_peakImportedBytes = std::max(_peakImportedBytes, importedBytes);
+}
+
+//glMemoryBarrier covers every resource: a pass only gets the bits of its accesses to resources with pending
+//writes that the barriers since did not cover. Writes count as well as reads, image stores after image stores
+//and rendering to a texture written with image stores are not ordered either
+void RenderGraph::placeBarriers()
+{
+	for (int pass = 0; pass < (int)_passes.size(); pass++)
+	{
+		GLbitfield bits = 0;
+		for (size_t a = 0; a < _accesses.size(); a++)
+		{
+			const Access & access = _accesses[a];
+			const Resource & r = _resources[access.resource];
+			if (access.pass == pass && r.pending && !(r.visibleBits & barrierBit(access.access)))
+				bits |= barrierBit(access.access);
+		}
+		_passes[pass].barrierBits = bits;
+		for (size_t i = 0; i < _resources.size(); i++)
+			if (_resources[i].pending)
+				_resources[i].visibleBits |= bits;
+
+		for (size_t a = 0; a < _accesses.size(); a++)
+		{
+			const Access & access = _accesses[a];
+			if (access.pass != pass || !access.write)
+				continue;
+			Resource & r = _resources[access.resource];
+			r.pending = access.access == RENDER_IMAGE || access.access == RENDER_STORAGE;
+			r.visibleBits = 0;
+		}
+	}
+}
+
+void RenderGraph::execute()
+{
+	allocateTransients();
+	placeBarriers();
+
+	int slot = _frame % RENDER_GRAPH_LATENCY;
+	if (_timing)
+		collectTimings(slot, true);
+	for (int pass = 0; pass < (int)_passes.size(); pass++)
+	{
+		const Pass & p = _passes[pass];
+		bool timed = _timing && pass < RENDER_GRAPH_TIMED_PASSES;
+		if (p.barrierBits)
+			glMemoryBarrier(p.barrierBits);
+		if (timed)
+			glQueryCounter(_queries[slot][2 * pass], GL_TIMESTAMP);
+		p.fn(p.data);
+		if (timed)
+		{
+			glQueryCounter(_queries[slot][2 * pass + 1], GL_TIMESTAMP);
+			_queryNames[slot][pass] = p.name;
+			_queryBarriers[slot][pass] = p.barrierBits;
+		}
+	}
+	if (_timing)
+	{
+		_queryCounts[slot] = std::min((int)_passes.size(), RENDER_GRAPH_TIMED_PASSES);
+		_timedFrames++;
+	}
+	_frame++;
+}
+
+//Adds the times of the passes of a frame slot to the totals
+void RenderGraph::collectTimings(int slot, bool wait)
+{
+	for (int pass = 0; pass < _queryCounts[slot]; pass++)
+	{
+		GLuint64 beginNs = 0, endNs = 0;
+		if (!wait)
+		{
+			GLint available = 0;
+			glGetQueryObjectiv(_queries[slot][2 * pass + 1], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available)
+				return;
+		}
+		glGetQueryObjectui64v(_queries[slot][2 * pass], GL_QUERY_RESULT, &beginNs);
+		glGetQueryObjectui64v(_queries[slot][2 * pass + 1], GL_QUERY_RESULT, &endNs);
+
+		const char* name = _queryNames[slot][pass];
+		size_t t = 0;
+		while (t < _totals.size() && strcmp(_totals[t].name, name) != 0)
+			t++;
+		if (t == _totals.size())
+			_totals.push_back({ name, 0, 0.0, 0 });
+		_totals[t].barrierBits |= _queryBarriers[slot][pass];
+		_totals[t].totalMs += (endNs - beginNs) * 1e-6;
+		_totals[t].calls++;
+	}
+	_queryCounts[slot] = 0;
+}
+
+void RenderGraph::startTiming()
+{
+	if (!_queries[0][0])
+		glGenQueries(RENDER_GRAPH_LATENCY * 2 * RENDER_GRAPH_TIMED_PASSES, &_queries[0][0]);
+	for (int slot = 0; slot < RENDER_GRAPH_LATENCY; slot++)
+		_queryCounts[slot] = 0;
+	_totals.clear();
+	_timedFrames = 0;
+	_peakBytes = _peakUnaliasedBytes = _peakImportedBytes = 0;
+	_timing = true;
+}
+
+void RenderGraph::report()
+{
+	for (int slot = 0; slot < RENDER_GRAPH_LATENCY; slot++)
+		collectTimings(slot, true);
+	_timing = false;
+
+	int frames = std::max(_timedFrames, 1);
+	fprintf(stdout, "Render graph over %d frames:\n", _timedFrames);
+	for (size_t t = 0; t < _totals.size(); t++)
+	{
+		GLbitfield bits = _totals[t].barrierBits;
+		char barriers[96] = "";
+		if (bits & GL_SHADER_IMAGE_ACCESS_BARRIER_BIT) strcat(barriers, " image");
+		if (bits & GL_TEXTURE_FETCH_BARRIER_BIT) strcat(barriers, " fetch");
+		if (bits & GL_SHADER_STORAGE_BARRIER_BIT) strcat(barriers, " storage");
+		if (bits & GL_FRAMEBUFFER_BARRIER_BIT) strcat(barriers, " framebuffer");
+		if (bits & GL_TEXTURE_UPDATE_BARRIER_BIT) strcat(barriers, " update");
+		fprintf(stdout, "  %-12s %9.3f ms per frame, %d per frame, barrier:%s\n", _totals[t].name, _totals[t].totalMs / frames,
+			_totals[t].calls / frames, bits ? barriers : " none");
+	}
+	fprintf(stdout, "  Peak memory: %.2f MB of transient textures (%.2f MB without aliasing), %.2f MB imported\n",
+		_peakBytes / 1048576.0, _peakUnaliasedBytes / 1048576.0, _peakImportedBytes / 1048576.0);
+}
+
+void RenderGraph::release()
+{
+	for (size_t p = 0; p < _pool.size(); p++)
+		glDeleteTextures(1, &_pool[p].texture);
+	_pool.clear();
+	if (_queries[0][0])
+		glDeleteQueries(RENDER_GRAPH_LATENCY * 2 * RENDER_GRAPH_TIMED_PASSES, &_queries[0][0]);
+	_queries[0][0] = 0;
+	reset();
+}
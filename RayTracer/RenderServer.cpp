@@ -0,0 +1,340 @@
+#include "RenderServer.h"
+#include "RayTracer.h"
+#include "Distributed.h"
+#include "Utils.h"
+#include "JobSystem.h"
+#include "Arena.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <list>
+#include <string>
+#include <vector>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+//*** Distributed rendering **************************************************************************
+
+//Converts the width x height region at the origin of the trace texture to RGB8, bottom row first, false if the texture is not textureWidth x textureHeight
+static bool readTraceRGB8(int width, int height, int textureWidth, int textureHeight, unsigned char* rgb)
+{
+	float* texels = arena_Frame().allocArray<float>((size_t)textureWidth * textureHeight * 4);
+	if (!read_Texture(texture, textureWidth, textureHeight, texels))
+		return false;
+	jobs_ParallelFor(0, height, 16, [&](int rowBegin, int rowEnd)
+	{
+		for (int y = rowBegin; y < rowEnd; y++)
+		{
+			unsigned char* dst = rgb + (size_t)y * width * 3;
+			for (int x = 0; x < width; x++)
+				for (int c = 0; c < 3; c++)
+				{
+					float value = texels[((size_t)y * textureWidth + x) * 4 + c];
+					*dst++ = (unsigned char)(glm::clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f);
+				}
+		}
+	});
+	return true;
+}
+
+//A tile of at most tileSize x tileSize pixels inside the frame, anything else would read past the trace texture
+static bool validTile(const TileJob & tile, const RenderSetup & setup)
+{
+	return tile.width > 0 && tile.height > 0 && tile.width <= setup.tileSize && tile.height <= setup.tileSize &&
+		tile.x >= 0 && tile.y >= 0 && tile.x <= setup.width - tile.width && tile.y <= setup.height - tile.height;
+}
+
+//Connect to a coordinator and render the tiles it hands out until the frame is complete
+int runWorker(const char* address)
+{
+	if (!net_Init())
+		return -1;
+	NetSocket socket = net_Connect(address);
+	if (socket == INVALID_NET_SOCKET)
+	{
+		net_Shutdown();
+		return -1;
+	}
+
+	uint32_t type;
+	std::vector<char> payload;
+	RenderSetup setup;
+	if (!net_RecvMessage(socket, type, payload) || type != MSG_SETUP || !decodeSetup(payload, setup, scene) ||
+		setup.width <= 0 || setup.height <= 0 || setup.tileSize < 16 || setup.tileSize > 4096)
+	{
+		fprintf(stderr, "Worker: invalid setup received from %s\n", address);
+		net_Close(socket);
+		net_Shutdown();
+		return -1;
+	}
+	for (int c = 0; c < 3; c++)
+	{
+		eye[c] = setup.eye[c];
+		focus[c] = setup.focus[c];
+	}
+	hfov = setup.hfov;
+	dnear = setup.dnear;
+	dfar = setup.dfar;
+
+	//The images hold one tile, the rays are shot through the whole frame
+	hiddenWindow = true;
+	if (!setGLVariables(setup.tileSize, setup.tileSize))
+	{
+		error_callback(1, "Could not init!\n");
+		net_Close(socket);
+		net_Shutdown();
+		return -1;
+	}
+	projection = glm::perspective((GLfloat)hfov, (GLfloat)setup.width / (GLfloat)setup.height, (GLfloat)dnear, (GLfloat)dfar);
+
+	std::vector<char> result;
+	int tilesRendered = 0;
+	while (net_RecvMessage(socket, type, payload) && type == MSG_TILE && payload.size() == sizeof(TileJob))
+	{
+		arena_Frame().reset();
+		TileJob tile;
+		memcpy(&tile, payload.data(), sizeof(TileJob));
+		if (!validTile(tile, setup))
+		{
+			fprintf(stderr, "Worker: invalid tile %dx%d at %d, %d received from %s\n", tile.width, tile.height, tile.x, tile.y, address);
+			break;
+		}
+		traceRegion(setup.width, setup.height, tile.x, tile.y, tile.width, tile.height, setup.depth);
+		result.resize(sizeof(TileJob) + (size_t)tile.width * tile.height * 3);
+		memcpy(result.data(), &tile, sizeof(TileJob));
+		if (!readTraceRGB8(tile.width, tile.height, setup.tileSize, setup.tileSize, (unsigned char*)result.data() + sizeof(TileJob)))
+			break;
+
+		if (!net_SendMessage(socket, MSG_RESULT, result.data(), result.size()))
+			break;
+		tilesRendered++;
+	}
+	fprintf(stdout, "Worker: %d tiles rendered\n", tilesRendered);
+
+	net_Close(socket);
+	net_Shutdown();
+	glfwTerminate();
+	return 1;
+}
+
+//*** Render server **********************************************************************************
+
+//Scenes resident on the GPU, most recently used first
+struct CachedScene
+{
+	std::string name;
+	GLuint buffer;
+};
+static std::list<CachedScene> sceneCache;
+static int sceneCacheSize;
+
+//Size of the trace targets, they grow to the largest job
+static int targetWidth, targetHeight;
+
+//The clients are read as their data arrives and never stall each other on a receive. Replies are sent whole, a
+//client that does not take its reply for this long is dropped
+#define SERVER_CLIENT_TIMEOUT_MS 5000
+
+//Bytes received from a client that do not make a complete message yet
+struct ServerClient
+{
+	NetSocket socket;
+	std::vector<char> received;
+};
+
+//Moves the scene to the front of the cache, outputs 0 if it is not resident
+static GLuint findScene(const std::string & name)
+{
+	for (std::list<CachedScene>::iterator it = sceneCache.begin(); it != sceneCache.end(); ++it)
+		if (it->name == name)
+		{
+			sceneCache.splice(sceneCache.begin(), sceneCache, it);
+			return sceneCache.front().buffer;
+		}
+	return 0;
+}
+
+//Uploads the scene under the name, evicting the least recently used scene when the cache is full
+static void cacheScene(const std::string & name, const Scene & sceneData)
+{
+	GLuint buffer = findScene(name);
+	if (!buffer)
+	{
+		if ((int)sceneCache.size() >= sceneCacheSize)
+		{
+			fprintf(stdout, "Evicting scene %s\n", sceneCache.back().name.c_str());
+			glDeleteBuffers(1, &sceneCache.back().buffer);
+			sceneCache.pop_back();
+		}
+		glGenBuffers(1, &buffer);
+		sceneCache.push_front({ name, buffer });
+	}
+	uploadScene(sceneData, buffer);
+}
+
+//Grow the trace targets and the tile lists to hold a width x height frame. The server traces with the default
+//options, there is no G-buffer, reflection, history or accumulation texture to grow
+static void resizeTraceTargets(int width, int height)
+{
+	if (width <= targetWidth && height <= targetHeight)
+		return;
+	targetWidth = std::max(width, targetWidth);
+	targetHeight = std::max(height, targetHeight);
+
+	for (int t = 0; t < traceTargetsNbr; t++)
+	{
+		glBindTexture(GL_TEXTURE_2D, traceTargets[t]);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, targetWidth, targetHeight, 0, GL_RGBA, GL_FLOAT, NULL);
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	int tilesNbr = ((targetWidth + CULL_TILE_SIZE - 1) / CULL_TILE_SIZE) * ((targetHeight + CULL_TILE_SIZE - 1) / CULL_TILE_SIZE);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, tileBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, tilesNbr * (TILE_OBJECTS_MAX_NBR + 1) * sizeof(GLint), NULL, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+//Renders the job with the warm programs and the resident scene, and sends the image back
+static bool serveJob(NetSocket client, const std::vector<char> & payload)
+{
+	arena_Frame().reset();
+	RenderJob job;
+	if (payload.size() != sizeof(RenderJob))
+		return false;
+	memcpy(&job, payload.data(), sizeof(RenderJob));
+	job.scene[SCENE_NAME_SIZE - 1] = '\0';
+
+	//The image is sent back in one message
+	if (job.width <= 0 || job.height <= 0 || job.width > 16384 || job.height > 16384 ||
+		sizeof(ImageHeader) + (size_t)job.width * job.height * 3 > NET_MAX_PAYLOAD)
+	{
+		std::string error = "invalid image dimensions";
+		return net_SendMessage(client, MSG_ERROR, error.data(), error.size());
+	}
+
+	GLuint buffer = findScene(job.scene);
+	if (!buffer && strcmp(job.scene, "default") == 0)
+	{
+		buildDefaultScene();
+		cacheScene(job.scene, scene);
+		buffer = findScene(job.scene);
+	}
+	if (!buffer)
+	{
+		std::string error = std::string("unknown scene ") + job.scene;
+		return net_SendMessage(client, MSG_ERROR, error.data(), error.size());
+	}
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int c = 0; c < 3; c++)
+	{
+		eye[c] = job.eye[c];
+		focus[c] = job.focus[c];
+	}
+	hfov = job.hfov;
+	view = glm::lookAt(glm::vec3(eye[0], eye[1], eye[2]), glm::vec3(focus[0], focus[1], focus[2]), glm::vec3(0.0f, 0.0f, 1.0f));
+	projection = glm::perspective((GLfloat)hfov, (GLfloat)job.width / (GLfloat)job.height, (GLfloat)dnear, (GLfloat)dfar);
+
+	resizeTraceTargets(job.width, job.height);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, buffer);
+	traceRegion(job.width, job.height, 0, 0, job.width, job.height, glm::clamp(job.depth, 0, 100));
+
+	size_t replySize = sizeof(ImageHeader) + (size_t)job.width * job.height * 3;
+	char* reply = arena_Frame().allocArray<char>(replySize);
+	if (!readTraceRGB8(job.width, job.height, targetWidth, targetHeight, (unsigned char*)reply + sizeof(ImageHeader)))
+		return false;
+
+	ImageHeader header = { job.width, job.height, 0.0f };
+	header.renderMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+	memcpy(reply, &header, sizeof(ImageHeader));
+	fprintf(stdout, "Scene %s %dx%d depth %d: %.2f ms\n", job.scene, job.width, job.height, job.depth, header.renderMs);
+
+	return net_SendMessage(client, MSG_IMAGE, reply, replySize);
+}
+
+//Handles a message of a client, false drops the client
+static bool serveMessage(NetSocket client, uint32_t type, const std::vector<char> & payload)
+{
+	if (type == MSG_RENDER)
+		return serveJob(client, payload);
+
+	if (type == MSG_SCENE)
+	{
+		Scene uploaded;
+		if (payload.size() < SCENE_NAME_SIZE ||
+			!deserializeScene(payload.data() + SCENE_NAME_SIZE, payload.size() - SCENE_NAME_SIZE, uploaded))
+			return false;
+		std::string name(payload.data(), strnlen(payload.data(), SCENE_NAME_SIZE));
+		if (uploaded.lights.size() > LIGHTS_MAX_NBR)
+			fprintf(stderr, "Scene %s has more than %d lights, only the first ones are used\n", name.c_str(), LIGHTS_MAX_NBR);
+		cacheScene(name, uploaded);
+		fprintf(stdout, "Scene %s uploaded, %d objects\n", name.c_str(), (int)uploaded.objects.size());
+		return true;
+	}
+	return false;
+}
+
+//Keep the context, the programs and the scenes warm, and render the jobs of the clients connecting on the address
+int runServer(const char* address, int scenesNbr)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	hiddenWindow = true;
+	buildDefaultScene();
+	if (!setGLVariables(256, 256))
+	{
+		error_callback(1, "Could not init!\n");
+		return -1;
+	}
+	targetWidth = targetHeight = 256;
+	sceneCacheSize = std::max(scenesNbr, 1);
+	sceneCache.push_front({ "default", sceneBuffer });
+
+	if (!net_Init())
+		return -1;
+	NetSocket listener = net_Listen(address);
+	if (listener == INVALID_NET_SOCKET)
+	{
+		net_Shutdown();
+		return -1;
+	}
+	fprintf(stdout, "Render server listening on %s, ready in %.1f ms\n", address,
+		std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+
+	std::vector<ServerClient> clients;
+	std::vector<NetSocket> sockets;
+	std::vector<char> payload;
+	for (;;)
+	{
+		sockets.assign(1, listener);
+		for (size_t c = 0; c < clients.size(); c++)
+			sockets.push_back(clients[c].socket);
+		int ready = net_WaitReadable(sockets, 1000);
+		if (ready < 0)
+			continue;
+		if (ready == 0)
+		{
+			NetSocket client = net_Accept(listener);
+			if (client != INVALID_NET_SOCKET)
+			{
+				net_SetTimeout(client, SERVER_CLIENT_TIMEOUT_MS);
+				clients.push_back({ client, std::vector<char>() });
+			}
+			continue;
+		}
+
+		//Only what the client already sent is read, the jobs of its complete messages are served
+		ServerClient & client = clients[ready - 1];
+		bool connected = net_RecvAvailable(client.socket, client.received);
+		uint32_t type;
+		bool invalid = false;
+		while (connected && net_PopMessage(client.received, type, payload, invalid))
+			connected = serveMessage(client.socket, type, payload);
+		if (!connected || invalid)
+		{
+			net_Close(client.socket);
+			clients.erase(clients.begin() + (ready - 1));
+		}
+	}
+}
@@ -0,0 +1,246 @@
+#include "Scene.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+
+//Layout: objects count, lights count, emission, reflection, objects, lights
+void serializeScene(const Scene & scene, std::vector<char> & data)
+{
+	uint32_t counts[2] = { (uint32_t)scene.objects.size(), (uint32_t)scene.lights.size() };
+	size_t objectsSize = scene.objects.size() * sizeof(SceneObject);
+	size_t lightsSize = scene.lights.size() * sizeof(SceneLight);
+
+	data.resize(sizeof(counts) + 2 * sizeof(glm::vec4) + objectsSize + lightsSize);
+	char* out = data.data();
+	memcpy(out, counts, sizeof(counts));
+	out += sizeof(counts);
+	memcpy(out, &scene.emission, sizeof(glm::vec4));
+	out += sizeof(glm::vec4);
+	memcpy(out, &scene.reflection, sizeof(glm::vec4));
+	out += sizeof(glm::vec4);
+	if (objectsSize)
+		memcpy(out, scene.objects.data(), objectsSize);
+	out += objectsSize;
+	if (lightsSize)
+		memcpy(out, scene.lights.data(), lightsSize);
+}
+
+bool deserializeScene(const char* data, size_t size, Scene & scene)
+{
+	uint32_t counts[2];
+	size_t headerSize = sizeof(counts) + 2 * sizeof(glm::vec4);
+	if (size < headerSize)
+		return false;
+	memcpy(counts, data, sizeof(counts));
+
+	size_t objectsSize = (size_t)counts[0] * sizeof(SceneObject);
+	size_t lightsSize = (size_t)counts[1] * sizeof(SceneLight);
+	if (size != headerSize + objectsSize + lightsSize)
+		return false;
+
+	const char* in = data + sizeof(counts);
+	memcpy(&scene.emission, in, sizeof(glm::vec4));
+	in += sizeof(glm::vec4);
+	memcpy(&scene.reflection, in, sizeof(glm::vec4));
+	in += sizeof(glm::vec4);
+	scene.objects.resize(counts[0]);
+	scene.lights.resize(counts[1]);
+	if (objectsSize)
+		memcpy(scene.objects.data(), in, objectsSize);
+	in += objectsSize;
+	if (lightsSize)
+		memcpy(scene.lights.data(), in, lightsSize);
+	return true;
+}
+
+//*** Procedural scenes ******************************************************************************
+
+//Half width of the ground and height of the tallest objects, the extent of the default room
+#define GENERATED_HALF_SIZE 350.0f
+#define GENERATED_HEIGHT 300.0f
+
+//xorshift32, with no library distribution in the way so that the scenes are the same on every platform
+struct SceneRandom
+{
+	uint32_t state;
+
+	explicit SceneRandom(uint32_t seed) : state(seed * 2654435761u ^ 0x9E3779B9u)
+	{
+		if (state == 0)
+			state = 1;
+	}
+	//Uniform in [0, 1)
+	float next()
+	{
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return (state >> 8) * (1.0f / 16777216.0f);
+	}
+	float range(float low, float high)
+	{
+		return low + (high - low) * next();
+	}
+	glm::vec4 color()
+	{
+		//Saturated colors, one channel kept bright
+		glm::vec4 color(range(0.1f, 1.0f), range(0.1f, 1.0f), range(0.1f, 1.0f), 1.0f);
+		color[(int)(next() * 3.0f)] = 1.0f;
+		return color;
+	}
+};
+
+static SceneObject makeBox(glm::vec3 min, glm::vec3 max, glm::vec4 color)
+{
+	SceneObject box = {};
+	box.type = OBJECT_BOX;
+	box.min = min;
+	box.max = max;
+	box.color = color;
+	return box;
+}
+
+static SceneObject makeSphere(glm::vec3 pos, float r, glm::vec4 color)
+{
+	SceneObject sphere = {};
+	sphere.type = OBJECT_SPHERE;
+	sphere.pos = pos;
+	sphere.r = r;
+	sphere.color = color;
+	return sphere;
+}
+
+static void addFloor(Scene & scene)
+{
+	scene.objects.push_back(makeBox(glm::vec3(-GENERATED_HALF_SIZE, -GENERATED_HALF_SIZE, -10.0f),
+		glm::vec3(GENERATED_HALF_SIZE, GENERATED_HALF_SIZE, 0.0f), glm::vec4(0.5f, 0.5f, 0.5f, 1.0f)));
+}
+
+//Spheres of random sizes, their radius shrinks with the count to keep the fill ratio
+static void generateSpheres(int count, SceneRandom & random, Scene & scene)
+{
+	float radius = 0.5f * GENERATED_HALF_SIZE / cbrtf((float)std::max(count, 1));
+	float extent = GENERATED_HALF_SIZE - radius;
+	for (int i = 0; i < count; i++)
+	{
+		float r = radius * random.range(0.4f, 1.0f);
+		glm::vec3 pos(random.range(-extent, extent), random.range(-extent, extent), random.range(r, GENERATED_HEIGHT));
+		scene.objects.push_back(makeSphere(pos, r, random.color()));
+	}
+}
+
+//Boxes around a few centers, bell shaped falloff from the sum of random numbers
+static void generateClusters(int count, SceneRandom & random, Scene & scene)
+{
+	int clustersNbr = std::max(1, (int)sqrtf((float)count) / 2);
+	float spread = GENERATED_HALF_SIZE / sqrtf((float)clustersNbr);
+	float size = 0.6f * spread / cbrtf((float)count / clustersNbr + 1.0f);
+	std::vector<glm::vec3> centers(clustersNbr);
+	for (int c = 0; c < clustersNbr; c++)
+		centers[c] = glm::vec3(random.range(-GENERATED_HALF_SIZE + spread, GENERATED_HALF_SIZE - spread),
+			random.range(-GENERATED_HALF_SIZE + spread, GENERATED_HALF_SIZE - spread), random.range(spread, GENERATED_HEIGHT));
+	for (int i = 0; i < count; i++)
+	{
+		const glm::vec3 & center = centers[i % clustersNbr];
+		glm::vec3 offset;
+		for (int a = 0; a < 3; a++)
+			offset[a] = (random.next() + random.next() + random.next() - 1.5f) * spread;
+		glm::vec3 half(random.range(0.3f, 1.0f) * size, random.range(0.3f, 1.0f) * size, random.range(0.3f, 1.0f) * size);
+		glm::vec3 pos = center + offset;
+		pos.z = std::max(pos.z, half.z);
+		scene.objects.push_back(makeBox(pos - half, pos + half, random.color()));
+	}
+}
+
+//Square grid of buildings separated by streets, filled row by row
+static void generateCity(int count, SceneRandom & random, Scene & scene)
+{
+	int side = std::max(1, (int)ceilf(sqrtf((float)count)));
+	float cell = 2.0f * GENERATED_HALF_SIZE / side;
+	float street = 0.2f * cell;
+	for (int i = 0; i < count; i++)
+	{
+		glm::vec2 corner(-GENERATED_HALF_SIZE + (i % side) * cell, -GENERATED_HALF_SIZE + (i / side) * cell);
+		//Mostly low buildings and a few towers
+		float height = GENERATED_HEIGHT * (0.1f + 0.9f * powf(random.next(), 3.0f));
+		float grey = random.range(0.4f, 0.9f);
+		scene.objects.push_back(makeBox(glm::vec3(corner + 0.5f * street, 0.0f), glm::vec3(corner + cell - 0.5f * street, height),
+			glm::vec4(grey, grey, random.range(grey, 1.0f), 1.0f)));
+	}
+}
+
+//Floor, back wall and colored side walls, the camera looks through the missing front wall along -x.
+//The shadow rays are not bounded by the distance to the light, a ceiling would shadow the whole room
+static void generateCornell(int count, SceneRandom & random, Scene & scene)
+{
+	const float half = GENERATED_HALF_SIZE, height = GENERATED_HEIGHT, wall = 10.0f;
+	glm::vec4 white(0.8f, 0.8f, 0.8f, 1.0f);
+	SceneObject walls[4] = {
+		makeBox(glm::vec3(-half, -half, -wall), glm::vec3(half, half, 0.0f), white),
+		makeBox(glm::vec3(-half - wall, -half, 0.0f), glm::vec3(-half, half, height), white),
+		makeBox(glm::vec3(-half, -half - wall, 0.0f), glm::vec3(half, -half, height), glm::vec4(0.8f, 0.1f, 0.1f, 1.0f)),
+		makeBox(glm::vec3(-half, half, 0.0f), glm::vec3(half, half + wall, height), glm::vec4(0.1f, 0.8f, 0.1f, 1.0f)) };
+	int wallsNbr = std::min(count, 4);
+	scene.objects.insert(scene.objects.end(), walls, walls + wallsNbr);
+
+	//Alternating spheres and boxes standing on the floor
+	int contentsNbr = count - wallsNbr;
+	float size = 0.5f * half / sqrtf((float)std::max(contentsNbr, 1));
+	float extent = half - size;
+	for (int i = 0; i < contentsNbr; i++)
+	{
+		float s = size * random.range(0.5f, 1.0f);
+		glm::vec2 pos(random.range(-extent, extent), random.range(-extent, extent));
+		if (i % 2 == 0)
+			scene.objects.push_back(makeSphere(glm::vec3(pos, s), s, random.color()));
+		else
+			scene.objects.push_back(makeBox(glm::vec3(pos - s, 0.0f), glm::vec3(pos + s, 2.0f * s * random.range(0.5f, 2.0f)), random.color()));
+	}
+}
+
+bool generateScene(const char* kind, int objectsNbr, int lightsNbr, uint32_t seed, Scene & scene)
+{
+	bool cornell = strcmp(kind, "cornell") == 0;
+	if (!cornell && strcmp(kind, "spheres") != 0 && strcmp(kind, "clusters") != 0 && strcmp(kind, "city") != 0)
+		return false;
+
+	SceneRandom random(seed);
+	objectsNbr = std::max(objectsNbr, 1);
+	lightsNbr = std::max(lightsNbr, 1);
+	scene.objects.clear();
+	scene.lights.clear();
+	scene.objects.reserve(objectsNbr);
+	scene.emission = glm::vec4(0.1f, 0.1f, 0.1f, 1.0f);
+	scene.reflection = glm::vec4(0.3f, 0.3f, 0.3f, 1.0f);
+
+	//The floor counts as one of the objects
+	if (cornell)
+		generateCornell(objectsNbr, random, scene);
+	else
+	{
+		addFloor(scene);
+		if (strcmp(kind, "spheres") == 0)
+			generateSpheres(objectsNbr - 1, random, scene);
+		else if (strcmp(kind, "clusters") == 0)
+			generateClusters(objectsNbr - 1, random, scene);
+		else
+			generateCity(objectsNbr - 1, random, scene);
+	}
+
+	//Same total intensity as the default lights whatever their count, on a ring above the scene, right above
+	//the room for cornell
+	float intensity = 1.5f / lightsNbr;
+	for (int l = 0; l < lightsNbr; l++)
+	{
+		float angle = 6.2831853f * (l + random.next()) / lightsNbr;
+		float distance = random.range(0.2f, cornell ? 0.8f : 1.5f) * GENERATED_HALF_SIZE;
+		SceneLight light;
+		light.pos = glm::vec3(distance * cosf(angle), distance * sinf(angle),
+			random.range(600.0f, 800.0f));
+		light.color = glm::vec4(intensity, intensity, intensity, 1.0f);
+		scene.lights.push_back(light);
+	}
+	return true;
+}
@@ -1,38 +1,43 @@
 #include "ShaderClass.h"
 
 #include <stdio.h>
+#include <algorithm>
 #include <iostream>
 using namespace std;
 
 bool Shader::init(const char* vertexShader, const char* fragmentShader )
+{
+	if (fragmentShader == nullptr)
+		return init(std::vector<const char*>{ vertexShader }, std::vector<const char*>{});
+	return init(std::vector<const char*>{ vertexShader }, std::vector<const char*>{ fragmentShader });
+}
+bool Shader::init(const std::vector<const char*> & vertexShaderChunks, const std::vector<const char*> & fragmentShaderChunks)
 {
 
-	if (vertexShader == nullptr)
+	if (vertexShaderChunks.empty() || std::find(vertexShaderChunks.begin(), vertexShaderChunks.end(), nullptr) != vertexShaderChunks.end())
 	{
 		fprintf(stdout, "Null Vertex Shader Code\n");
 		return false;
 	}
 	// shader Program
 	_ID = glCreateProgram();
-
-	const char* vShaderCode = vertexShader;
+	_locations.clear();
 
 	// vertex shader
 	unsigned int vertex;
 	vertex = glCreateShader(GL_VERTEX_SHADER);
-	glShaderSource(vertex, 1, &vShaderCode, NULL);
+	glShaderSource(vertex, (GLsizei)vertexShaderChunks.size(), vertexShaderChunks.data(), NULL);
 	glCompileShader(vertex);
 	if (checkCompileErrors(vertex, "VERTEX"))
 		glAttachShader(_ID, vertex);
 	glDeleteShader(vertex);
 
 	//if fragment shader is given, compile geometry shader
-	if (fragmentShader != nullptr)
+	if (!fragmentShaderChunks.empty())
 	{
-		const char * fShaderCode = fragmentShader;
 		unsigned int fragment;
 		fragment = glCreateShader(GL_FRAGMENT_SHADER);
-		glShaderSource(fragment, 1, &fShaderCode, NULL);
+		glShaderSource(fragment, (GLsizei)fragmentShaderChunks.size(), fragmentShaderChunks.data(), NULL);
 		glCompileShader(fragment);
 		if (checkCompileErrors(fragment, "FRAGMENT"))
 			glAttachShader(_ID, fragment);
@@ -49,20 +54,25 @@ bool Shader::init(const char* vertexShader, const char* fragmentShader )
 	return true;
 }
 bool Shader::initComputeShader(const char* computeShader) {
-	if (computeShader == nullptr)
+	return initComputeShader(std::vector<const char*>{ computeShader });
+}
+bool Shader::initComputeShader(const std::vector<const char*> & computeShaderChunks) {
+	for (const char* chunk : computeShaderChunks)
 	{
-		fprintf(stdout, "Null Compute Shader Code\n");
-		return false;
+		if (chunk == nullptr)
+		{
+			fprintf(stdout, "Null Compute Shader Code\n");
+			return false;
+		}
 	}
 	// shader Program
 	_ID = glCreateProgram();
-
-	const char* cShaderCode = computeShader;
+	_locations.clear();
 
 	// compute shader
 	unsigned int computeS;
 	computeS = glCreateShader(GL_COMPUTE_SHADER);
-	glShaderSource(computeS, 1, &cShaderCode, NULL);
+	glShaderSource(computeS, (GLsizei)computeShaderChunks.size(), computeShaderChunks.data(), NULL);
 	glCompileShader(computeS);
 	if (checkCompileErrors(computeS, "COMPUTE"))
 		glAttachShader(_ID, computeS);
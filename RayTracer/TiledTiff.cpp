@@ -0,0 +1,179 @@
+#include "TiledTiff.h"
+
+//TIFF field types and tags
+#define TIFF_SHORT 3
+#define TIFF_LONG 4
+#define TIFF_LONG8 16
+
+#define TAG_IMAGE_WIDTH 256
+#define TAG_IMAGE_LENGTH 257
+#define TAG_BITS_PER_SAMPLE 258
+#define TAG_COMPRESSION 259
+#define TAG_PHOTOMETRIC 262
+#define TAG_SAMPLES_PER_PIXEL 277
+#define TAG_PLANAR_CONFIG 284
+#define TAG_TILE_WIDTH 322
+#define TAG_TILE_LENGTH 323
+#define TAG_TILE_OFFSETS 324
+#define TAG_TILE_BYTE_COUNTS 325
+
+//Little endian encoding, whatever the host
+static void putLE(std::vector<unsigned char> & out, uint64_t value, int bytes)
+{
+	for (int b = 0; b < bytes; b++)
+		out.push_back((unsigned char)(value >> (8 * b)));
+}
+
+static int typeSize(uint16_t type)
+{
+	return type == TIFF_SHORT ? 2 : type == TIFF_LONG ? 4 : 8;
+}
+
+TiledTiffWriter::~TiledTiffWriter()
+{
+	if (_file)
+		fclose(_file);
+}
+
+bool TiledTiffWriter::write(const void* data, size_t size)
+{
+	if (!_failed && fwrite(data, 1, size, _file) != size)
+		_failed = true;
+	_position += size;
+	return !_failed;
+}
+
+bool TiledTiffWriter::open(const char* path, int width, int height, int tileSize)
+{
+	_width = width;
+	_height = height;
+	_tileSize = tileSize;
+	_tilesX = (width + tileSize - 1) / tileSize;
+	_tilesY = (height + tileSize - 1) / tileSize;
+	_tileOffsets.assign((size_t)_tilesX * _tilesY, 0);
+	_failed = false;
+	_position = 0;
+
+	//Classic TIFF offsets are 32 bits, keep some room for the directory
+	uint64_t dataSize = (uint64_t)_tilesX * _tilesY * tileSize * tileSize * 3;
+	_bigTiff = dataSize + 16 * _tileOffsets.size() + 4096 > 0xFFFFFFFFull;
+
+	_file = fopen(path, "wb");
+	if (!_file)
+	{
+		fprintf(stderr, "Could not open %s for writing\n", path);
+		return false;
+	}
+
+	//The directory offset is patched by close()
+	std::vector<unsigned char> header = { 'I', 'I' };
+	if (_bigTiff)
+	{
+		putLE(header, 43, 2);
+		putLE(header, 8, 2);
+		putLE(header, 0, 2);
+		putLE(header, 0, 8);
+	}
+	else
+	{
+		putLE(header, 42, 2);
+		putLE(header, 0, 4);
+	}
+	return write(header.data(), header.size());
+}
+
+bool TiledTiffWriter::writeTile(int tileX, int tileY, const unsigned char* rgb)
+{
+	if (!_file || tileX < 0 || tileY < 0 || tileX >= _tilesX || tileY >= _tilesY)
+		return false;
+	_tileOffsets[(size_t)tileY * _tilesX + tileX] = _position;
+	return write(rgb, (size_t)_tileSize * _tileSize * 3);
+}
+
+void TiledTiffWriter::addEntry(uint16_t tag, uint16_t type, const std::vector<uint64_t> & values)
+{
+	Entry entry;
+	entry.tag = tag;
+	entry.type = type;
+	entry.count = values.size();
+	entry.offset = 0;
+	for (uint64_t value : values)
+		putLE(entry.data, value, typeSize(type));
+	_entries.push_back(entry);
+}
+
+bool TiledTiffWriter::close()
+{
+	if (!_file)
+		return false;
+
+	bool complete = true;
+	for (uint64_t offset : _tileOffsets)
+		complete = complete && offset != 0;
+
+	uint16_t offsetType = _bigTiff ? TIFF_LONG8 : TIFF_LONG;
+	uint64_t tileBytes = (uint64_t)_tileSize * _tileSize * 3;
+	_entries.clear();
+	addEntry(TAG_IMAGE_WIDTH, TIFF_LONG, { (uint64_t)_width });
+	addEntry(TAG_IMAGE_LENGTH, TIFF_LONG, { (uint64_t)_height });
+	addEntry(TAG_BITS_PER_SAMPLE, TIFF_SHORT, { 8, 8, 8 });
+	addEntry(TAG_COMPRESSION, TIFF_SHORT, { 1 });
+	addEntry(TAG_PHOTOMETRIC, TIFF_SHORT, { 2 });
+	addEntry(TAG_SAMPLES_PER_PIXEL, TIFF_SHORT, { 3 });
+	addEntry(TAG_PLANAR_CONFIG, TIFF_SHORT, { 1 });
+	addEntry(TAG_TILE_WIDTH, TIFF_LONG, { (uint64_t)_tileSize });
+	addEntry(TAG_TILE_LENGTH, TIFF_LONG, { (uint64_t)_tileSize });
+	addEntry(TAG_TILE_OFFSETS, offsetType, _tileOffsets);
+	addEntry(TAG_TILE_BYTE_COUNTS, offsetType, std::vector<uint64_t>(_tileOffsets.size(), tileBytes));
+	_tileOffsets.clear();
+
+	//Values that do not fit in their entry go before the directory, on word boundaries
+	size_t inlineSize = _bigTiff ? 8 : 4;
+	for (Entry & entry : _entries)
+	{
+		if (entry.data.size() <= inlineSize)
+			continue;
+		if (_position & 1)
+			write("", 1);
+		entry.offset = _position;
+		write(entry.data.data(), entry.data.size());
+	}
+	if (_position & 1)
+		write("", 1);
+
+	uint64_t directoryOffset = _position;
+	std::vector<unsigned char> directory;
+	putLE(directory, _entries.size(), _bigTiff ? 8 : 2);
+	for (Entry & entry : _entries)
+	{
+		putLE(directory, entry.tag, 2);
+		putLE(directory, entry.type, 2);
+		putLE(directory, entry.count, _bigTiff ? 8 : 4);
+		if (entry.data.size() <= inlineSize)
+		{
+			entry.data.resize(inlineSize, 0);
+			directory.insert(directory.end(), entry.data.begin(), entry.data.end());
+		}
+		else
+		{
+			putLE(directory, entry.offset, (int)inlineSize);
+		}
+	}
+	putLE(directory, 0, (int)inlineSize);
+	write(directory.data(), directory.size());
+	_entries.clear();
+
+	std::vector<unsigned char> patch;
+	putLE(patch, directoryOffset, (int)inlineSize);
+	if (!_failed && (fseek(_file, _bigTiff ? 8 : 4, SEEK_SET) != 0 || fwrite(patch.data(), 1, patch.size(), _file) != patch.size()))
+		_failed = true;
+	if (fclose(_file) != 0)
+		_failed = true;
+	_file = NULL;
+
+	if (_failed)
+		fprintf(stderr, "Could not write the TIFF file\n");
+	else if (!complete)
+		fprintf(stderr, "TIFF file closed with missing tiles\n");
+	return !_failed && complete;
+}
@@ -0,0 +1,94 @@
+#include "TraceShared.h"
+#include "JobSystem.h"
+
+namespace trace
+{
+	const Object* vObjects = nullptr;
+	int objectsNbr = 0;
+	const Light* vLights = nullptr;
+	int lightsNbr = 0;
+	vec4 emission;
+	vec4 reflection;
+	float dnear;
+	float dfar;
+	int depthMax;
+}
+
+void trace_SetScene(const Scene & scene, float dnear, float dfar, int depth)
+{
+	trace::vObjects = scene.objects.data();
+	trace::objectsNbr = (int)scene.objects.size();
+	trace::vLights = scene.lights.data();
+	trace::lightsNbr = (int)scene.lights.size();
+	trace::emission = scene.emission;
+	trace::reflection = scene.reflection;
+	trace::dnear = dnear;
+	trace::dfar = dfar;
+	trace::depthMax = depth;
+}
+
+//Traces the pixel x, y into rgba
+static inline void tracePixel(const glm::mat4 & invProjectionView, const glm::vec3 & eye, int width, int height, int x, int y, float* rgba)
+{
+	//Through the texel corner, as in tracePrimary
+	glm::vec2 texCoord((float)x / (float)width, (float)y / (float)height);
+	trace::Ray ray = trace::cameraRay(invProjectionView, eye, 2.0f * texCoord - 1.0f);
+	trace::hitInfo hit;
+	glm::vec4 color(0.0f, 0.0f, 0.0f, 1.0f);
+	if (trace::intersectObjects(ray, hit))
+		color = trace::shadeHit(ray, hit);
+	float* pixel = rgba + ((size_t)y * width + x) * 4;
+	pixel[0] = color.r;
+	pixel[1] = color.g;
+	pixel[2] = color.b;
+	pixel[3] = color.a;
+}
+
+//Even bits of the index, the x of its point on the Z-curve, or the y once shifted by one
+static inline int compactBits(unsigned int bits)
+{
+	bits &= 0x55555555u;
+	bits = (bits | (bits >> 1)) & 0x33333333u;
+	bits = (bits | (bits >> 2)) & 0x0F0F0F0Fu;
+	bits = (bits | (bits >> 4)) & 0x00FF00FFu;
+	bits = (bits | (bits >> 8)) & 0x0000FFFFu;
+	return (int)bits;
+}
+
+void trace_RenderCpu(const glm::mat4 & invProjectionView, const glm::vec3 & eye, int width, int height, float* rgba,
+	bool morton, bool threaded)
+{
+	int tilesX = (width + TRACE_CPU_TILE - 1) / TRACE_CPU_TILE;
+	int tilesY = (height + TRACE_CPU_TILE - 1) / TRACE_CPU_TILE;
+	auto traceRows = [&](int begin, int end)
+	{
+		for (int y = begin; y < end; y++)
+			for (int x = 0; x < width; x++)
+				tracePixel(invProjectionView, eye, width, height, x, y, rgba);
+	};
+	auto traceTiles = [&](int begin, int end)
+	{
+		for (int tile = begin; tile < end; tile++)
+		{
+			int tileX = tile % tilesX * TRACE_CPU_TILE, tileY = tile / tilesX * TRACE_CPU_TILE;
+			for (unsigned int index = 0; index < TRACE_CPU_TILE * TRACE_CPU_TILE; index++)
+			{
+				int x = tileX + compactBits(index), y = tileY + compactBits(index >> 1);
+				if (x < width && y < height)
+					tracePixel(invProjectionView, eye, width, height, x, y, rgba);
+			}
+		}
+	};
+
+	if (!threaded)
+	{
+		if (morton)
+			traceTiles(0, tilesX * tilesY);
+		else
+			traceRows(0, height);
+	}
+	else if (morton)
+		jobs_ParallelFor(0, tilesX * tilesY, 1, traceTiles);
+	else
+		jobs_ParallelFor(0, height, 1, traceRows);
+}
@@ -3,6 +3,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <math.h>
 
 #include "Utils.h"
 
@@ -19,27 +20,27 @@ bool check_FB_Status()
 	switch (e) {
 	case GL_FRAMEBUFFER_COMPLETE:
 	{
-		fprintf(stdout, "FBO OK");
+		fprintf(stdout, "FBO OK\n");
 		FB_status = true;
 	}
 	break;
 	case GL_FRAMEBUFFER_UNDEFINED:
-		fprintf(stdout, "FBO Undefined");
+		fprintf(stdout, "FBO Undefined\n");
 		break;
 	case GL_FRAMEBUFFER_INCOMPLETE_ATTACHMENT:
-		fprintf(stdout, "FBO Incomplete Attachment");
+		fprintf(stdout, "FBO Incomplete Attachment\n");
 		break;
 	case GL_FRAMEBUFFER_INCOMPLETE_MISSING_ATTACHMENT:
-		fprintf(stdout, "FBO Missing Attachment");
+		fprintf(stdout, "FBO Missing Attachment\n");
 		break;
 	case GL_FRAMEBUFFER_INCOMPLETE_DRAW_BUFFER:
-		fprintf(stdout, "FBO Incomplete Draw Buffer");
+		fprintf(stdout, "FBO Incomplete Draw Buffer\n");
 		break;
 	case GL_FRAMEBUFFER_UNSUPPORTED:
-		fprintf(stdout, "FBO Unsupported");
+		fprintf(stdout, "FBO Unsupported\n");
 		break;
 	default:
-		fprintf(stdout, "FBO Problem?");
+		fprintf(stdout, "FBO Problem?\n");
 	}
 	return FB_status;
 }
@@ -88,4 +89,81 @@ void init_Quad(unsigned int  shaderID, unsigned int  & quadVAO, unsigned int  &
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 
 	glBindVertexArray(0);
-}
\ No newline at end of file
+}
+//Checks that the level 0 of the bound texture is width x height (x layers), reading more would overflow the caller's buffer
+static bool check_TextureSize(unsigned int target, int width, int height, int layers)
+{
+	int levelWidth = 0, levelHeight = 0, levelDepth = 1;
+	glGetTexLevelParameteriv(target, 0, GL_TEXTURE_WIDTH, &levelWidth);
+	glGetTexLevelParameteriv(target, 0, GL_TEXTURE_HEIGHT, &levelHeight);
+	if (target == GL_TEXTURE_2D_ARRAY)
+		glGetTexLevelParameteriv(target, 0, GL_TEXTURE_DEPTH, &levelDepth);
+	if (levelWidth != width || levelHeight != height || levelDepth != layers)
+	{
+		fprintf(stderr, "Texture is %dx%dx%d, expected %dx%dx%d, not reading it back\n", levelWidth, levelHeight, levelDepth, width, height, layers);
+		return false;
+	}
+	return true;
+}
+
+bool read_Texture(unsigned int texture, int width, int height, std::vector<float> & pixels)
+{
+	pixels.assign((size_t)width * height * 4, 0.0f);
+	return read_Texture(texture, width, height, pixels.data());
+}
+
+bool read_Texture(unsigned int texture, int width, int height, float* pixels)
+{
+	//The texture may have been written by image stores
+	glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	bool sizeOk = check_TextureSize(GL_TEXTURE_2D, width, height, 1);
+	if (sizeOk)
+		glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, pixels);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	return sizeOk;
+}
+
+bool read_TextureLayers(unsigned int texture, int width, int height, int layers, std::vector<float> & pixels)
+{
+	pixels.assign((size_t)width * height * layers * 4, 0.0f);
+	glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+	bool sizeOk = check_TextureSize(GL_TEXTURE_2D_ARRAY, width, height, layers);
+	if (sizeOk)
+		glGetTexImage(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA, GL_FLOAT, pixels.data());
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	return sizeOk;
+}
+
+double compute_RMSE(const std::vector<float> & image, const std::vector<float> & reference)
+{
+	double sum = 0.0;
+	size_t count = 0;
+	for (size_t i = 0; i + 3 < image.size() && i + 3 < reference.size(); i += 4)
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			double diff = (double)image[i + c] - reference[i + c];
+			sum += diff * diff;
+		}
+		count += 3;
+	}
+	return count ? sqrt(sum / count) : 0.0;
+}
+
+bool write_PPM(const char* path, int width, int height, const std::vector<unsigned char> & rgb)
+{
+	FILE* file = fopen(path, "wb");
+	if (!file)
+	{
+		fprintf(stderr, "Could not open %s for writing\n", path);
+		return false;
+	}
+	fprintf(file, "P6\n%d %d\n255\n", width, height);
+	bool written = fwrite(rgb.data(), 1, rgb.size(), file) == rgb.size();
+	fclose(file);
+	if (!written)
+		fprintf(stderr, "Could not write %s\n", path);
+	return written;
+}
@@ -0,0 +1,77 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <vector>
+
+//Bump allocator for transient data: an allocation moves a pointer and everything is released at once by reset.
+//What does not fit in the block comes from the heap, and the block grows at the next reset to hold it all, so
+//a frame that allocates no more than the previous ones does not touch the heap
+class Arena
+{
+public:
+	explicit Arena(size_t capacity = 0);
+	~Arena();
+	Arena(const Arena &) = delete;
+	Arena & operator=(const Arena &) = delete;
+
+	//Uninitialized memory, valid until the arena is reset or rewound before it
+	void* alloc(size_t size, size_t alignment = 16);
+	//No constructor is run, for plain types only
+	template<class T>
+	T* allocArray(size_t count)
+	{
+		return (T*)alloc(count * sizeof(T), alignof(T) > 16 ? alignof(T) : 16);
+	}
+
+	//Releases everything allocated
+	void reset();
+	//Releases what was allocated in the block after the mark
+	size_t mark() const { return _used; }
+	void rewind(size_t mark);
+	bool empty() const { return _used == 0 && _overflow.empty(); }
+
+	size_t capacity() const { return _capacity; }
+	//Most bytes allocated between two resets
+	size_t peak() const { return _peak; }
+
+private:
+	char* _block{};
+	size_t _capacity{}, _used{}, _peak{};
+	//Allocations that did not fit in the block, freed by reset
+	std::vector<void*> _overflow;
+	size_t _overflowSize{};
+};
+
+//Releases on destruction what was allocated from the arena in the scope. A scope opened on an empty arena
+//resets it, which lets the block grow after an overflow
+class ArenaScope
+{
+public:
+	explicit ArenaScope(Arena & arena) : _arena(arena), _mark(arena.mark()), _outermost(arena.empty()) {}
+	~ArenaScope()
+	{
+		if (_outermost)
+			_arena.reset();
+		else
+			_arena.rewind(_mark);
+	}
+	ArenaScope(const ArenaScope &) = delete;
+	ArenaScope & operator=(const ArenaScope &) = delete;
+
+private:
+	Arena & _arena;
+	size_t _mark;
+	bool _outermost;
+};
+
+//Transient data of the frame on the main thread, reset at the start of every frame, job or tile
+Arena & arena_Frame();
+//Arena of the calling thread for the jobs, used inside an ArenaScope. The outermost scope resets it
+Arena & arena_Thread();
+
+//Heap allocations made through operator new since the start of the program. They are only counted in
+//debug builds, or with ARENA_COUNT_ALLOCATIONS defined, otherwise -1
+long long heap_AllocationCount();
+
+#endif
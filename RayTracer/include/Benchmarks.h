@@ -0,0 +1,31 @@
+#ifndef BENCHMARKS_H
+#define BENCHMARKS_H
+
+//Benchmarks of the renderer, run once the window, the shaders and the scene of main are set up
+
+//Render frames as fast as possible and report the GPU time spent per frame
+void benchmark(int width, int height, int depth, int frames);
+
+//Turntable of viewsNbr views traced one render at a time then batched
+void benchmarkViews(int width, int height, int depth, int viewsNbr);
+
+//Error of the reduced resolution reflections against full resolution ones
+void reportReflectionError(int width, int height, int depth);
+
+//GPU time over the object count, the light count and the depth of the generated scene, as CSV
+void benchmarkScaling(int width, int height, int depth, int frames);
+
+//Renders the frame with the shaders and with the shared trace code on the CPU, false when they differ
+bool compareCpuTrace(int width, int height, int depth);
+
+//Row-major against Morton order of the pixels, on the GPU and on the CPU
+void benchmarkTraversal(int width, int height, int depth, int frames);
+
+//GPU and CPU denoisers on a frame of a few samples per pixel against a path traced reference
+void benchmarkDenoiser(int width, int height, int depth, int samples);
+
+//The last two need no GL context, their output is the exit code of main
+int benchmarkThreads(bool pin);
+int benchmarkIntersections();
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef DENOISER_H
+#define DENOISER_H
+
+#include <vector>
+
+//Parameters of the a-trous filter, shared by the CPU denoiser and the atrousCS shader.
+//The color sigma is halved at every pass, the step between the taps doubled
+#define DENOISE_PASSES 5
+#define DENOISE_SIGMA_COLOR 1.0f
+#define DENOISE_SIGMA_ALBEDO 0.1f
+#define DENOISE_SIGMA_DEPTH 0.02f
+
+//Edge-aware a-trous wavelet filter: DENOISE_PASSES passes of a 5x5 B3 spline kernel with holes, weighted by
+//the differences of color, albedo, normal and depth with the center pixel. CPU version of atrousCS
+class AtrousDenoiser
+{
+public:
+	//The images are width x height RGBA floats. normalDepth holds the normal of the primary hit and its distance,
+	//negative where the pixel sees the background. Without simd, or without SSE2, every pixel takes the scalar path
+	void denoise(const float* color, const float* albedo, const float* normalDepth, int width, int height, float* output, bool simd = true);
+
+	static bool simdAvailable();
+
+private:
+	void filterPixel(int x, int y, int step, float sigmaColor, const std::vector<float>* in, std::vector<float>* out);
+	void filterPixels4(int x, int y, int step, float sigmaColor, const std::vector<float>* in, std::vector<float>* out);
+
+	//One plane per channel, the color planes are ping-ponged between the passes
+	int _width{}, _height{};
+	std::vector<float> _albedo[3];
+	std::vector<float> _normal[3];
+	std::vector<float> _depth;
+	std::vector<float> _color[2][3];
+};
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef DISTRIBUTED_H
+#define DISTRIBUTED_H
+
+#include "Net.h"
+#include "Scene.h"
+
+//Messages between the coordinator and the workers, and between the render server and its clients
+enum DistributedMessage
+{
+	MSG_SETUP = 1,	//coordinator -> worker: RenderSetup followed by the serialized scene
+	MSG_TILE,		//coordinator -> worker: TileJob to render
+	MSG_RESULT,		//worker -> coordinator: TileJob followed by its RGB8 texels, bottom row first
+	MSG_DONE,		//coordinator -> worker: frame complete, disconnect
+	MSG_SCENE,		//client -> server: scene name on SCENE_NAME_SIZE bytes followed by the serialized scene
+	MSG_RENDER,		//client -> server: RenderJob
+	MSG_IMAGE,		//server -> client: ImageHeader followed by the RGB8 texels, bottom row first
+	MSG_ERROR		//server -> client: error message
+};
+
+#define SCENE_NAME_SIZE 64
+
+//What is rendered of the scene, sent once to each worker
+struct RenderSetup
+{
+	int32_t width, height;
+	int32_t depth;
+	int32_t tileSize;
+	double eye[3];
+	double focus[3];
+	double hfov, dnear, dfar;
+};
+
+//Rectangle of the frame, in pixels from the bottom left corner
+struct TileJob
+{
+	int32_t id;
+	int32_t x, y;
+	int32_t width, height;
+};
+
+//Render server job. The scene is referenced by the name it was uploaded under, "default" is the built-in scene
+struct RenderJob
+{
+	char scene[SCENE_NAME_SIZE];
+	int32_t width, height;
+	int32_t depth;
+	double eye[3];
+	double focus[3];
+	double hfov;
+};
+
+struct ImageHeader
+{
+	int32_t width, height;
+	//Time spent by the server on the job
+	float renderMs;
+};
+
+bool sendSetup(NetSocket socket, const RenderSetup & setup, const Scene & scene);
+bool decodeSetup(const std::vector<char> & payload, RenderSetup & setup, Scene & scene);
+
+//Hands the tiles of the frame out to the workers connecting on the address and writes the assembled image.
+//When spawnCommand is set, it is run in the background workersNbr times to start local workers. Outputs the time
+//from the first tile to the last one, the workers connecting and building their programs are not counted
+bool runCoordinator(const char* address, int workersNbr, const char* spawnCommand,
+	const RenderSetup & setup, const Scene & scene, const char* outputPath, double* seconds = NULL);
+
+//Renders the frame with 1, 2, 4... up to workersNbr workers started by spawnCommand, one count after the other,
+//and prints the time of each count and its speedup against one worker
+bool runSpeedupSweep(const char* address, int workersNbr, const char* spawnCommand,
+	const RenderSetup & setup, const Scene & scene, const char* outputPath);
+
+//Sends the job jobsNbr times to a render server, writes the last image and prints the latencies.
+//The scene is uploaded under the job's scene name if the server does not know it
+bool runClient(const char* address, const RenderJob & job, const Scene & scene, int jobsNbr, const char* outputPath);
+
+#endif
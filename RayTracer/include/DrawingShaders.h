@@ -25,8 +25,78 @@ static const GLchar* rayTraceFS = STRINGIFY(
 in vec2 io_texCoord;
 
 uniform sampler2D tex;
+//Part of the texture holding the image, when traced at a reduced resolution
+uniform vec2 texScale;
 layout(location = 0) out vec4 color;
 void main(void) {
-	color = texture(tex, io_texCoord);
+	vec2 halfTexel = 0.5 / vec2(textureSize(tex, 0));
+	color = texture(tex, min(io_texCoord * texScale, texScale - halfTexel));
 }
-);
\ No newline at end of file
+);
+
+//G-buffer pass: every object is drawn as its bounding box, the fragments then
+//intersect the actual object along the camera ray. Built after the shaderVersion,
+//sceneGLSL and intersectionGLSL chunks.
+static const GLchar* gBufferVS = STRINGIFY(
+
+uniform mat4 projectionView;
+
+flat out int io_objIdx;
+out vec3 io_worldPos;
+
+const int cubeCorners[36] = int[](0, 2, 1, 1, 2, 3, 4, 5, 6, 5, 7, 6,
+								  0, 1, 4, 1, 5, 4, 2, 6, 3, 3, 6, 7,
+								  0, 4, 2, 2, 4, 6, 1, 3, 5, 3, 7, 5);
+
+void main()
+{
+	int corner = cubeCorners[gl_VertexID];
+	vec3 minCorner;
+	vec3 maxCorner;
+	if (vObjects[gl_InstanceID].type == 0.0f)
+	{
+		minCorner = vObjects[gl_InstanceID].pos - vObjects[gl_InstanceID].r;
+		maxCorner = vObjects[gl_InstanceID].pos + vObjects[gl_InstanceID].r;
+	}
+	else
+	{
+		minCorner = vObjects[gl_InstanceID].min;
+		maxCorner = vObjects[gl_InstanceID].max;
+	}
+
+	io_objIdx = gl_InstanceID;
+	io_worldPos = mix(minCorner, maxCorner, vec3(corner & 1, (corner >> 1) & 1, (corner >> 2) & 1));
+	gl_Position = projectionView * vec4(io_worldPos, 1.0);
+}
+);
+
+static const GLchar* gBufferFS = STRINGIFY(
+
+uniform mat4 projectionView;
+uniform vec3 eye;
+
+flat in int io_objIdx;
+in vec3 io_worldPos;
+
+layout(location = 0) out vec4 gPosition;
+layout(location = 1) out vec4 gNormal;
+
+void main(void) {
+	Ray ray;
+	ray.origin = eye;
+	ray.dir = normalize(io_worldPos - eye);
+
+	vec3 normalAtPt;
+	float dist = objectIntersect(ray, io_objIdx, normalAtPt);
+	if (dist <= 0.0f)
+		discard;
+
+	vec3 hitPos = eye + dist * ray.dir;
+	vec4 clipPos = projectionView * vec4(hitPos, 1.0);
+	gl_FragDepth = 0.5 * clipPos.z / clipPos.w + 0.5;
+
+	//Same shading point as the traced primary rays, slightly in front of the surface
+	gPosition = vec4(eye + 0.99f * dist * ray.dir, float(io_objIdx));
+	gNormal = vec4(normalAtPt, 0.0);
+}
+);
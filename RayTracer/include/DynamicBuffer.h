@@ -0,0 +1,51 @@
+#ifndef DYNAMIC_BUFFER_H
+#define DYNAMIC_BUFFER_H
+
+#include <glad/glad.h>
+
+#include <vector>
+
+//Regions of the ring, one written by the host while the GPU may still read the other ones
+#define DYNAMIC_BUFFER_REGIONS 3
+
+//Blocks until the GPU signals the fence and deletes it. A wait that does not return at once is added to waitMs
+//and counted in waits
+void waitFence(GLsync fence, double & waitMs, int & waits);
+
+//Ring of regions in one buffer for the data written every frame. The buffer is mapped once with persistent and
+//coherent mapping, the writes are memcpy to the current region. A fence is placed when the host moves on from a
+//region, and waited on before the region is written again, which only blocks when the host is
+//DYNAMIC_BUFFER_REGIONS frames ahead of the GPU. Without OpenGL 4.4 the writes go through glBufferSubData,
+//to a region the GPU is done with all the same
+class DynamicBuffer
+{
+public:
+	//Allocate the buffer and map it, regionSize bytes per region
+	bool init(GLsizeiptr regionSize);
+	void release();
+
+	//Copies size bytes to the current region and outputs their offset in the buffer, aligned for binding them as
+	//a uniform or a storage block. Moves to the next region when the current one is full. -1 when size is larger
+	//than a region
+	GLintptr write(const void* data, GLsizeiptr size);
+	//Fences the current region and moves to the next one, at the end of a frame
+	void nextRegion();
+
+	GLuint buffer() const { return _buffer; }
+	bool persistent() const { return _mapped != nullptr; }
+	//Time spent waiting for the GPU to release a region since the last call, and the number of waits
+	double takeWaitMs(int* waits = nullptr);
+
+private:
+	GLuint _buffer{};
+	char* _mapped{};
+	GLsizeiptr _regionSize{};
+	GLintptr _alignment{};
+	std::vector<GLsync> _fences;
+	int _region{};
+	GLintptr _used{};
+	double _waitMs{};
+	int _waits{};
+};
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef GPU_TIMER_H
+#define GPU_TIMER_H
+
+#include <glad/glad.h>
+
+#include <vector>
+
+//Measures GPU time between begin() and end() with timer queries.
+//Queries are recycled in a ring so reading the results never stalls the pipeline.
+class GpuTimer
+{
+public:
+	//Allocate the ring of queries, latency is the number of frames in flight
+	void init(int latency = 4);
+	void release();
+
+	void begin();
+	//The tag is handed back with the measurement, to tell what was measured
+	void end(int tag = 0);
+
+	//Outputs the oldest measurement available in milliseconds, false if none is ready yet.
+	//A measurement not fetched before the ring wraps around is dropped
+	bool fetch(double & elapsedMs, int* tag = nullptr);
+	//Wait for all the pending measurements
+	void finish();
+
+private:
+	//Collect the results of the finished queries, blocking on the oldest one if wait is set
+	void collect(bool wait);
+
+	//The slots from _oldest on hold _readyNbr results then the pending queries, _usedNbr in total
+	std::vector<GLuint> _queries;
+	std::vector<double> _results;
+	std::vector<int> _tags;
+	int _oldest{}, _usedNbr{}, _readyNbr{};
+};
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef INTERSECT_H
+#define INTERSECT_H
+
+#include "TraceShared.h"
+
+//Ray/object tests on the CPU. The scalar ones are boxIntersect and sphereIntersect of the shaders, compiled from
+//the shared source. The SIMD ones test one ray against four objects and the packet ones four rays against one
+//object, they only output the distances: the normal is only needed at the closest hit, where the scalar
+//version gives it
+using trace::Ray;
+using trace::boxIntersect;
+using trace::sphereIntersect;
+
+//Four objects or four rays, one per lane, in structures of arrays
+struct Boxes4
+{
+	float minX[4], minY[4], minZ[4];
+	float maxX[4], maxY[4], maxZ[4];
+};
+
+struct Spheres4
+{
+	float x[4], y[4], z[4], r[4];
+};
+
+struct RayPacket4
+{
+	float originX[4], originY[4], originZ[4];
+	float dirX[4], dirY[4], dirZ[4];
+};
+
+//One ray against four objects, outputs the distance to each as the scalar versions return it
+void boxIntersect4(const Ray & ray, const Boxes4 & boxes, float distances[4]);
+void sphereIntersect4(const Ray & ray, const Spheres4 & spheres, float distances[4]);
+
+//Four rays against one object. The sphere test skips the square root when all the rays miss,
+//which coherent packets do together
+void boxIntersectPacket(const RayPacket4 & rays, const glm::vec3 & minCorner, const glm::vec3 & maxCorner, float distances[4]);
+void sphereIntersectPacket(const RayPacket4 & rays, const glm::vec3 & center, float radius, float distances[4]);
+
+//Without SSE2 the four lane versions loop over the scalar ones
+bool intersectSimdAvailable();
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <atomic>
+
+#include "Profiler.h"
+
+//Work-stealing scheduler for the host side. Each thread owns a Chase-Lev deque: it pushes and pops its jobs
+//at the bottom, idle threads steal the oldest ones at the top. The main thread is one of the threads and runs
+//jobs while it waits. Before jobs_Init, or when the deque of the thread is full, jobs run inline
+
+//Number of jobs spawned with the counter and not finished yet
+struct JobCounter
+{
+	std::atomic<int> pending{ 0 };
+};
+
+//A job runs fn(data) once. The caller keeps the job and its data alive until it waits for the counter
+struct Job
+{
+	void (*fn)(void* data);
+	void* data;
+	JobCounter* counter;
+};
+
+//Starts threads - 1 workers, threads <= 0 uses one per hardware thread. pin binds the thread i to the core i
+bool jobs_Init(int threads, bool pin = false);
+void jobs_Shutdown();
+//Number of threads running jobs, the main thread included
+int jobs_ThreadCount();
+
+void jobs_Spawn(Job & job, JobCounter & counter);
+//Runs jobs, its own or stolen, until all the jobs of the counter are finished
+void jobs_Wait(JobCounter & counter);
+
+//Fork-join over the range: halves it recursively, spawning one half and running the other, down to grain items.
+//body(begin, end) is called for consecutive sub-ranges from any thread
+template<class Body>
+struct ParallelForRange
+{
+	const Body* body;
+	int begin, end, grain;
+};
+
+template<class Body>
+void jobs_RunRange(void* data)
+{
+	ParallelForRange<Body>* range = (ParallelForRange<Body>*)data;
+	if (range->end - range->begin <= range->grain)
+	{
+		PROFILE_ZONE("parallelFor");
+		(*range->body)(range->begin, range->end);
+		return;
+	}
+
+	int middle = range->begin + (range->end - range->begin) / 2;
+	ParallelForRange<Body> left = { range->body, range->begin, middle, range->grain };
+	ParallelForRange<Body> right = { range->body, middle, range->end, range->grain };
+	JobCounter counter;
+	Job job = { &jobs_RunRange<Body>, &right, nullptr };
+	jobs_Spawn(job, counter);
+	jobs_RunRange<Body>(&left);
+	jobs_Wait(counter);
+}
+
+template<class Body>
+void jobs_ParallelFor(int begin, int end, int grain, const Body & body)
+{
+	if (begin >= end)
+		return;
+	ParallelForRange<Body> range = { &body, begin, end, grain < 1 ? 1 : grain };
+	jobs_RunRange<Body>(&range);
+}
+
+#endif
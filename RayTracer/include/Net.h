@@ -0,0 +1,46 @@
+#ifndef NET_H
+#define NET_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+//Blocking stream sockets over Winsock or BSD sockets.
+//Addresses are "host:port" for TCP, or "unix:path" for a Unix domain socket (not on Windows)
+#ifdef _WIN32
+typedef uintptr_t NetSocket;
+#else
+typedef int NetSocket;
+#endif
+#define INVALID_NET_SOCKET ((NetSocket)-1)
+
+bool net_Init();
+void net_Shutdown();
+
+NetSocket net_Listen(const char* address);
+NetSocket net_Accept(NetSocket listener);
+//Retries for up to timeoutMs while nobody listens at the address yet
+NetSocket net_Connect(const char* address, int timeoutMs = 5000);
+void net_Close(NetSocket socket);
+//Sends and receives on the socket fail once they block for timeoutMs, 0 blocks forever
+bool net_SetTimeout(NetSocket socket, int timeoutMs);
+
+bool net_SendAll(NetSocket socket, const void* data, size_t size);
+bool net_RecvAll(NetSocket socket, void* data, size_t size);
+
+//Messages are a type and a payload size followed by the payload. Payloads are at most NET_MAX_PAYLOAD bytes, a
+//serialized scene of millions of objects or an image of 8192x8192 RGB8 texels: a peer announcing a larger one is
+//treated as a lost connection rather than allocating whatever size it sent
+#define NET_MAX_PAYLOAD ((size_t)256 << 20)
+bool net_SendMessage(NetSocket socket, uint32_t type, const void* payload, size_t size);
+bool net_RecvMessage(NetSocket socket, uint32_t & type, std::vector<char> & payload);
+//Receiving without blocking on a peer that sends a message in pieces: net_RecvAvailable appends one read of a
+//readable socket to the buffer, false when the peer closed or failed. net_PopMessage moves the first message of the
+//buffer out once it is complete, false until then or when its size is over the limit, which sets invalid
+bool net_RecvAvailable(NetSocket socket, std::vector<char> & buffer);
+bool net_PopMessage(std::vector<char> & buffer, uint32_t & type, std::vector<char> & payload, bool & invalid);
+
+//Waits until one of the sockets can be read, outputs its index, -1 on timeout or error
+int net_WaitReadable(const std::vector<NetSocket> & sockets, int timeoutMs);
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+//Hardware cache events counted by PerfCounters
+enum PerfEvent
+{
+	PERF_L1D_READS,
+	PERF_L1D_READ_MISSES,
+	PERF_LLC_REFERENCES,
+	PERF_LLC_MISSES,
+	PERF_EVENTS_NBR,
+};
+
+//Cache counters of the calling thread, in user space only, through perf_event_open on Linux. Elsewhere, or when
+//the kernel or the CPU does not expose an event (virtual machines, perf_event_paranoid), its count is -1
+class PerfCounters
+{
+public:
+	//Opens the events available, false when none is
+	bool open();
+	void close();
+
+	void start();
+	//Stops counting and outputs the counts since start, scaled up when the kernel multiplexed the events
+	void stop(long long counts[PERF_EVENTS_NBR]);
+
+	~PerfCounters() { close(); }
+
+private:
+	int _fds[PERF_EVENTS_NBR]{ -1, -1, -1, -1 };
+};
+
+#endif
@@ -0,0 +1,8 @@
+#ifndef POSTER_H
+#define POSTER_H
+
+//Render a width x height image one tile at a time and stream the tiles to a tiled TIFF file.
+//The GPU and CPU memory only depend on the tile size, a multiple of 16
+bool renderPoster(const char* path, int width, int height, int depth, int tileSize);
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdint.h>
+#include <atomic>
+
+//Hot path instrumentation. While a capture runs, the host zones of every thread go to a lock-free ring owned
+//by the thread and the GPU zones to timestamp queries. Both are collected at the end of each frame and
+//written as Chrome trace JSON, to open in chrome://tracing or ui.perfetto.dev.
+//Outside of a capture a zone costs one relaxed load
+
+//Measures the rest of the scope on the calling thread, the name must be a literal
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+//Measures on the GPU the GL commands issued in the rest of the scope, on the thread of the GL context only
+#define PROFILE_GPU_ZONE(name) ProfileGpuZone PROFILE_CONCAT(profileGpuZone, __LINE__)(name)
+
+#define PROFILE_CONCAT_IMPL(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_IMPL(a, b)
+
+extern std::atomic<bool> profileCapturing;
+
+//Nanoseconds since the start of the program
+int64_t profile_Now();
+void profile_Record(const char* name, int64_t beginNs, int64_t endNs);
+//Outputs the index of the query pair of the zone, -1 when all are in flight
+int profile_GpuBegin(const char* name);
+void profile_GpuEnd(int zone);
+
+//Captures the next frames, on the thread of the GL context
+void profile_Start(int frames);
+bool profile_Capturing();
+//Marks the end of a frame on the thread of the GL context: collects the zones of the threads and the finished
+//GPU zones. Outputs true once the last frame of the capture is in
+bool profile_FrameEnd();
+//Writes the capture as Chrome trace JSON and prints the average time of each zone per frame
+bool profile_Write(const char* path);
+
+class ProfileZone
+{
+public:
+	explicit ProfileZone(const char* name) : _name(name), _begin(profileCapturing.load(std::memory_order_relaxed) ? profile_Now() : -1) {}
+	~ProfileZone()
+	{
+		if (_begin >= 0)
+			profile_Record(_name, _begin, profile_Now());
+	}
+	ProfileZone(const ProfileZone &) = delete;
+	ProfileZone & operator=(const ProfileZone &) = delete;
+
+private:
+	const char* _name;
+	int64_t _begin;
+};
+
+class ProfileGpuZone
+{
+public:
+	explicit ProfileGpuZone(const char* name) : _zone(profileCapturing.load(std::memory_order_relaxed) ? profile_GpuBegin(name) : -1) {}
+	~ProfileGpuZone()
+	{
+		if (_zone >= 0)
+			profile_GpuEnd(_zone);
+	}
+	ProfileGpuZone(const ProfileGpuZone &) = delete;
+	ProfileGpuZone & operator=(const ProfileGpuZone &) = delete;
+
+private:
+	int _zone;
+};
+
+#endif
@@ -4,16 +4,33 @@
 #define STRINGIFY(A)  #A
 #endif // 
 
+//The host side mirrors of the shader limits are in RayTracer.h, they must match the defines below
 
-static const GLchar* rayTraceCS = STRINGIFY(
+
+//Version line, first chunk of every shader built from several chunks
+static const GLchar* shaderVersion = STRINGIFY(
 \n#version 430 core\n
+);
 
-layout(binding = 0, rgba32f) uniform image2D framebuffer;
+//Inserted after the version to build the multi-view variants of the culling and raytracing shaders
+static const GLchar* multiViewDefine = STRINGIFY(
+\n#define MULTI_VIEW\n
+);
 
+//Inserted after the version to build the ray counting variant of the raytracing shader
+static const GLchar* rayStatsDefine = STRINGIFY(
+\n#define RAY_STATS\n
+);
 
-\n#define reflectionMaxDepth 100\n
-\n#define lightsMaxNbr 10\n
-\n#define objectsMaxNbr 20\n
+//Scene description shared by the culling, the raytracing and the G-buffer shaders
+static const GLchar* sceneGLSL = STRINGIFY(
+
+\n#define lightsMaxNbr 64\n
+\n#define tileObjectsMaxNbr 32\n
+\n#define tileSize 16\n
+//Function prefix and out parameters of the code shared with the CPU, see TraceSharedCode.h
+\n#define TRACE_INLINE\n
+\n#define TRACE_OUT(T) out T\n
 
 struct Light {
 	vec3 pos;
@@ -29,226 +46,832 @@ struct Object {
 	vec4 color;
 };
 
-uniform vec3 eye;
-uniform mat4 view;
-uniform mat4 inversinvProjectionView;
 uniform float dnear;
 uniform float dfar;
-uniform int depthMax;
-uniform int lightsNbr;
-uniform int objectsNbr;
-uniform Light vLights[lightsMaxNbr];
-uniform Object vObjects[objectsMaxNbr];
-uniform vec4 emission;
-uniform vec4 reflection;
 
-struct Ray {
-	vec3 origin;
-	vec3 dir;
+//Uploaded once per scene and shared by all the programs, see uploadScene for the host side of the layout
+layout(std430, binding = 3) readonly buffer SceneData {
+	vec4 emission;
+	vec4 reflection;
+	int objectsNbr;
+	int lightsNbr;
+	Light vLights[lightsMaxNbr];
+	Object vObjects[];
+};
+);
+
+//Per tile object lists, written by the culling pre-pass and read by the primary rays
+static const GLchar* tileListsGLSL = STRINGIFY(
+
+//Per tile object lists: for each tile, the objects count followed by tileObjectsMaxNbr indices.
+//A count of -1 marks a tile seeing more objects than a list holds, its rays test all the objects
+layout(std430, binding = 1) buffer TileObjects {
+	int tileObjects[];
 };
 
+int tileListBase(ivec2 tile, ivec2 frameSize)
+{
+	int tilesX = (frameSize.x + tileSize - 1) / tileSize;
+	int base = (tile.y * tilesX + tile.x) * (tileObjectsMaxNbr + 1);
+\n#ifdef MULTI_VIEW\n
+	//One set of lists per view, one after the other
+	int tilesY = (frameSize.y + tileSize - 1) / tileSize;
+	base += int(gl_GlobalInvocationID.z) * tilesX * tilesY * (tileObjectsMaxNbr + 1);
+\n#endif\n
+	return base;
+}
+);
+
+//Cameras of a multi-view batch, the view index is the z of the dispatch
+static const GLchar* multiViewGLSL = STRINGIFY(
 
-struct hitInfo {
-	float distFromCam;
-	int objIdx;
-	vec3 normalAtPt;
+struct View {
+	mat4 projectionView;
+	mat4 invProjectionView;
+	vec4 eye;
 };
 
+layout(std430, binding = 4) readonly buffer Views {
+	View views[];
+};
+);
+
+//Camera and pass of the frame for the single view raytracing shaders, written each frame by the host into its
+//dynamic buffer ring, see GPUFrameData for the host side of the layout
+static const GLchar* frameDataGLSL = STRINGIFY(
+
+\n#define FRAME_DATA\n
+layout(std140, binding = 0) uniform FrameData {
+	mat4 inversinvProjectionView;
+	mat4 prevProjectionView;
+	vec4 frameEye;
+	vec4 prevEye;
+	int frameIndex;
+	float pixelAngle;
+	int pixelStride;
+	bool refinePass;
+	float historyViewCos;
+};
+);
+
+//Culling pre-pass: one invocation per screen tile, lists the objects whose projected bounds overlap the tile
+static const GLchar* tileCullCS = STRINGIFY(
+
+\n#ifdef MULTI_VIEW\n
+mat4 projectionView;
+\n#else\n
+uniform mat4 projectionView;
+\n#endif\n
+uniform ivec2 frameSize;
+//Rectangle of the frame being traced, the tiles cover the region only
+uniform ivec2 regionOrigin;
+uniform ivec2 regionSize;
+
+//Outputs the pixel rectangle covered by the projection of a box, the whole screen if it crosses the camera plane
+vec4 projectBounds(vec3 minCorner, vec3 maxCorner)
+{
+	vec2 rectMin = vec2(frameSize);
+	vec2 rectMax = vec2(0.0f);
+	for (int c = 0; c < 8; c++)
+	{
+		vec3 corner = mix(minCorner, maxCorner, vec3(c & 1, (c >> 1) & 1, (c >> 2) & 1));
+		vec4 clipPos = projectionView * vec4(corner, 1.0f);
+		if (clipPos.w <= dnear)
+			return vec4(vec2(0.0f), vec2(frameSize));
+		vec2 pixel = (0.5f * clipPos.xy / clipPos.w + 0.5f) * vec2(frameSize);
+		rectMin = min(rectMin, pixel);
+		rectMax = max(rectMax, pixel);
+	}
+	return vec4(rectMin, rectMax);
+}
 
-//Returns the distances from the origin of the ray to the closest hit and outputs the normal
-float boxIntersect(Ray ray, const vec3 minCorner, const vec3 maxCorner, out vec3 outNormal) {
+layout(local_size_x = 8, local_size_y = 8) in;
 
-	vec3 tMin = (minCorner - ray.origin) / ray.dir;
-	vec3 tMax = (maxCorner - ray.origin) / ray.dir;
-	vec3 t1 = min(tMin, tMax);
-	vec3 t2 = max(tMin, tMax);
+void main(void)
+{
+	ivec2 tile = ivec2(gl_GlobalInvocationID.xy);
+	ivec2 tilesNbr = (regionSize + tileSize - 1) / tileSize;
+\n#ifdef MULTI_VIEW\n
+	projectionView = views[gl_GlobalInvocationID.z].projectionView;
+\n#endif\n
+	if (tile.x >= tilesNbr.x || tile.y >= tilesNbr.y) {
+		return;
+	}
 
-	float tN = max(max(t1.x, t1.y), t1.z);
-	float tF = min(min(t2.x, t2.y), t2.z);
-	outNormal = -sign(ray.dir)*step(t1.yzx, t1.xyz)*step(t1.zxy, t1.xyz);
+	//Rays of the tile go through its texel corners, keep a one pixel margin around them
+	vec2 tileMin = vec2(regionOrigin + tile * tileSize) - 1.0f;
+	vec2 tileMax = vec2(regionOrigin + tile * tileSize + tileSize) + 1.0f;
 
-	if (tN > tF) return -1.0f; // no intersection
-	else return tN;
+	int base = tileListBase(tile, regionSize);
+	int count = 0;
+	for (int i = 0; i < objectsNbr; i++) {
+		vec4 rect;
+		if (vObjects[i].type == 0.0f)
+			rect = projectBounds(vObjects[i].pos - vObjects[i].r, vObjects[i].pos + vObjects[i].r);
+		else
+			rect = projectBounds(vObjects[i].min, vObjects[i].max);
 
+		if (rect.z >= tileMin.x && rect.x <= tileMax.x && rect.w >= tileMin.y && rect.y <= tileMax.y) {
+			if (count == tileObjectsMaxNbr) {
+				count = -1;
+				break;
+			}
+			count++;
+			tileObjects[base + count] = i;
+		}
+	}
+	tileObjects[base] = count;
 }
+);
+
+//The intersection and shading chunks shared with the CPU: intersectionGLSL and traceShadingGLSL
+#define TRACE_SHARED(name, ...) static const GLchar* name = #__VA_ARGS__;
+#include "TraceSharedCode.h"
+#undef TRACE_SHARED
+
+//Uniforms and ray counters of the shading, before traceShadingGLSL
+static const GLchar* shadingGLSL = STRINGIFY(
 
-//Returns the distances from the origin of the ray to the closest hit and outputs the normal
-float sphereIntersect(Ray ray, vec3 center, float radius, out  vec3 outNormal)
+\n#if defined(MULTI_VIEW) || defined(FRAME_DATA)\n
+vec3 eye;
+\n#else\n
+uniform vec3 eye;
+\n#endif\n
+uniform int depthMax;
+
+\n#ifdef RAY_STATS\n
+\n#define STATS_DEPTHS 8\n
+\n#define PRIMARY_RAY 0\n
+\n#define REFLECTION_RAY 1\n
+\n#define SHADOW_RAY 2\n
+//Rays cast and objects tested in the frame by kind and bounce, the bounces past the last one are counted in it.
+//Each invocation tallies its own and adds them once, see RayStats for the host side of the layout
+layout(std430, binding = 6) buffer RayStats {
+	uint maxPixelTests;
+	uint frameRays[3 * STATS_DEPTHS];
+	uint frameTests[3 * STATS_DEPTHS];
+};
+uint pixelRays[3 * STATS_DEPTHS];
+uint pixelTests[3 * STATS_DEPTHS];
+int statsDepth;
+
+void resetRayStats()
 {
+	for (int s = 0; s < 3 * STATS_DEPTHS; s++) {
+		pixelRays[s] = 0u;
+		pixelTests[s] = 0u;
+	}
+	statsDepth = 0;
+}
 
-	vec3 oc = ray.origin - center;
-	float b = dot(oc, ray.dir);
-	float c = dot(oc, oc) - radius * radius;
-	float h = b * b - c;
-	if (h < 0.0f) return -1.0f; // no intersection
-	h = sqrt(h);
-	float dist = -b - h;
+void countRay(int kind, int tests)
+{
+	int s = kind * STATS_DEPTHS + min(statsDepth, STATS_DEPTHS - 1);
+	pixelRays[s]++;
+	pixelTests[s] += uint(tests);
+}
 
-	vec3 nrml = (1.0f / radius)*(ray.origin + dist * ray.dir - center);
-	float nrml_norm = dot(nrml, nrml);
-	outNormal = nrml / nrml_norm;
+void setStatsDepth(int depth)
+{
+	statsDepth = depth;
+}
 
-	return dist;
+//Adds the tallies of the invocation to the frame, outputs its number of tests
+uint flushRayStats()
+{
+	uint tests = 0u;
+	for (int s = 0; s < 3 * STATS_DEPTHS; s++) {
+		if (pixelRays[s] > 0u) {
+			atomicAdd(frameRays[s], pixelRays[s]);
+			atomicAdd(frameTests[s], pixelTests[s]);
+			tests += pixelTests[s];
+		}
+	}
+	atomicMax(maxPixelTests, tests);
+	return tests;
+}
+\n#else\n
+\n#define countRay(kind, tests)\n
+\n#define setStatsDepth(depth)\n
+\n#endif\n
+);
+
+//Primary hits stored in the G-buffer, either rasterized or written by the primary rays
+static const GLchar* gBufferGLSL = STRINGIFY(
+
+layout(binding = 1) uniform sampler2D gPosition;
+layout(binding = 2) uniform sampler2D gNormal;
+
+//Outputs the primary ray and its hit for the texel, false if the texel sees the background
+bool hitFromGBuffer(ivec2 texel, out Ray ray, out hitInfo info)
+{
+	vec4 hitPos = texelFetch(gPosition, texel, 0);
+	if (hitPos.w < 0.0f)
+		return false;
+
+	vec3 toHit = hitPos.xyz - eye;
+	info.distFromCam = length(toHit);
+	info.objIdx = int(hitPos.w);
+	info.normalAtPt = texelFetch(gNormal, texel, 0).xyz;
+
+	ray.origin = eye;
+	ray.dir = toHit / info.distFromCam;
+	return true;
+}
+);
+
+static const GLchar* rayTraceCS = STRINGIFY(
+
+//Traced resolution, the framebuffer can be larger
+uniform ivec2 frameSize;
+//Rectangle of the frame traced by this dispatch, the images hold the region only
+uniform ivec2 regionOrigin;
+uniform ivec2 regionSize;
+
+//Progressive preview: one pixel out of pixelStride x pixelStride is traced and fills its block.
+//A refine pass skips the blocks whose pixel was traced by the previous pass, at twice the stride.
+//The camera, the pass and the temporal cache frame come from FrameData, see frameDataGLSL
+
+//Multi-view batches write one layer per view, the camera of the view is set by main.
+//They are traced in one pass, without temporal cache
+\n#ifdef MULTI_VIEW\n
+layout(binding = 0, rgba32f) uniform writeonly image2DArray framebuffer;
+void storeTexel(ivec2 texel, vec4 color) { imageStore(framebuffer, ivec3(texel, gl_GlobalInvocationID.z), color); }
+mat4 inversinvProjectionView;
+const int pixelStride = 1;
+const bool refinePass = false;
+const int frameIndex = 0;
+const mat4 prevProjectionView = mat4(1.0f);
+const vec4 prevEye = vec4(0.0f);
+const float pixelAngle = 0.0f;
+const float historyViewCos = 1.0f;
+\n#else\n
+layout(binding = 0, rgba32f) uniform image2D framebuffer;
+void storeTexel(ivec2 texel, vec4 color) { imageStore(framebuffer, texel, color); }
+\n#endif\n
+
+void storeColor(ivec2 texel, vec4 color)
+{
+	ivec2 blockEnd = min(texel + pixelStride, regionSize);
+	for (int y = texel.y; y < blockEnd.y; y++)
+		for (int x = texel.x; x < blockEnd.x; x++)
+			storeTexel(ivec2(x, y), color);
 }
 
+//Primary visibility rasterized in the G-buffer instead of traced
+uniform bool rasterPrimary;
+
+//When greater than 1 the reflections are traced at a reduced resolution by another pass,
+//this pass then only outputs the direct lighting and the primary hits
+uniform int reflectionScale;
+layout(binding = 1, rgba32f) uniform writeonly image2D hitPositionImage;
+layout(binding = 2, rgba16f) uniform writeonly image2D hitNormalImage;
+
+//Temporal reprojection cache: the shading of the previous frames is reused where the primary hit is unchanged,
+//one pixel out of temporalRefresh is re-traced anyway each frame and no shading is kept for more than
+//temporalRefresh frames (its age is stored in the alpha of the history). Disabled when temporalRefresh is 0
+uniform int temporalRefresh;
+layout(binding = 3) uniform sampler2D historyColor;
+layout(binding = 4) uniform sampler2D historyPosition;
+layout(binding = 3, rgba32f) uniform writeonly image2D historyColorOut;
+layout(binding = 4, rgba32f) uniform writeonly image2D historyPositionOut;
+layout(std430, binding = 2) buffer TemporalStats {
+	uint tracedPixels;
+};
 
-//returns wether an object is hit along the ray and stocks the results in the hitInfo
-bool intersectObjects(Ray ray, out hitInfo info) {
+\n#ifdef RAY_STATS\n
+//Heatmap: when positive, the pixels show their number of tests times heatmapScale in false colours,
+//from blue for none to red for 1
+uniform float heatmapScale;
+
+vec4 countedColor(vec4 color)
+{
+	float heat = clamp(float(flushRayStats()) * heatmapScale, 0.0f, 1.0f);
+	if (heatmapScale <= 0.0f)
+		return color;
+	return vec4(clamp(vec3(1.5f) - abs(4.0f * vec3(heat) - vec3(3.0f, 2.0f, 1.0f)), 0.0f, 1.0f), 1.0f);
+}
+\n#endif\n
+
+//Same as intersectObjects, restricted to the objects listed for the tile by the culling pre-pass
+bool intersectTileObjects(Ray ray, int tileBase, out hitInfo info) {
 
-	//start the furthest point in the frustum
 	float closest = dfar;
 	bool found = false;
 
-	for (int i = 0; i < objectsNbr; i++) {
-		float distFromCam;
+	int count = tileObjects[tileBase];
+	for (int k = 1; k <= count; k++) {
+		int i = tileObjects[tileBase + k];
 		vec3 normalAtPt;
-		if (vObjects[i].type == 0.0f)
-		{
-			distFromCam = sphereIntersect(ray, vObjects[i].pos, vObjects[i].r, normalAtPt);
+		float distFromCam = objectIntersect(ray, i, normalAtPt);
 
-		}
-		else
-		{
-			distFromCam = boxIntersect(ray, vObjects[i].min, vObjects[i].max, normalAtPt);
-
-		}
-		//set up the intersection with the closest hit
 		if (distFromCam > 0.0f && distFromCam < closest) {
 			closest = distFromCam;
 			info.distFromCam = 0.99f * distFromCam;
 			info.objIdx = i;
 			info.normalAtPt = normalAtPt;
 			found = true;
-
 		}
 	}
 	return found;
 }
 
-//Apply lighting to the objects
-vec4 computeLighting(vec3 intersectionPt, vec3 normalAtPt, int objIdx)
+//Casts the primary ray of the pixel, only against the objects seen by the tile of its texel
+bool tracePrimary(ivec2 texel, ivec2 pixel, out Ray ray, out hitInfo info)
 {
-	vec4 iL = vec4(0.0f, 0.0f, 0.0f, 0.0f);
-	// Go though all light sources to update texel colors
-	for (int l = 0; l < lightsNbr; l++)
-	{
-		hitInfo j;
-
-		vec3 shadowRayDir = normalize(vLights[l].pos - intersectionPt);
-		Ray shadowRay;
-		shadowRay.origin = intersectionPt;
-		shadowRay.dir = shadowRayDir;
-		//if no object was found, we set the color, we set to shadow color otherwise
-		if (!intersectObjects(shadowRay, j))
-		{
-			float light_cos = dot(normalAtPt, shadowRayDir);
-			iL += light_cos * vObjects[objIdx].color*vLights[l].color;
+	//Nothing projects onto this tile, it only sees the background
+	int tileBase = tileListBase(texel / tileSize, regionSize);
+	int tileCount = tileObjects[tileBase];
+	countRay(PRIMARY_RAY, tileCount < 0 ? objectsNbr : tileCount);
+	if (tileCount == 0)
+		return false;
 
-		}
+	vec2 texCoord = vec2(float(pixel.x) / float(frameSize.x),
+		float(pixel.y) / float(frameSize.y));
 
-	}
-	return iL;
+	//Normalized coordinates
+	vec2 nCoords = (2.0f * texCoord - 1.0f);
+	ray = cameraRay(inversinvProjectionView, eye, nCoords);
+
+	//Overflowing list
+	if (tileCount < 0)
+		return intersectObjects(ray, info);
+	return intersectTileObjects(ray, tileBase, info);
 }
 
-bool reflectRay(Ray ray,out vec4 iL, out vec4 reflection,out hitInfo j)
+//Outputs the color cached for the hit point by the previous frame, false if it has to be traced again
+bool reprojectHistory(ivec2 pixel, vec3 hitPt, hitInfo hit, out vec4 color)
 {
-	iL = vec4(0.0f, 0.0f, 0.0f, 0.0f);
-	if (intersectObjects(ray, j)) {
-		reflection = reflection;
-		vec3 intersectionPt = ray.origin + ray.dir * j.distFromCam;
-		iL += computeLighting(intersectionPt, j.normalAtPt, j.objIdx);
-		return true;
+	//Rolling refresh, scattered over the screen
+	uint pixelHash = uint(pixel.x) * 73856093u ^ uint(pixel.y) * 19349663u;
+	if (frameIndex == 0 || (pixelHash + uint(frameIndex)) % uint(temporalRefresh) == 0u)
+		return false;
+
+	vec4 prevClip = prevProjectionView * vec4(hitPt, 1.0f);
+	if (prevClip.w <= dnear)
+		return false;
+	ivec2 prevTexel = ivec2(floor((0.5f * prevClip.xy / prevClip.w + 0.5f) * vec2(frameSize) + 0.5f)) - regionOrigin;
+	if (prevTexel.x < 0 || prevTexel.y < 0 || prevTexel.x >= regionSize.x || prevTexel.y >= regionSize.y)
+		return false;
+
+	//Same object and same point, within the footprint of a pixel: otherwise disoccluded
+	vec4 prevHit = texelFetch(historyPosition, prevTexel, 0);
+	if (int(prevHit.w) != hit.objIdx || distance(prevHit.xyz, hitPt) > pixelAngle * hit.distFromCam)
+		return false;
+
+	//The cached color holds the reflections, which follow the view direction: the direction to the hit may only
+	//turn by a fraction of the bound per frame, so that it stays within the bound over the age of the color
+	if (dot(normalize(hitPt - eye), normalize(hitPt - prevEye.xyz)) < historyViewCos)
+		return false;
+
+	//Cached shading is carried along with the motion, bound its age
+	color = texelFetch(historyColor, prevTexel, 0);
+	return color.a < float(temporalRefresh - 1);
+}
+
+
+//Workgroup shape, defined by the chunk of the autotuned size when there is one
+\n#ifndef TRACE_GROUP_X\n
+\n#define TRACE_GROUP_X 8\n
+\n#define TRACE_GROUP_Y 8\n
+\n#endif\n
+layout(local_size_x = TRACE_GROUP_X, local_size_y = TRACE_GROUP_Y) in;
+
+\n#ifdef MORTON_ORDER\n
+//A workgroup covers a tile of TRACE_TILE_X x TRACE_TILE_Y pixels, as many as it has invocations, along a Z-curve:
+//the bits of the invocation index alternate between x and y while both sides have bits left
+uvec2 invocationPixel()
+{
+	uint index = gl_LocalInvocationIndex;
+	uvec2 local = uvec2(0u);
+	uvec2 bit = uvec2(1u);
+	while (index != 0u) {
+		if (bit.x < uint(TRACE_TILE_X)) {
+			local.x |= (index & 1u) * bit.x;
+			bit.x <<= 1u;
+			index >>= 1u;
+		}
+		if (bit.y < uint(TRACE_TILE_Y)) {
+			local.y |= (index & 1u) * bit.y;
+			bit.y <<= 1u;
+			index >>= 1u;
+		}
 	}
-	return false;
+	return gl_WorkGroupID.xy * uvec2(TRACE_TILE_X, TRACE_TILE_Y) + local;
 }
+\n#else\n
+//Row-major: the invocations of a workgroup cover its own shape
+uvec2 invocationPixel()
+{
+	return gl_GlobalInvocationID.xy;
+}
+\n#endif\n
 
+void main(void)
+{
 
-vec4 traceRay(vec3 origin, vec3 dir) {
-	Ray currentRay;
-	currentRay.origin = origin;
-	currentRay.dir = dir;
-	
-	vec4 iR = vec4(0.0f, 0.0f, 0.0f, 1.0f);	//Reflection Term
-	vec4 iE = vec4(0.0f, 0.0f, 0.0f, 1.0f); //Emission Term
+	ivec2 texel = ivec2(invocationPixel()) * pixelStride;
+	if (texel.x >= regionSize.x || texel.y >= regionSize.y) {
+		return;
+	}
+	if (refinePass && texel.x % (2 * pixelStride) == 0 && texel.y % (2 * pixelStride) == 0) {
+		return;
+	}
+	ivec2 pixel = regionOrigin + texel;
+\n#ifdef MULTI_VIEW\n
+	eye = views[gl_GlobalInvocationID.z].eye.xyz;
+	inversinvProjectionView = views[gl_GlobalInvocationID.z].invProjectionView;
+\n#else\n
+	eye = frameEye.xyz;
+\n#endif\n
+
+\n#ifdef RAY_STATS\n
+	resetRayStats();
+\n#endif\n
+	Ray ray;
+	hitInfo hit;
+	bool found;
+	if (rasterPrimary)
+		found = hitFromGBuffer(texel, ray, hit);
+	else
+		found = tracePrimary(texel, pixel, ray, hit);
+
+	bool deferReflections = reflectionScale > 1;
+	vec4 color = vec4(0.0f, 0.0f, 0.0f, 1.0f);
+	vec4 hitPos = vec4(0.0f, 0.0f, 0.0f, -1.0f);
+	if (found)
+		hitPos = vec4(ray.origin + ray.dir * hit.distFromCam, float(hit.objIdx));
+
+	if (deferReflections) {
+		if (!rasterPrimary) {
+			imageStore(hitPositionImage, texel, hitPos);
+			imageStore(hitNormalImage, texel, vec4(hit.normalAtPt, 0.0f));
+		}
+		if (found)
+			color = shadeDirect(ray, hit);
+\n#ifdef RAY_STATS\n
+		color = countedColor(color);
+\n#endif\n
+		storeColor(texel, color);
+		return;
+	}
 
-	//Used to stock reflection info throughout raycasting
-	vec4 iL_vect[reflectionMaxDepth];
-	vec4 reflection_vect[reflectionMaxDepth];
-	hitInfo i;
-	//Do the first ray casting
-	if (intersectObjects(currentRay, i)) {
-		iE += emission;
-		i.distFromCam = i.distFromCam;
+	float age = 0.0f;
+	if (found && temporalRefresh > 0 && reprojectHistory(pixel, hitPos.xyz, hit, color)) {
+		age = color.a + 1.0f;
+		color.a = 1.0f;
+	}
+	else if (found) {
+		color = shadeHit(ray, hit);
+		if (temporalRefresh > 0)
+			atomicAdd(tracedPixels, 1u);
+	}
 
-		vec3 intersectionPt = currentRay.origin + currentRay.dir * i.distFromCam;
+	if (temporalRefresh > 0) {
+		imageStore(historyColorOut, texel, vec4(color.rgb, age));
+		imageStore(historyPositionOut, texel, hitPos);
+	}
+\n#ifdef RAY_STATS\n
+	color = countedColor(color);
+\n#endif\n
+	storeColor(texel, color);
+}
+);
 
-		iL_vect[0] = computeLighting(intersectionPt, i.normalAtPt, i.objIdx);
-		reflection_vect[0] = reflection;
-		
-		//updating the ray
-		currentRay.origin = currentRay.origin + currentRay.dir * i.distFromCam;
-		float n_dot_dir = dot(i.normalAtPt, currentRay.dir);
-		currentRay.dir = currentRay.dir - 2.0f * n_dot_dir*i.normalAtPt;
-		//currentRay.dir = reflect(currentRay.dir, i.normalAtPt);	
+//Reduced resolution reflections: one invocation per block of reflectionScale x reflectionScale pixels,
+//the reflection chain of the block's center pixel is traced from its primary hit
+static const GLchar* reflectionCS = STRINGIFY(
 
-		//Reflect the ray depthMax-1 times
-		for (int depth = 1; depth < depthMax; depth++)
-		{
-			hitInfo j;
-			//No need to go through the rest of the iterations if we dont hit and object
-			if (!reflectRay(currentRay, iL_vect[depth], reflection_vect[depth], j))
-				break;
+layout(binding = 0, rgba32f) uniform writeonly image2D reflectionImage;
 
-			//updating the ray
-			currentRay.origin = currentRay.origin + currentRay.dir * j.distFromCam;
-			float n_dot_dir = dot(j.normalAtPt, currentRay.dir);
-			currentRay.dir = currentRay.dir - 2.0f * n_dot_dir*j.normalAtPt;
-			//currentRay.dir = reflect(currentRay.dir, j.normalAtPt);
-		}
+uniform int reflectionScale;
+uniform ivec2 frameSize;
 
-		//iReflect = iL + R*( iL' + R'*( iL" + ...))
-		for (int d = depthMax - 1; d >= 0; d--)
-		{
-			vec4 tmp = iR;
-			iR = iL_vect[d] + reflection_vect[d] * tmp;
-		}
+layout(local_size_x = 8, local_size_y = 8) in;
 
+void main(void)
+{
+	ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+	ivec2 reflectionSize = (frameSize + reflectionScale - 1) / reflectionScale;
+	if (texel.x >= reflectionSize.x || texel.y >= reflectionSize.y) {
+		return;
 	}
 
+	ivec2 source = min(texel * reflectionScale + reflectionScale / 2, frameSize - 1);
+	Ray ray;
+	hitInfo hit;
+	vec4 iR = vec4(0.0f, 0.0f, 0.0f, 0.0f);
+	if (hitFromGBuffer(source, ray, hit))
+		iR = traceReflections(reflectedRay(ray, hit));
 
-	return iR + iE;
+	imageStore(reflectionImage, texel, iR);
 }
+);
 
+//Composites the reduced resolution reflections over the direct lighting with a joint bilateral upsampling,
+//guided by the depth and normal of the primary hits
+static const GLchar* reflectionUpsampleCS = STRINGIFY(
+
+layout(binding = 0, rgba32f) uniform image2D framebuffer;
+layout(binding = 1) uniform sampler2D gPosition;
+layout(binding = 2) uniform sampler2D gNormal;
+layout(binding = 3) uniform sampler2D reflectionTex;
+
+uniform vec3 eye;
+uniform vec4 reflection;
+uniform int reflectionScale;
+uniform ivec2 frameSize;
+
+\n#define depthSharpness 50.0f\n
+\n#define normalSharpness 32.0f\n
 
 layout(local_size_x = 8, local_size_y = 8) in;
 
 void main(void)
 {
-
 	ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
-	ivec2 frameSize = imageSize(framebuffer);
 	if (texel.x >= frameSize.x || texel.y >= frameSize.y) {
 		return;
 	}
-	vec2 pos = vec2(texel) / vec2(frameSize.x, frameSize.y);
 
+	vec4 color = imageLoad(framebuffer, texel);
+	vec4 hitPos = texelFetch(gPosition, texel, 0);
+	if (hitPos.w < 0.0f) {
+		imageStore(framebuffer, texel, clamp(color, 0.0f, 1.0f));
+		return;
+	}
+	float depth = length(hitPos.xyz - eye);
+	vec3 normalAtPt = texelFetch(gNormal, texel, 0).xyz;
+
+	//Position of the pixel center in the reduced grid, whose samples sit at the block centers
+	ivec2 reflectionSize = (frameSize + reflectionScale - 1) / reflectionScale;
+	vec2 gridPos = (vec2(texel) + 0.5f) / float(reflectionScale) - 0.5f;
+	ivec2 base = ivec2(floor(gridPos));
+	vec2 bilinear = gridPos - vec2(base);
+
+	vec4 iR = vec4(0.0f, 0.0f, 0.0f, 0.0f);
+	float weightSum = 0.0f;
+	for (int dy = 0; dy < 2; dy++) {
+		for (int dx = 0; dx < 2; dx++) {
+			ivec2 sampleTexel = clamp(base + ivec2(dx, dy), ivec2(0), reflectionSize - 1);
+			ivec2 source = min(sampleTexel * reflectionScale + reflectionScale / 2, frameSize - 1);
+			vec4 samplePos = texelFetch(gPosition, source, 0);
+			if (samplePos.w < 0.0f)
+				continue;
+
+			float weight = (dx == 0 ? 1.0f - bilinear.x : bilinear.x) * (dy == 0 ? 1.0f - bilinear.y : bilinear.y);
+			weight *= exp(-depthSharpness * abs(length(samplePos.xyz - eye) - depth) / depth);
+			weight *= pow(max(dot(normalAtPt, texelFetch(gNormal, source, 0).xyz), 0.0f), normalSharpness);
+
+			iR += weight * texelFetch(reflectionTex, sampleTexel, 0);
+			weightSum += weight;
+		}
+	}
+	//No sample shares this surface, fall back to the closest one
+	if (weightSum > 1e-4f)
+		iR /= weightSum;
+	else
+		iR = texelFetch(reflectionTex, clamp(ivec2(gridPos + 0.5f), ivec2(0), reflectionSize - 1), 0);
 
-	vec2 texCoord = vec2(float(texel.x) / float(frameSize.x),
-		float(texel.y) / float(frameSize.y));
+	imageStore(framebuffer, texel, clamp(color + reflection * iR, 0.0f, 1.0f));
+}
+);
 
-	//Normalized coordinates
-	vec2 nCoords = (2.0f * texCoord - 1.0f);
+//Monte Carlo path tracing: each dispatch adds one sample per pixel to the accumulation image and outputs the mean.
+//One workgroup per tile, a tile stops sampling once the estimated noise of its pixels falls under noiseThreshold
+static const GLchar* pathTraceCS = STRINGIFY(
+
+uniform ivec2 frameSize;
+uniform mat4 inversinvProjectionView;
+uniform float noiseThreshold;
+uniform int minSamples;
+uniform int maxSamples;
+//Offsets the random sequences, to draw independent sets of samples
+uniform int seed;
+
+layout(binding = 0, rgba32f) uniform writeonly image2D framebuffer;
+//Sum of the samples in rgb and of their squared luminance in alpha
+layout(binding = 1, rgba32f) uniform image2D accumImage;
+//Guides of the denoiser written by the first sample: albedo of the primary hit, and its normal and distance.
+//The distance is negative on the background
+layout(binding = 2, rgba32f) uniform writeonly image2D albedoImage;
+layout(binding = 3, rgba32f) uniform writeonly image2D normalDepthImage;
+
+struct TileConvergence {
+	uint samples;
+	float noise;
+};
+
+//Cleared by the host to restart the accumulation, activeTiles counts the tiles sampled since the last read
+layout(std430, binding = 5) buffer Convergence {
+	uint activeTiles;
+	TileConvergence tiles[];
+};
+
+\n#define luminanceWeights vec3(0.2126f, 0.7152f, 0.0722f)\n
+
+//PCG random numbers, the sequence of a pixel only depends on its position and on the sample index
+uint rngState;
+
+uint pcgHash(uint v)
+{
+	uint state = v * 747796405u + 2891336453u;
+	uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+	return (word >> 22u) ^ word;
+}
+
+float random()
+{
+	rngState = pcgHash(rngState);
+	return float(rngState >> 8u) / 16777216.0f;
+}
+
+//Cosine weighted direction on the hemisphere around the normal
+vec3 cosineSample(vec3 normal)
+{
+	float phi = 6.2831853f * random();
+	float r2 = random();
+	vec3 tangent = normalize(cross(abs(normal.x) > 0.5f ? vec3(0.0f, 1.0f, 0.0f) : vec3(1.0f, 0.0f, 0.0f), normal));
+	vec3 bitangent = cross(normal, tangent);
+	return normalize(sqrt(r2) * (cos(phi) * tangent + sin(phi) * bitangent) + sqrt(1.0f - r2) * normal);
+}
+
+//Radiance along the ray: the direct lighting of every hit, and a bounce that is either the mirror reflection
+//or a diffuse one, chosen in proportion to their weights. Paths end after depthMax hits or by Russian roulette.
+//Also outputs the albedo, normal and distance of the primary hit
+vec3 tracePath(Ray ray, out vec3 primaryAlbedo, out vec4 primaryNormalDepth)
+{
+	primaryAlbedo = vec3(0.0f);
+	primaryNormalDepth = vec4(0.0f, 0.0f, 0.0f, -1.0f);
+	vec3 radiance = vec3(0.0f);
+	vec3 throughput = vec3(1.0f);
+	for (int bounce = 0; bounce < depthMax; bounce++)
+	{
+		hitInfo hit;
+		if (!intersectObjects(ray, hit))
+			break;
+
+		vec3 hitPt = ray.origin + ray.dir * hit.distFromCam;
+		if (dot(hit.normalAtPt, ray.dir) > 0.0f)
+			hit.normalAtPt = -hit.normalAtPt;
+
+		//Same emission term as the raytracer, on the primary hit only
+		if (bounce == 0) {
+			radiance += emission.rgb;
+			primaryAlbedo = vObjects[hit.objIdx].color.rgb;
+			primaryNormalDepth = vec4(hit.normalAtPt, hit.distFromCam);
+		}
+		radiance += throughput * max(computeLighting(hitPt, hit.normalAtPt, hit.objIdx).rgb, 0.0f);
+
+		vec3 albedo = vObjects[hit.objIdx].color.rgb;
+		float mirrorWeight = dot(reflection.rgb, vec3(1.0f));
+		float mirrorProbability = mirrorWeight / max(mirrorWeight + dot(albedo, vec3(1.0f)), 1e-6f);
+		if (random() < mirrorProbability) {
+			ray = reflectedRay(ray, hit);
+			throughput *= reflection.rgb / mirrorProbability;
+		}
+		else {
+			ray.origin = hitPt;
+			ray.dir = cosineSample(hit.normalAtPt);
+			throughput *= albedo / (1.0f - mirrorProbability);
+		}
 
+		//Past the first bounces, dim paths are ended early and the survivors weighted up
+		if (bounce >= 2) {
+			float survival = min(max(throughput.r, max(throughput.g, throughput.b)), 0.95f);
+			if (random() >= survival)
+				break;
+			throughput /= survival;
+		}
+	}
+	return radiance;
+}
 
-	//Setting up the ray from camera to the texel
-	float frustumDepth = dfar - dnear;
-	float frustumSum = dfar + dnear;
-	vec4 camRay = inversinvProjectionView * vec4(nCoords * frustumDepth, frustumSum, frustumDepth);
-	vec3 dir = normalize(camRay).xyz;
+layout(local_size_x = tileSize, local_size_y = tileSize) in;
 
+//Sum of the noise of the pixels of the tile in 16.16 fixed point, and their number
+shared uint tileNoise;
+shared uint tilePixels;
 
-	vec4 color = traceRay(eye, dir);
+void main(void)
+{
+	uint tileIdx = gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x;
+	uint samples = tiles[tileIdx].samples;
+	//The whole workgroup leaves before the barriers
+	if (samples >= uint(maxSamples) || (samples >= uint(minSamples) && tiles[tileIdx].noise < noiseThreshold))
+		return;
 
-	imageStore(framebuffer, texel, clamp(color, 0.0f, 1.0f));
+	if (gl_LocalInvocationIndex == 0u) {
+		tileNoise = 0u;
+		tilePixels = 0u;
+		atomicAdd(activeTiles, 1u);
+	}
+	memoryBarrierShared();
+	barrier();
+
+	ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+	if (pixel.x < frameSize.x && pixel.y < frameSize.y) {
+		rngState = pcgHash(uint(pixel.x) + pcgHash(uint(pixel.y) + pcgHash(samples + uint(seed))));
+
+		//Primary ray through a random point of the pixel
+		vec2 texCoord = (vec2(pixel) + vec2(random(), random())) / vec2(frameSize);
+		vec2 nCoords = (2.0f * texCoord - 1.0f);
+		float frustumDepth = dfar - dnear;
+		float frustumSum = dfar + dnear;
+		vec4 camRay = inversinvProjectionView * vec4(nCoords * frustumDepth, frustumSum, frustumDepth);
+		Ray ray;
+		ray.origin = eye;
+		ray.dir = normalize(camRay).xyz;
+
+		vec3 albedo;
+		vec4 normalDepth;
+		vec3 radiance = tracePath(ray, albedo, normalDepth);
+		if (samples == 0u) {
+			imageStore(albedoImage, pixel, vec4(albedo, 1.0f));
+			imageStore(normalDepthImage, pixel, normalDepth);
+		}
+		float luminance = dot(radiance, luminanceWeights);
+		vec4 sum = vec4(radiance, luminance * luminance);
+		if (samples > 0u)
+			sum += imageLoad(accumImage, pixel);
+		imageStore(accumImage, pixel, sum);
+
+		float n = float(samples + 1u);
+		vec3 mean = sum.rgb / n;
+		imageStore(framebuffer, pixel, vec4(clamp(mean, 0.0f, 1.0f), 1.0f));
+
+		//Standard error of the mean luminance, relative to the luminance. Dark pixels are measured against a floor,
+		//their noise is not visible
+		float meanLuminance = dot(mean, luminanceWeights);
+		float variance = max(sum.a / n - meanLuminance * meanLuminance, 0.0f) / n;
+		float noise = sqrt(variance) / max(meanLuminance, 0.1f);
+		atomicAdd(tileNoise, uint(min(noise, 16.0f) * 65536.0f));
+		atomicAdd(tilePixels, 1u);
+	}
+	memoryBarrierShared();
+	barrier();
+
+	if (gl_LocalInvocationIndex == 0u) {
+		tiles[tileIdx].samples = samples + 1u;
+		tiles[tileIdx].noise = float(tileNoise) / (65536.0f * float(max(tilePixels, 1u)));
+	}
+}
+);
+
+//One pass of the edge-aware a-trous wavelet filter, see AtrousDenoiser for the CPU version.
+//The taps of the 5x5 B3 spline kernel are stepWidth pixels apart, and weighted down by the differences of color,
+//albedo, normal and depth with the center pixel
+static const GLchar* atrousCS = STRINGIFY(
+
+layout(binding = 0, rgba32f) uniform writeonly image2D filteredImage;
+layout(binding = 0) uniform sampler2D colorTex;
+layout(binding = 1) uniform sampler2D albedoTex;
+layout(binding = 2) uniform sampler2D normalDepthTex;
+
+uniform ivec2 frameSize;
+uniform int stepWidth;
+uniform float sigmaColor;
+uniform float sigmaAlbedo;
+uniform float sigmaDepth;
+
+layout(local_size_x = 8, local_size_y = 8) in;
+
+void main(void)
+{
+	ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+	if (texel.x >= frameSize.x || texel.y >= frameSize.y) {
+		return;
+	}
+
+	vec4 color = texelFetch(colorTex, texel, 0);
+	vec4 normalDepth = texelFetch(normalDepthTex, texel, 0);
+	if (normalDepth.w < 0.0f) {
+		imageStore(filteredImage, texel, color);
+		return;
+	}
+	vec3 albedo = texelFetch(albedoTex, texel, 0).rgb;
+
+	float kernel[5] = float[5](1.0f / 16.0f, 1.0f / 4.0f, 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f);
+	float colorScale = 1.0f / (sigmaColor * sigmaColor);
+	float albedoScale = 1.0f / (sigmaAlbedo * sigmaAlbedo);
+	float depthScale = 1.0f / (sigmaDepth * float(stepWidth) * normalDepth.w);
+	vec3 sum = vec3(0.0f);
+	float weightSum = 0.0f;
+	for (int dy = -2; dy <= 2; dy++) {
+		for (int dx = -2; dx <= 2; dx++) {
+			ivec2 tap = clamp(texel + ivec2(dx, dy) * stepWidth, ivec2(0), frameSize - 1);
+			vec3 tapColor = texelFetch(colorTex, tap, 0).rgb;
+			vec3 tapAlbedo = texelFetch(albedoTex, tap, 0).rgb;
+			vec4 tapNormalDepth = texelFetch(normalDepthTex, tap, 0);
+
+			vec3 dc = tapColor - color.rgb;
+			vec3 da = tapAlbedo - albedo;
+			float exponent = dot(dc, dc) * colorScale + dot(da, da) * albedoScale + abs(tapNormalDepth.w - normalDepth.w) * depthScale;
+			float weight = kernel[dx + 2] * kernel[dy + 2] * pow(max(dot(tapNormalDepth.xyz, normalDepth.xyz), 0.0f), 64.0f) * exp(-exponent);
+			sum += weight * tapColor;
+			weightSum += weight;
+		}
+	}
+	imageStore(filteredImage, texel, vec4(sum / weightSum, color.a));
 }
-);
\ No newline at end of file
+);
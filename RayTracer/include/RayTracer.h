@@ -0,0 +1,87 @@
+#ifndef RAYTRACER_H
+#define RAYTRACER_H
+
+#include <stdint.h>
+#include <vector>
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+
+#include "Scene.h"
+#include "RenderGraph.h"
+#include "DynamicBuffer.h"
+
+//State and stages of the renderer defined in RayTracer.cpp, shared with the modes that live in their own files:
+//the benchmarks, the poster and the render server. The options are described with their definitions
+
+//Host side mirrors of the shader limits, they must match the defines of RayTraceShader.h
+#define TILE_OBJECTS_MAX_NBR 32
+#define LIGHTS_MAX_NBR 64
+#define CULL_TILE_SIZE 16
+
+//Camera
+extern double eye[3];
+extern double focus[3];
+extern double hfov, dnear, dfar;
+extern glm::mat4 view, projection;
+
+//Scene given to the shaders, and the procedural scene replacing the built-in room
+extern Scene scene;
+extern const char* generatedKind;
+extern int generatedObjectsNbr, generatedLightsNbr;
+extern uint32_t sceneSeed;
+
+//OpenGL variables
+extern GLFWwindow* glContext;
+extern bool hiddenWindow;
+extern GLuint texture, tileBuffer, sceneBuffer;
+extern GLuint albedoTexture, normalDepthTexture;
+extern GLuint viewsTexture;
+extern RenderGraph renderGraph;
+extern DynamicBuffer frameDataRing;
+
+//Trace targets used round robin by render()
+extern int traceTargetsNbr;
+extern GLuint traceTargets[];
+extern double traceTargetWaitMs;
+extern int traceTargetWaits;
+
+//Options of the modes
+extern bool rasterPrimary, progressive, rayStats, mortonOrder;
+extern int reflectionScale, temporalRefresh, profileFrames, pathSeed;
+extern double orbitStep, targetFrameMs, noiseThreshold, statsGpuMs;
+extern const char* profilePath;
+extern int traceGroupX, traceGroupY;
+
+//Setting the scene
+void buildDefaultScene();
+void uploadScene(const Scene & sceneData, GLuint buffer);
+void orbitCamera(double azimuth, double elevation);
+bool setGLVariables(const int width, const int height);
+bool buildTraceShader(int x, int y);
+bool mortonTile(int x, int y, int & tileX, int & tileY);
+
+//Rendering, an empty region of render() covers the whole window
+void render(int width, int height, int depth, glm::ivec4 region = glm::ivec4(0));
+int addTraceRegion(int frameWidth, int frameHeight, int regionX, int regionY, int width, int height, int depth,
+	int stride = 1, bool refine = false);
+void traceRegion(int frameWidth, int frameHeight, int regionX, int regionY, int width, int height, int depth,
+	int stride = 1, bool refine = false);
+void resizeViewTargets(int width, int height, int layers);
+void traceViews(const std::vector<glm::mat4> & cameras, int width, int height, int depth);
+void governResolution(double frameMs);
+
+//Path tracing and ray statistics
+void resetAccumulation();
+void pathTraceFrame(int width, int height, int depth);
+GLuint denoiseFrame(int width, int height);
+void readRayStats();
+void resetRayStats();
+void reportRayStats();
+
+//Frame timing
+double readTracedFraction();
+double timeFrames(int width, int height, int depth, int frames);
+
+#endif
@@ -0,0 +1,121 @@
+#ifndef RENDER_GRAPH_H
+#define RENDER_GRAPH_H
+
+#include <glad/glad.h>
+
+#include <stddef.h>
+#include <vector>
+
+//Frames of pass timings in flight, and passes timed per frame
+#define RENDER_GRAPH_LATENCY 4
+#define RENDER_GRAPH_TIMED_PASSES 16
+
+//Access of a pass to a resource. The barrier placed before a pass depends on how it accesses, reading or writing,
+//a resource last written with image stores or storage buffer writes, the only writes that are not ordered with
+//the next commands
+enum RenderAccess
+{
+	RENDER_IMAGE,
+	RENDER_SAMPLED,
+	RENDER_STORAGE,
+	RENDER_ATTACHMENT,
+	//glCopyImageSubData and the other texture updates
+	RENDER_COPY,
+};
+
+//Passes of a frame declared with the resources they read and write, then executed in the order they were added.
+//The graph places before each pass the barrier its accesses need and no other one, and allocates the transient
+//textures from a pool: two transient textures of the same size and format whose lifetimes do not overlap share
+//one texture. Imported resources are assumed to hold writes from before the graph, their first access gets a barrier.
+//The graph is declared again every frame, its storage is kept from one frame to the next
+class RenderGraph
+{
+public:
+	void reset();
+	//The name must be a literal, it is kept for the report
+	int importTexture(const char* name, GLuint texture, int width, int height, GLenum format);
+	int importBuffer(const char* name, GLuint buffer);
+	int createTexture(const char* name, int width, int height, GLenum format);
+
+	//The pass runs fn(data), data has to live until execute
+	int addPass(const char* name, void (*fn)(void* data), void* data);
+	//Accesses of a pass added to the graph to a resource imported or created in it, the others are rejected
+	void read(int pass, int resource, RenderAccess access);
+	void write(int pass, int resource, RenderAccess access);
+
+	//Allocates the transient textures, places the barriers and runs the passes
+	void execute();
+	//Texture of a resource, the transient ones are only allocated once execute has started
+	GLuint texture(int resource) const;
+
+	//Times the passes on the GPU from now on, report prints the average time and the barrier of each pass since,
+	//and the peak memory of the resources with and without aliasing
+	void startTiming();
+	void report();
+	void release();
+
+private:
+	struct Resource
+	{
+		const char* name;
+		GLuint object;
+		int width, height;
+		GLenum format;
+		bool transient;
+		int firstPass, lastPass;
+		int physical;
+		//Written with a shader write not made visible to the accesses missing from visibleBits yet
+		bool pending;
+		GLbitfield visibleBits;
+	};
+	struct Access
+	{
+		int pass, resource;
+		RenderAccess access;
+		bool write;
+	};
+	struct Pass
+	{
+		const char* name;
+		void (*fn)(void* data);
+		void* data;
+		GLbitfield barrierBits;
+	};
+	struct Physical
+	{
+		GLuint texture;
+		int width, height;
+		GLenum format;
+		int busyUntil;
+		bool used;
+	};
+	struct PassTotal
+	{
+		const char* name;
+		GLbitfield barrierBits;
+		double totalMs;
+		int calls;
+	};
+
+	bool checkAccess(int pass, int resource) const;
+	void allocateTransients();
+	void placeBarriers();
+	void collectTimings(int frame, bool wait);
+
+	std::vector<Resource> _resources;
+	std::vector<Access> _accesses;
+	std::vector<Pass> _passes;
+	std::vector<Physical> _pool;
+
+	bool _timing{};
+	GLuint _queries[RENDER_GRAPH_LATENCY][2 * RENDER_GRAPH_TIMED_PASSES]{};
+	const char* _queryNames[RENDER_GRAPH_LATENCY][RENDER_GRAPH_TIMED_PASSES]{};
+	GLbitfield _queryBarriers[RENDER_GRAPH_LATENCY][RENDER_GRAPH_TIMED_PASSES]{};
+	int _queryCounts[RENDER_GRAPH_LATENCY]{};
+	int _frame{};
+	std::vector<PassTotal> _totals;
+	int _timedFrames{};
+	size_t _peakBytes{}, _peakUnaliasedBytes{}, _peakImportedBytes{};
+};
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef RENDERSERVER_H
+#define RENDERSERVER_H
+
+//Connect to a coordinator and render the tiles it hands out until the frame is complete
+int runWorker(const char* address);
+
+//Keep the context, the programs and up to scenesNbr scenes warm, and render the jobs of the clients connecting
+//on the address
+int runServer(const char* address, int scenesNbr);
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/glm.hpp>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+//Object types, as stored in Object.type by the shaders
+#define OBJECT_SPHERE 0.0f
+#define OBJECT_BOX 1.0f
+
+//Same fields as the Object struct of the shaders, spheres use pos and r, boxes min and max
+struct SceneObject
+{
+	float type;
+	glm::vec3 pos;
+	float r;
+	glm::vec3 min;
+	glm::vec3 max;
+	glm::vec4 color;
+};
+
+struct SceneLight
+{
+	glm::vec3 pos;
+	glm::vec4 color;
+};
+
+struct Scene
+{
+	std::vector<SceneObject> objects;
+	std::vector<SceneLight> lights;
+	glm::vec4 emission;
+	glm::vec4 reflection;
+};
+
+//Flat binary copy of the scene, to ship it to other processes of the same architecture
+void serializeScene(const Scene & scene, std::vector<char> & data);
+bool deserializeScene(const char* data, size_t size, Scene & scene);
+
+//Deterministic procedural scene of objectsNbr objects lit by lightsNbr lights, the same seed gives the same
+//scene on every platform. Kind is one of:
+//  spheres   spheres of random sizes scattered uniformly over a floor
+//  clusters  boxes packed around a few random centers
+//  city      a grid of buildings of random heights
+//  cornell   a room open toward the camera and the sky, red and green side walls, filled with spheres and boxes
+//All kinds fit in the bounds of the default room, seen by the default camera. Outputs false for an unknown kind
+bool generateScene(const char* kind, int objectsNbr, int lightsNbr, uint32_t seed, Scene & scene);
+
+#endif
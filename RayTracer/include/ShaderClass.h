@@ -8,7 +8,9 @@
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/glm.hpp>
 
+#include <string.h>
 #include <string>
+#include <vector>
 
 class Shader
 {
@@ -17,7 +19,11 @@ public:
 
 	//Init Shaders from string code
 	bool init(const char* vertexShader, const char* fragmentShader = nullptr);
+	//Init Shaders from several code chunks each, concatenated in the given order
+	bool init(const std::vector<const char*> & vertexShaderChunks, const std::vector<const char*> & fragmentShaderChunks);
 	bool initComputeShader(const char* computeShader);
+	//Init a compute shader from several code chunks, concatenated in the given order
+	bool initComputeShader(const std::vector<const char*> & computeShaderChunks);
 
 	//Use the Shader
 	void use()
@@ -26,38 +32,72 @@ public:
 	}
 	GLuint getID(){ return _ID; }
 	//Set an int input
-	void setInt(const std::string &name, int value) const
+	void setInt(const char* name, int value) const
 	{
-		glUniform1i(glGetUniformLocation(_ID, name.c_str()), value);
+		glUniform1i(location(name), value);
 	}
 
 	//Set a float input
-	void setFloat(const std::string &name, float value) const
+	void setFloat(const char* name, float value) const
 	{
-		glUniform1f(glGetUniformLocation(_ID, name.c_str()), value);
+		glUniform1f(location(name), value);
 	}
 
 
+	//Set an ivec2 input
+	void setIVec2(const char* name, const glm::ivec2 &vec) const
+	{
+		glUniform2iv(location(name), 1, &vec[0]);
+	}
+
+	//Set a vec2 input
+	void setVec2(const char* name, const glm::vec2 &vec) const
+	{
+		glUniform2fv(location(name), 1, &vec[0]);
+	}
+
 	//Set a vec3 input
-	void setVec3(const std::string &name, const glm::vec3 &vec) const
+	void setVec3(const char* name, const glm::vec3 &vec) const
 	{
-		glUniform3fv(glGetUniformLocation(_ID, name.c_str()), 1, &vec[0]);
+		glUniform3fv(location(name), 1, &vec[0]);
 	}
 
 	//Set a vec4 input
-	void setVec4(const std::string &name, const glm::vec4 &vec) const
+	void setVec4(const char* name, const glm::vec4 &vec) const
 	{
-		glUniform4fv(glGetUniformLocation(_ID, name.c_str()), 1, &vec[0]);
+		glUniform4fv(location(name), 1, &vec[0]);
 	}
 	//Set a mat4 input
-	void setMat4(const std::string &name, const glm::mat4 &mat) const
+	void setMat4(const char* name, const glm::mat4 &mat) const
 	{
-		glUniformMatrix4fv(glGetUniformLocation(_ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+		glUniformMatrix4fv(location(name), 1, GL_FALSE, &mat[0][0]);
 	}
 
 	//Check linking Errors
 	GLint checkProgramLinkingErrors();
 private:
+	//Location of a uniform, looked up once per name. The names are kept: they must be literals, whose address is
+	//tried before the text
+	GLint location(const char* name) const
+	{
+		for (size_t i = 0; i < _locations.size(); i++)
+			if (_locations[i].name == name)
+				return _locations[i].location;
+		for (size_t i = 0; i < _locations.size(); i++)
+			if (strcmp(_locations[i].name, name) == 0)
+				return _locations[i].location;
+		GLint location = glGetUniformLocation(_ID, name);
+		_locations.push_back({ name, location });
+		return location;
+	}
+
+	struct UniformLocation
+	{
+		const char* name;
+		GLint location;
+	};
+	mutable std::vector<UniformLocation> _locations;
+
 	// utility function for checking shader compilation/linking errors.
 	GLint checkCompileErrors(GLuint shader, const std::string & type);
 };
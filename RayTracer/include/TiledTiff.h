@@ -0,0 +1,49 @@
+#ifndef TILED_TIFF_H
+#define TILED_TIFF_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+//Streams an uncompressed RGB8 tiled TIFF to disk. The tiles are written as they arrive, in any order,
+//and only their offsets are kept in memory. Switches to BigTIFF past 4GB
+class TiledTiffWriter
+{
+public:
+	~TiledTiffWriter();
+
+	//The tile size must be a multiple of 16
+	bool open(const char* path, int width, int height, int tileSize);
+	//Tile (tileX, tileY) counted from the top left corner, tileSize x tileSize texels top row first.
+	//The texels of the edge tiles outside the image are ignored by readers
+	bool writeTile(int tileX, int tileY, const unsigned char* rgb);
+	//Writes the directory, false if a tile is missing or the file could not be written
+	bool close();
+
+	int tilesX() const { return _tilesX; }
+	int tilesY() const { return _tilesY; }
+
+private:
+	struct Entry
+	{
+		uint16_t tag;
+		uint16_t type;
+		uint64_t count;
+		std::vector<unsigned char> data;
+		uint64_t offset;
+	};
+
+	bool write(const void* data, size_t size);
+	void addEntry(uint16_t tag, uint16_t type, const std::vector<uint64_t> & values);
+
+	FILE* _file{};
+	bool _bigTiff{};
+	bool _failed{};
+	uint64_t _position{};
+	int _width{}, _height{}, _tileSize{};
+	int _tilesX{}, _tilesY{};
+	std::vector<uint64_t> _tileOffsets;
+	std::vector<Entry> _entries;
+};
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef TRACE_SHARED_H
+#define TRACE_SHARED_H
+
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/glm.hpp>
+
+#include "Scene.h"
+
+//C++ side of the code shared with the shaders, TraceSharedCode.h compiled with glm in the trace namespace.
+//The globals stand for the scene buffer and the uniforms of the shaders, they are set by trace_SetScene and
+//only read while tracing, so the rows of a frame can be traced on several threads
+namespace trace
+{
+	using namespace glm;
+
+	typedef SceneObject Object;
+	typedef SceneLight Light;
+
+	extern const Object* vObjects;
+	extern int objectsNbr;
+	extern const Light* vLights;
+	extern int lightsNbr;
+	extern vec4 emission;
+	extern vec4 reflection;
+	extern float dnear;
+	extern float dfar;
+	extern int depthMax;
+
+	//The rays are only counted by the shaders
+	enum { PRIMARY_RAY, REFLECTION_RAY, SHADOW_RAY };
+	inline void countRay(int, int) {}
+	inline void setStatsDepth(int) {}
+
+#define TRACE_INLINE inline
+#define TRACE_OUT(T) T &
+#define TRACE_SHARED(name, ...) __VA_ARGS__
+#include "TraceSharedCode.h"
+#undef TRACE_SHARED
+#undef TRACE_OUT
+#undef TRACE_INLINE
+}
+
+//Points the shared code at the scene, which must outlive the traces, with the depth and clipping planes of the frame
+void trace_SetScene(const Scene & scene, float dnear, float dfar, int depth);
+
+//Side of the square tiles of the Morton order on the CPU
+#define TRACE_CPU_TILE 16
+
+//Traces the frame on the CPU as the raytracing shader does, with the primary rays tested against all the objects
+//instead of the tile lists. Outputs width x height RGBA floats, the first row at the bottom. The threads take the
+//rows in row-major order, or with morton the tiles of TRACE_CPU_TILE pixels, each traced along a Z-curve.
+//Without threaded the calling thread traces the whole frame
+void trace_RenderCpu(const glm::mat4 & invProjectionView, const glm::vec3 & eye, int width, int height, float* rgba,
+	bool morton = false, bool threaded = true);
+
+#endif
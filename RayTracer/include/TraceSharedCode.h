@@ -0,0 +1,191 @@
+//Intersection and shading code written once for the shaders and the CPU, see TraceShared.h for the C++ side and
+//RayTraceShader.h for the shader side. It is compiled as GLSL and as C++ with glm, so it keeps to what both read
+//the same way:
+//  o no preprocessor lines and no swizzles, glm only has them with GLM_FORCE_SWIZZLE
+//  o functions prefixed with TRACE_INLINE and out parameters through TRACE_OUT(type), a reference in C++
+//  o float literals with the f suffix, no implicit conversions between int and float
+//  o functions declared before they are used, globals only from the scene, the uniforms and the ray counters
+//    that both sides provide: objectsNbr, vObjects, lightsNbr, vLights, emission, reflection, dnear, dfar,
+//    depthMax, countRay and setStatsDepth
+//Each block becomes the GLSL chunk it names. Included twice, no include guard
+
+//Ray/object intersections shared by the raytracing and the G-buffer shaders
+TRACE_SHARED(intersectionGLSL,
+
+struct Ray {
+	vec3 origin;
+	vec3 dir;
+};
+
+
+struct hitInfo {
+	float distFromCam;
+	int objIdx;
+	vec3 normalAtPt;
+};
+
+
+//Returns the distances from the origin of the ray to the closest hit and outputs the normal
+TRACE_INLINE float boxIntersect(Ray ray, vec3 minCorner, vec3 maxCorner, TRACE_OUT(vec3) outNormal) {
+
+	vec3 tMin = (minCorner - ray.origin) / ray.dir;
+	vec3 tMax = (maxCorner - ray.origin) / ray.dir;
+	vec3 t1 = min(tMin, tMax);
+	vec3 t2 = max(tMin, tMax);
+
+	float tN = max(max(t1.x, t1.y), t1.z);
+	float tF = min(min(t2.x, t2.y), t2.z);
+	outNormal = -sign(ray.dir)*step(vec3(t1.y, t1.z, t1.x), t1)*step(vec3(t1.z, t1.x, t1.y), t1);
+
+	if (tN > tF) return -1.0f; // no intersection
+	else return tN;
+
+}
+
+//Returns the distances from the origin of the ray to the closest hit and outputs the normal
+TRACE_INLINE float sphereIntersect(Ray ray, vec3 center, float radius, TRACE_OUT(vec3) outNormal)
+{
+
+	vec3 oc = ray.origin - center;
+	float b = dot(oc, ray.dir);
+	float c = dot(oc, oc) - radius * radius;
+	float h = b * b - c;
+	if (h < 0.0f) return -1.0f; // no intersection
+	h = sqrt(h);
+	float dist = -b - h;
+
+	vec3 nrml = (1.0f / radius)*(ray.origin + dist * ray.dir - center);
+	float nrml_norm = dot(nrml, nrml);
+	outNormal = nrml / nrml_norm;
+
+	return dist;
+}
+
+
+//Returns the distance from the origin of the ray to the hit with the object i and outputs the normal
+TRACE_INLINE float objectIntersect(Ray ray, int i, TRACE_OUT(vec3) normalAtPt)
+{
+	if (vObjects[i].type == 0.0f)
+		return sphereIntersect(ray, vObjects[i].pos, vObjects[i].r, normalAtPt);
+	else
+		return boxIntersect(ray, vObjects[i].min, vObjects[i].max, normalAtPt);
+}
+)
+
+//Primary rays, direct lighting and reflections, after the uniforms and the ray counters of shadingGLSL
+TRACE_SHARED(traceShadingGLSL,
+
+//Primary ray through the normalized coordinates nCoords of the frame, from the eye
+TRACE_INLINE Ray cameraRay(mat4 invProjectionView, vec3 origin, vec2 nCoords)
+{
+	//Setting up the ray from camera to the texel
+	float frustumDepth = dfar - dnear;
+	float frustumSum = dfar + dnear;
+	vec4 camRay = invProjectionView * vec4(nCoords * frustumDepth, frustumSum, frustumDepth);
+	Ray ray;
+	ray.origin = origin;
+	ray.dir = vec3(normalize(camRay));
+	return ray;
+}
+
+//returns wether an object is hit along the ray and stocks the results in the hitInfo
+TRACE_INLINE bool intersectObjects(Ray ray, TRACE_OUT(hitInfo) info) {
+
+	//start the furthest point in the frustum
+	float closest = dfar;
+	bool found = false;
+
+	for (int i = 0; i < objectsNbr; i++) {
+		vec3 normalAtPt;
+		float distFromCam = objectIntersect(ray, i, normalAtPt);
+
+		//set up the intersection with the closest hit
+		if (distFromCam > 0.0f && distFromCam < closest) {
+			closest = distFromCam;
+			info.distFromCam = 0.99f * distFromCam;
+			info.objIdx = i;
+			info.normalAtPt = normalAtPt;
+			found = true;
+
+		}
+	}
+	return found;
+}
+
+//Apply lighting to the objects
+TRACE_INLINE vec4 computeLighting(vec3 intersectionPt, vec3 normalAtPt, int objIdx)
+{
+	vec4 iL = vec4(0.0f, 0.0f, 0.0f, 0.0f);
+	// Go though all light sources to update texel colors
+	for (int l = 0; l < lightsNbr; l++)
+	{
+		hitInfo j;
+
+		vec3 shadowRayDir = normalize(vLights[l].pos - intersectionPt);
+		Ray shadowRay;
+		shadowRay.origin = intersectionPt;
+		shadowRay.dir = shadowRayDir;
+		countRay(SHADOW_RAY, objectsNbr);
+		//if no object was found, we set the color, we set to shadow color otherwise
+		if (!intersectObjects(shadowRay, j))
+		{
+			float light_cos = dot(normalAtPt, shadowRayDir);
+			iL += light_cos * vObjects[objIdx].color*vLights[l].color;
+
+		}
+
+	}
+	return iL;
+}
+
+//Emission and direct lighting at the hit i of the ray
+TRACE_INLINE vec4 shadeDirect(Ray ray, hitInfo i)
+{
+	vec4 iE = vec4(0.0f, 0.0f, 0.0f, 1.0f) + emission; //Emission Term
+	vec3 intersectionPt = ray.origin + ray.dir * i.distFromCam;
+	return iE + computeLighting(intersectionPt, i.normalAtPt, i.objIdx);
+}
+
+//Mirror reflection of the ray at the hit i
+TRACE_INLINE Ray reflectedRay(Ray ray, hitInfo i)
+{
+	Ray reflected;
+	reflected.origin = ray.origin + ray.dir * i.distFromCam;
+	float n_dot_dir = dot(i.normalAtPt, ray.dir);
+	reflected.dir = ray.dir - 2.0f * n_dot_dir*i.normalAtPt;
+	return reflected;
+}
+
+//Follows the reflected ray through depthMax-1 bounces
+//iReflect = iL' + R*( iL" + R*( ...))
+TRACE_INLINE vec4 traceReflections(Ray currentRay)
+{
+	vec4 iR = vec4(0.0f, 0.0f, 0.0f, 0.0f);
+	vec4 attenuation = vec4(1.0f, 1.0f, 1.0f, 1.0f);
+	for (int depth = 1; depth < depthMax; depth++)
+	{
+		hitInfo j;
+		setStatsDepth(depth);
+		countRay(REFLECTION_RAY, objectsNbr);
+		//No need to go through the rest of the iterations if we dont hit and object
+		if (!intersectObjects(currentRay, j))
+			break;
+
+		vec3 intersectionPt = currentRay.origin + currentRay.dir * j.distFromCam;
+		iR += attenuation * computeLighting(intersectionPt, j.normalAtPt, j.objIdx);
+		attenuation *= reflection;
+
+		currentRay = reflectedRay(currentRay, j);
+	}
+	return iR;
+}
+
+//Color of a pixel whose primary ray hits: direct lighting and the chain of reflections
+TRACE_INLINE vec4 shadeHit(Ray ray, hitInfo hit)
+{
+	vec4 color = shadeDirect(ray, hit);
+	color += reflection * traceReflections(reflectedRay(ray, hit));
+	return clamp(color, 0.0f, 1.0f);
+}
+
+)
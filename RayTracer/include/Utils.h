@@ -1,6 +1,8 @@
 #ifndef UTILS_H
 #define UTILS_H
 
+#include <vector>
+
 
 //Used for outputting error messages
 void error_callback(int err_code, const char* err_str);
@@ -11,4 +13,18 @@ bool check_FB_Status();
 
 void init_Quad(unsigned int shaderID, unsigned int  & quadVAO, unsigned int  & quadVBO);
 
+//Reads back the level 0 of an RGBA texture as floats, false if the level is not width x height
+bool read_Texture(unsigned int texture, int width, int height, std::vector<float> & pixels);
+//Same into width x height x 4 floats allocated by the caller
+bool read_Texture(unsigned int texture, int width, int height, float* pixels);
+
+//Reads back the level 0 of all the layers of an RGBA array texture as floats, false if the size differs
+bool read_TextureLayers(unsigned int texture, int width, int height, int layers, std::vector<float> & pixels);
+
+//Root mean square error between the RGB channels of two RGBA images
+double compute_RMSE(const std::vector<float> & image, const std::vector<float> & reference);
+
+//Writes a binary PPM from RGB8 texels, top row first
+bool write_PPM(const char* path, int width, int height, const std::vector<unsigned char> & rgb);
+
 #endif
\ No newline at end of file